@@ -0,0 +1,65 @@
+#include "bench.hpp"
+
+#include <new>
+#include <atomic>
+#include <cstdlib>
+
+// Replaces the global allocation functions of the whole program, so the
+// allocations of the engine and its threads are counted too. The array and
+// nothrow forms forward to these by default.
+
+namespace
+{
+
+std::atomic<uint64_t> allocations{ 0 };
+
+} // namespace
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    // aligned_alloc wants a multiple of the alignment
+    size_t rounded = (size + align - 1) / align * align;
+    if (void* pointer = std::aligned_alloc(align, rounded ? rounded : align))
+        return pointer;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    std::free(pointer);
+}
+
+namespace baldwin
+{
+namespace bench
+{
+
+uint64_t allocationCount()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+} // namespace bench
+} // namespace baldwin
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <filesystem>
+#include <functional>
+
+namespace baldwin
+{
+namespace bench
+{
+
+using Clock = std::chrono::steady_clock;
+
+inline double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+struct BenchOptions
+{
+    int frames = 300;
+    // Run before measuring so pipelines, uploads and caches settle
+    int warmupFrames = 30;
+    int width = 1280;
+    int height = 720;
+    std::filesystem::path assets = "assets";
+};
+
+// Metrics keep their insertion order in the report
+struct BenchResult
+{
+    std::string name;
+    std::vector<std::pair<std::string, double>> metrics;
+    std::string error;
+
+    void add(std::string key, double value)
+    {
+        metrics.emplace_back(std::move(key), value);
+    }
+};
+
+struct Scenario
+{
+    std::string name;
+    std::string description;
+    std::function<void(const BenchOptions&, BenchResult&)> run;
+};
+
+// Headless frames through the whole engine
+std::vector<Scenario> renderScenarios();
+// Engine systems measured on their own, no GPU needed
+std::vector<Scenario> cpuScenarios();
+
+// Heap allocations made by every thread since the start of the program
+uint64_t allocationCount();
+
+} // namespace bench
+} // namespace baldwin
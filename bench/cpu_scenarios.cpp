@@ -0,0 +1,444 @@
+#include "bench.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <thread>
+#include <stdexcept>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include "loader/gltf.hpp"
+#include "loader/mesh_optimizer.hpp"
+#include "loader/mesh_simplifier.hpp"
+#include "loader/meshlet_builder.hpp"
+#include "renderer/bounds.hpp"
+#include "renderer/culling.hpp"
+#include "renderer/vertex_compression.hpp"
+#include "utils/job_system.hpp"
+
+namespace baldwin
+{
+namespace bench
+{
+
+namespace
+{
+
+// Same camera as the renderer
+Frustum benchFrustum()
+{
+    glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, -3));
+    glm::mat4 proj = glm::perspective(
+      glm::radians(70.0f), 16.0f / 9.0f, 0.1f, 10.0f);
+    proj[1][1] *= -1;
+    return extractFrustum(proj * view);
+}
+
+void runCull(CullBackend backend, BenchResult& result)
+{
+    constexpr size_t SphereCount = 1 << 20;
+    constexpr int Iterations = 50;
+
+    if (backend > bestCullBackend())
+        throw std::runtime_error("Not supported by this CPU");
+
+    // Spread so about a third of the spheres are visible
+    std::mt19937 generator(1234);
+    std::uniform_real_distribution<float> position(-12.0f, 12.0f);
+    std::uniform_real_distribution<float> radius(0.01f, 0.5f);
+    SceneBounds bounds;
+    for (size_t i = 0; i < SphereCount; i++)
+    {
+        Bounds sphere;
+        sphere.center = { position(generator),
+                          position(generator),
+                          position(generator) };
+        sphere.radius = radius(generator);
+        bounds.push(sphere);
+    }
+
+    Frustum frustum = benchFrustum();
+    std::vector<uint32_t> reference;
+    cullSpheres(frustum, bounds, reference, CullBackend::Scalar);
+
+    std::vector<uint32_t> visible;
+    cullSpheres(frustum, bounds, visible, backend);
+    if (visible != reference)
+        throw std::runtime_error("Visible set differs from the scalar one");
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < Iterations; i++)
+        cullSpheres(frustum, bounds, visible, backend);
+    double ms = millisecondsSince(start) / Iterations;
+
+    result.add("spheres", SphereCount);
+    result.add("visible", visible.size());
+    result.add("ms_per_cull", ms);
+    result.add("spheres_per_us", SphereCount / (ms * 1e3));
+}
+
+// Jobs spawning jobs and continuations, checked against the expected count
+void runJobStress(BenchResult& result)
+{
+    constexpr int Rounds = 50;
+    constexpr int Parents = 64;
+    constexpr int Children = 64;
+
+    JobSystem jobs;
+    std::atomic<uint64_t> executed{ 0 };
+    Clock::time_point start = Clock::now();
+    for (int round = 0; round < Rounds; round++)
+    {
+        JobCounter parents;
+        JobCounter continuations;
+        for (int parent = 0; parent < Parents; parent++)
+        {
+            jobs.run(
+              [&]()
+              {
+                  // Waiting inside a job runs other jobs meanwhile
+                  JobCounter children;
+                  for (int child = 0; child < Children; child++)
+                  {
+                      jobs.run(
+                        [&]() { executed.fetch_add(1); }, &children);
+                  }
+                  jobs.wait(children);
+                  executed.fetch_add(1);
+              },
+              &parents);
+        }
+        jobs.then(
+          parents, [&]() { executed.fetch_add(1); }, &continuations);
+        jobs.wait(continuations);
+    }
+    double ms = millisecondsSince(start);
+
+    uint64_t expected = uint64_t(Rounds) * (Parents * (Children + 1) + 1);
+    if (executed.load() != expected)
+        throw std::runtime_error("Jobs were lost or ran twice");
+
+    result.add("threads", jobs.threadCount());
+    result.add("jobs", expected);
+    result.add("ms", ms);
+    result.add("jobs_per_ms", expected / ms);
+}
+
+// parallelFor inside parallelFor, every level waiting on a counter on its
+// stack that is destroyed as soon as the wait returns
+void runNestedParallelFor(BenchResult& result)
+{
+    constexpr int Rounds = 200;
+    constexpr size_t Outer = 64;
+    constexpr size_t Middle = 16;
+    constexpr size_t Inner = 16;
+
+    JobSystem jobs;
+    std::atomic<uint64_t> executed{ 0 };
+    Clock::time_point start = Clock::now();
+    for (int round = 0; round < Rounds; round++)
+    {
+        jobs.parallelFor(
+          Outer,
+          [&](size_t)
+          {
+              jobs.parallelFor(
+                Middle,
+                [&](size_t)
+                {
+                    jobs.parallelFor(Inner,
+                                     [&](size_t) { executed.fetch_add(1); });
+                });
+          });
+    }
+    double ms = millisecondsSince(start);
+
+    uint64_t expected = uint64_t(Rounds) * Outer * Middle * Inner;
+    if (executed.load() != expected)
+        throw std::runtime_error("Iterations were lost or ran twice");
+
+    result.add("threads", jobs.threadCount());
+    result.add("iterations", expected);
+    result.add("ms", ms);
+}
+
+// The same parallelFor at increasing thread counts
+void runParallelForScaling(BenchResult& result)
+{
+    constexpr size_t Count = 1 << 24;
+    constexpr size_t Grain = 1 << 14;
+    constexpr int Iterations = 10;
+
+    std::vector<float> values(Count);
+    for (size_t i = 0; i < Count; i++)
+        values[i] = static_cast<float>(i);
+
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+    double singleMs = 0.0;
+    for (unsigned int threads = 1;; threads = std::min(threads * 2, hardware))
+    {
+        JobSystem jobs(threads);
+        std::vector<double> sums((Count + Grain - 1) / Grain);
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < Iterations; i++)
+        {
+            jobs.parallelFor(Count,
+                             Grain,
+                             [&](size_t begin, size_t end)
+                             {
+                                 double sum = 0.0;
+                                 for (size_t j = begin; j < end; j++)
+                                     sum += std::sqrt(values[j]);
+                                 sums[begin / Grain] = sum;
+                             });
+        }
+        double ms = millisecondsSince(start) / Iterations;
+        if (threads == 1)
+            singleMs = ms;
+
+        std::string prefix = "threads_" + std::to_string(threads);
+        result.add(prefix + "_ms", ms);
+        result.add(prefix + "_speedup", singleMs / ms);
+        if (threads == hardware)
+            break;
+    }
+}
+
+// Repeated loads of the same file, decoded on one thread or on the jobs
+void runImport(const BenchOptions& options, bool parallel,
+               BenchResult& result)
+{
+    constexpr int Iterations = 20;
+
+    JobSystem jobs;
+    GLTFLoadOptions loadOptions;
+    if (parallel)
+        loadOptions.jobs = &jobs;
+    else
+        loadOptions.threadCount = 1;
+
+    std::filesystem::path path = options.assets / "models/suzanne.glb";
+    size_t meshes = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < Iterations; i++)
+    {
+        auto loaded = loadGLTFMeshes(path, loadOptions);
+        if (!loaded)
+            throw std::runtime_error("Could not load " + path.string());
+        meshes = loaded->size();
+    }
+    double ms = millisecondsSince(start) / Iterations;
+
+    result.add("threads", parallel ? jobs.threadCount() : 1);
+    result.add("meshes", meshes);
+    result.add("ms_per_load", ms);
+}
+
+// Size and worst errors of the compact vertex format on the test assets
+void runVertexCompression(const BenchOptions& options, BenchResult& result)
+{
+    std::filesystem::path path = options.assets / "models/suzanne.glb";
+    auto meshes = loadGLTFMeshes(path);
+    if (!meshes)
+        throw std::runtime_error("Could not load " + path.string());
+
+    size_t vertexCount = 0;
+    CompressionError worst{};
+    std::vector<CompactVertex> compact;
+    double encodeMs = 0.0;
+    for (const std::shared_ptr<Mesh>& mesh : *meshes)
+    {
+        vertexCount += mesh->vertices.size();
+        Clock::time_point start = Clock::now();
+        compressVertices(mesh->vertices, compact);
+        encodeMs += millisecondsSince(start);
+
+        CompressionError error = measureCompression(mesh->vertices);
+        worst.position = std::max(worst.position, error.position);
+        worst.normalDegrees = std::max(worst.normalDegrees,
+                                       error.normalDegrees);
+        worst.uv = std::max(worst.uv, error.uv);
+        worst.color = std::max(worst.color, error.color);
+    }
+
+    result.add("vertices", vertexCount);
+    result.add("standard_bytes", vertexCount * sizeof(Vertex));
+    result.add("compact_bytes", vertexCount * sizeof(CompactVertex));
+    result.add("encode_ms", encodeMs);
+    result.add("max_position_error", worst.position);
+    result.add("max_normal_error_degrees", worst.normalDegrees);
+    result.add("max_uv_error", worst.uv);
+    result.add("max_color_error", worst.color);
+}
+
+// Cache statistics of suzanne.glb as exported and with its triangles
+// shuffled, before and after optimizeMesh
+void runMeshOptimizer(const BenchOptions& options, BenchResult& result)
+{
+    std::filesystem::path path = options.assets / "models/suzanne.glb";
+    auto meshes = loadGLTFMeshes(path);
+    if (!meshes || meshes->empty())
+        throw std::runtime_error("Could not load " + path.string());
+
+    Mesh shuffled = *meshes->front();
+    std::vector<uint32_t> triangles(shuffled.indices.size() / 3);
+    for (uint32_t t = 0; t < triangles.size(); t++)
+        triangles[t] = t;
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(1234));
+    for (size_t t = 0; t < triangles.size(); t++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            shuffled.indices[t * 3 + k] =
+              meshes->front()->indices[triangles[t] * 3 + k];
+        }
+    }
+
+    const std::pair<const char*, Mesh*> inputs[] = {
+        { "exported", meshes->front().get() },
+        { "shuffled", &shuffled },
+    };
+    for (const auto& [name, mesh] : inputs)
+    {
+        Clock::time_point start = Clock::now();
+        MeshOptimizationStatistics stats = optimizeMesh(*mesh);
+        double ms = millisecondsSince(start);
+
+        std::string prefix = name;
+        result.add(prefix + "_acmr_before", stats.before.acmr);
+        result.add(prefix + "_acmr_after", stats.after.acmr);
+        result.add(prefix + "_atvr_before", stats.before.atvr);
+        result.add(prefix + "_atvr_after", stats.after.atvr);
+        result.add(prefix + "_vertices_before", stats.verticesBefore);
+        result.add(prefix + "_vertices_after", stats.verticesAfter);
+        result.add(prefix + "_ms", ms);
+    }
+}
+
+// LOD chain of suzanne.glb, with the triangles and error of every level
+void runMeshSimplifier(const BenchOptions& options, BenchResult& result)
+{
+    std::filesystem::path path = options.assets / "models/suzanne.glb";
+    auto meshes = loadGLTFMeshes(path, { .optimize = true });
+    if (!meshes || meshes->empty())
+        throw std::runtime_error("Could not load " + path.string());
+
+    Mesh& mesh = *meshes->front();
+    Clock::time_point start = Clock::now();
+    size_t levels = generateLods(mesh);
+    double ms = millisecondsSince(start);
+
+    result.add("levels", levels);
+    result.add("ms", ms);
+    for (size_t i = 0; i < mesh.lods.size(); i++)
+    {
+        std::string prefix = "lod" + std::to_string(i);
+        result.add(prefix + "_triangles", mesh.lods[i].indexCount / 3);
+        result.add(prefix + "_error", mesh.lods[i].error);
+    }
+}
+
+// Meshlets of suzanne.glb and how full they are
+void runMeshletBuilder(const BenchOptions& options, BenchResult& result)
+{
+    std::filesystem::path path = options.assets / "models/suzanne.glb";
+    auto meshes = loadGLTFMeshes(path, { .optimize = true });
+    if (!meshes || meshes->empty())
+        throw std::runtime_error("Could not load " + path.string());
+
+    Mesh& mesh = *meshes->front();
+    Clock::time_point start = Clock::now();
+    size_t count = buildMeshlets(mesh);
+    double ms = millisecondsSince(start);
+
+    size_t triangles = 0;
+    size_t backfacing = 0;
+    for (const Meshlet& meshlet : mesh.meshlets)
+    {
+        triangles += meshlet.triangleCount;
+        if (meshlet.coneCutoff < 1.0f)
+            backfacing++;
+    }
+    result.add("meshlets", count);
+    result.add("triangles_per_meshlet",
+               count > 0 ? static_cast<double>(triangles) / count : 0.0);
+    result.add("cone_cullable", backfacing);
+    result.add("ms", ms);
+}
+
+} // namespace
+
+std::vector<Scenario> cpuScenarios()
+{
+    std::vector<Scenario> scenarios;
+    const std::pair<const char*, CullBackend> backends[] = {
+        { "cull_scalar", CullBackend::Scalar },
+        { "cull_sse", CullBackend::SSE },
+        { "cull_avx", CullBackend::AVX },
+    };
+    for (const auto& [name, backend] : backends)
+    {
+        scenarios.push_back(
+          { .name = name,
+            .description = "Frustum culling of a million spheres",
+            .run = [backend](const BenchOptions&, BenchResult& result)
+            {
+                runCull(backend, result);
+            } });
+    }
+    scenarios.push_back(
+      { .name = "jobs_stress",
+        .description = "Nested jobs and continuations",
+        .run = [](const BenchOptions&, BenchResult& result)
+        {
+            runJobStress(result);
+        } });
+    scenarios.push_back(
+      { .name = "jobs_nested_parallel_for",
+        .description = "Three levels of nested parallelFor",
+        .run = [](const BenchOptions&, BenchResult& result)
+        {
+            runNestedParallelFor(result);
+        } });
+    scenarios.push_back(
+      { .name = "parallel_for_scaling",
+        .description = "A parallelFor over 16M floats per thread count",
+        .run = [](const BenchOptions&, BenchResult& result)
+        {
+            runParallelForScaling(result);
+        } });
+    for (bool parallel : { false, true })
+    {
+        scenarios.push_back(
+          { .name = parallel ? "gltf_import_parallel" : "gltf_import_serial",
+            .description = "Loads of suzanne.glb",
+            .run = [parallel](const BenchOptions& options,
+                              BenchResult& result)
+            {
+                runImport(options, parallel, result);
+            } });
+    }
+    scenarios.push_back(
+      { .name = "vertex_compression",
+        .description = "Compact vertex errors on suzanne.glb",
+        .run = runVertexCompression });
+    scenarios.push_back(
+      { .name = "mesh_optimizer",
+        .description = "Vertex cache statistics of optimizeMesh",
+        .run = runMeshOptimizer });
+    scenarios.push_back(
+      { .name = "mesh_simplifier",
+        .description = "LOD chain of suzanne.glb",
+        .run = runMeshSimplifier });
+    scenarios.push_back(
+      { .name = "meshlet_builder",
+        .description = "Meshlets of suzanne.glb",
+        .run = runMeshletBuilder });
+    return scenarios;
+}
+
+} // namespace bench
+} // namespace baldwin
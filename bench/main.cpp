@@ -0,0 +1,191 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <exception>
+#include <string_view>
+
+#include "bench.hpp"
+#include "utils/profiler.hpp"
+
+// Runs scripted scenarios headless and reports them as JSON, so runs on
+// different commits or machines can be diffed. Run it from the build
+// directory, shaders and assets are loaded relative to it. The report is
+// the only thing written to stdout, logs go to stderr.
+
+namespace
+{
+
+using namespace baldwin::bench;
+
+void printUsage()
+{
+    std::cerr << "Usage: baldwin_bench [options]\n"
+                 "  --list             Print the scenarios and exit\n"
+                 "  --filter <text>    Only run scenarios whose name "
+                 "contains text\n"
+                 "  --frames <n>       Measured frames per scenario\n"
+                 "  --warmup <n>       Frames run before measuring\n"
+                 "  --size <w> <h>     Resolution of the draw image\n"
+                 "  --out <file>       Writes the report there instead of "
+                 "stdout\n"
+                 "  --trace <file>     Writes a Chrome trace of the whole "
+                 "run there\n";
+}
+
+// Scenario names and errors are the only strings in the report
+std::string escape(std::string_view text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            escaped += '\\';
+        if (c == '\n')
+            escaped += "\\n";
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+void writeReport(std::ostream& out, const BenchOptions& options,
+                 const std::vector<BenchResult>& results)
+{
+    out << "{\n";
+    out << "  \"frames\": " << options.frames << ",\n";
+    out << "  \"warmup_frames\": " << options.warmupFrames << ",\n";
+    out << "  \"width\": " << options.width << ",\n";
+    out << "  \"height\": " << options.height << ",\n";
+#ifdef BALDWIN_PROFILING
+    out << "  \"profiling\": true,\n";
+#else
+    out << "  \"profiling\": false,\n";
+#endif
+    out << "  \"scenarios\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult& result = results[i];
+        out << "    { \"name\": \"" << escape(result.name) << "\"";
+        if (!result.error.empty())
+            out << ", \"error\": \"" << escape(result.error) << "\"";
+        out << ", \"metrics\": {";
+        for (size_t j = 0; j < result.metrics.size(); j++)
+        {
+            out << (j == 0 ? " " : ", ") << '"' << result.metrics[j].first
+                << "\": " << result.metrics[j].second;
+        }
+        out << " } }" << (i + 1 < results.size() ? "," : "") << '\n';
+    }
+    out << "  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    std::string filter;
+    std::string outPath;
+    std::string tracePath;
+    bool list = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--list")
+            list = true;
+        else if (arg == "--filter" && hasValue)
+            filter = argv[++i];
+        else if (arg == "--frames" && hasValue)
+            options.frames = std::atoi(argv[++i]);
+        else if (arg == "--warmup" && hasValue)
+            options.warmupFrames = std::atoi(argv[++i]);
+        else if (arg == "--size" && i + 2 < argc)
+        {
+            options.width = std::atoi(argv[++i]);
+            options.height = std::atoi(argv[++i]);
+        }
+        else if (arg == "--out" && hasValue)
+            outPath = argv[++i];
+        else if (arg == "--trace" && hasValue)
+            tracePath = argv[++i];
+        else
+        {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+    // The engine treats a frame limit of 0 as no limit
+    if (options.frames <= 0 || options.warmupFrames <= 0 ||
+        options.width <= 0 || options.height <= 0)
+    {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Scenario> scenarios = renderScenarios();
+    for (Scenario& scenario : cpuScenarios())
+        scenarios.push_back(std::move(scenario));
+
+    if (list)
+    {
+        for (const Scenario& scenario : scenarios)
+            std::cout << scenario.name << " : " << scenario.description
+                      << '\n';
+        return EXIT_SUCCESS;
+    }
+
+    // The engine logs through std::cout in places, keep them out of the
+    // report
+    std::streambuf* stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+
+    // Only filled in profiling builds, the zones compile to nothing otherwise
+    if (!tracePath.empty())
+        baldwin::Profiler::instance().beginCapture();
+
+    // A failing scenario is reported and the others still run
+    std::vector<BenchResult> results;
+    bool failed = false;
+    for (const Scenario& scenario : scenarios)
+    {
+        if (scenario.name.find(filter) == std::string::npos)
+            continue;
+        std::cerr << "Running " << scenario.name << '\n';
+        BenchResult& result = results.emplace_back();
+        result.name = scenario.name;
+        try
+        {
+            scenario.run(options, result);
+        }
+        catch (const std::exception& e)
+        {
+            result.error = e.what();
+            failed = true;
+            std::cerr << scenario.name << " failed : " << e.what() << '\n';
+        }
+    }
+
+    if (!tracePath.empty() &&
+        !baldwin::Profiler::instance().endCapture(tracePath))
+    {
+        failed = true;
+    }
+
+    std::cout.rdbuf(stdoutBuffer);
+    if (outPath.empty())
+    {
+        writeReport(std::cout, options, results);
+    }
+    else
+    {
+        std::ofstream file(outPath, std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << "Could not write " << outPath << '\n';
+            return EXIT_FAILURE;
+        }
+        writeReport(file, options, results);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,521 @@
+#include "bench.hpp"
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <glm/ext/matrix_transform.hpp>
+
+#include "engine.hpp"
+#include "loader/gltf.hpp"
+#include "loader/meshlet_builder.hpp"
+#include "renderer/bounds.hpp"
+#include "renderer/vertex_compression.hpp"
+#include "utils/profiler.hpp"
+#include "utils/uuid.hpp"
+
+namespace baldwin
+{
+namespace bench
+{
+
+namespace
+{
+
+// The renderer looks down -z from z = 3 with a far plane at 10, scenes are
+// laid out in the box in front of it
+constexpr float SceneExtent = 5.0f;
+constexpr float SceneDepth = -1.0f;
+
+// Zones the Vulkan renderer records around its passes
+const char* const GpuZones[] = {
+    "Clear", "Prepare draws", "Main pass", "Depth pyramid", "Blit to swapchain"
+};
+
+struct SceneSetup
+{
+    RendererSettings settings{};
+    bool pipelined = true;
+    // Adds the meshes and returns the bytes of geometry it uploaded
+    std::function<size_t(Engine&)> populate;
+    // Builds the per frame update once the engine exists, may be empty
+    std::function<Engine::UpdateFunction(Engine&)> makeUpdate;
+};
+
+size_t geometryBytes(const Mesh& mesh)
+{
+    return mesh.vertices.size() * vertexSize(mesh.vertexFormat) +
+           mesh.indices.size() * sizeof(uint32_t);
+}
+
+std::shared_ptr<Mesh> finishMesh(Mesh mesh)
+{
+    mesh.uuid = generateUUID();
+    mesh.bounds = computeBounds(mesh.vertices);
+    return std::make_shared<Mesh>(std::move(mesh));
+}
+
+// rings * segments * 2 triangles, counter clockwise seen from outside
+std::shared_ptr<Mesh> makeSphere(glm::vec3 center, float radius,
+                                 uint32_t rings, uint32_t segments)
+{
+    constexpr float Pi = 3.14159265358979f;
+    Mesh mesh;
+    mesh.vertices.reserve((rings + 1) * (segments + 1));
+    mesh.indices.reserve(rings * segments * 6);
+    for (uint32_t ring = 0; ring <= rings; ring++)
+    {
+        float v = static_cast<float>(ring) / rings;
+        float phi = v * Pi;
+        for (uint32_t segment = 0; segment <= segments; segment++)
+        {
+            float u = static_cast<float>(segment) / segments;
+            float theta = u * 2.0f * Pi;
+            glm::vec3 normal{ std::sin(phi) * std::cos(theta),
+                              std::cos(phi),
+                              std::sin(phi) * std::sin(theta) };
+            mesh.vertices.push_back({ .position = center + normal * radius,
+                                      .uv_x = u,
+                                      .normal = normal,
+                                      .uv_y = v,
+                                      .color = glm::vec4(normal * 0.5f + 0.5f,
+                                                         1.0f) });
+        }
+    }
+    for (uint32_t ring = 0; ring < rings; ring++)
+    {
+        for (uint32_t segment = 0; segment < segments; segment++)
+        {
+            uint32_t a = ring * (segments + 1) + segment;
+            uint32_t b = a + segments + 1;
+            mesh.indices.insert(mesh.indices.end(),
+                                { a, a + 1, b, a + 1, b + 1, b });
+        }
+    }
+    return finishMesh(std::move(mesh));
+}
+
+// Eight triangles, the smallest mesh that still has a volume
+std::shared_ptr<Mesh> makeOctahedron(glm::vec3 center, float size)
+{
+    const glm::vec3 axes[] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 },
+                               { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    Mesh mesh;
+    for (const glm::vec3& axis : axes)
+        mesh.vertices.push_back({ .position = center + axis * size,
+                                  .normal = axis,
+                                  .color = glm::vec4(axis * 0.5f + 0.5f,
+                                                     1.0f) });
+    mesh.indices = { 0, 2, 4, 2, 1, 4, 1, 3, 4, 3, 0, 4,
+                     2, 0, 5, 1, 2, 5, 3, 1, 5, 0, 3, 5 };
+    return finishMesh(std::move(mesh));
+}
+
+// Centers of count cells filling the scene box
+std::vector<glm::vec3> gridCenters(size_t count, float& spacing)
+{
+    size_t side = static_cast<size_t>(std::ceil(std::cbrt(count)));
+    spacing = SceneExtent / side;
+    std::vector<glm::vec3> centers;
+    centers.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 cell{ static_cast<float>(i % side),
+                        static_cast<float>((i / side) % side),
+                        static_cast<float>(i / (side * side)) };
+        centers.push_back((cell + 0.5f) * spacing -
+                          glm::vec3(SceneExtent * 0.5f,
+                                    SceneExtent * 0.5f,
+                                    SceneExtent - SceneDepth));
+    }
+    return centers;
+}
+
+std::shared_ptr<Mesh> loadSuzanne(const BenchOptions& options,
+                                  const GLTFLoadOptions& loadOptions = {})
+{
+    auto meshes = loadGLTFMeshes(options.assets / "models/suzanne.glb",
+                                 loadOptions);
+    if (!meshes || meshes->empty())
+        throw std::runtime_error("Could not load suzanne.glb");
+    return meshes->front();
+}
+
+std::vector<glm::mat4> gridTransforms(const Mesh& mesh, size_t count)
+{
+    float spacing;
+    std::vector<glm::vec3> centers = gridCenters(count, spacing);
+    // Neighbours touch but do not overlap
+    float scale = spacing * 0.5f / std::max(mesh.bounds.radius, 1e-6f);
+    std::vector<glm::mat4> transforms;
+    transforms.reserve(count);
+    for (const glm::vec3& center : centers)
+        transforms.push_back(
+          glm::scale(glm::translate(glm::mat4(1.0f), center),
+                     glm::vec3(scale)) *
+          glm::translate(glm::mat4(1.0f), -mesh.bounds.center));
+    return transforms;
+}
+
+size_t populateInstances(Engine& engine, const std::shared_ptr<Mesh>& mesh,
+                         size_t count)
+{
+    std::vector<glm::mat4> transforms = gridTransforms(*mesh, count);
+    engine.addInstances(*mesh, transforms);
+    return geometryBytes(*mesh);
+}
+
+// Distinct meshes, one draw each unless they are drawn indirectly
+size_t populateTinyMeshes(Engine& engine, size_t count)
+{
+    float spacing;
+    std::vector<std::shared_ptr<Mesh>> meshes;
+    meshes.reserve(count);
+    size_t bytes = 0;
+    for (const glm::vec3& center : gridCenters(count, spacing))
+    {
+        meshes.push_back(makeOctahedron(center, spacing * 0.4f));
+        bytes += geometryBytes(*meshes.back());
+    }
+    engine.addToScene(meshes);
+    return bytes;
+}
+
+// Four spheres of a million triangles each
+size_t populateLargeMeshes(Engine& engine, VertexFormat format,
+                           bool meshlets)
+{
+    std::vector<std::shared_ptr<Mesh>> meshes;
+    size_t bytes = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        glm::vec3 center{ (i % 2) * 2.0f - 1.0f, (i / 2) * 2.0f - 1.0f, 0.0f };
+        meshes.push_back(makeSphere(center, 0.9f, 512, 1024));
+        meshes.back()->vertexFormat = format;
+        if (meshlets)
+            buildMeshlets(*meshes.back());
+        bytes += geometryBytes(*meshes.back());
+    }
+    engine.addToScene(meshes);
+    return bytes;
+}
+
+// Spins every instance around its own center each frame, so the scene is
+// extracted again every frame
+Engine::UpdateFunction spinInstances(Engine&)
+{
+    auto base = std::make_shared<std::vector<glm::mat4>>();
+    auto time = std::make_shared<double>(0.0);
+    return [base, time](RenderScene& scene, double dt)
+    {
+        if (base->empty())
+            *base = scene.instanceTransforms;
+        *time += dt;
+        glm::mat4 spin = glm::rotate(glm::mat4(1.0f),
+                                     static_cast<float>(*time),
+                                     glm::vec3(0.0f, 1.0f, 0.0f));
+        for (uint32_t i = 0; i < base->size(); i++)
+            scene.setTransform(i, (*base)[i] * spin);
+    };
+}
+
+void runFrames(const BenchOptions& options, SceneSetup setup,
+               BenchResult& result)
+{
+    setup.settings.headless = true;
+    Engine engine(
+      options.width, options.height, RenderAPI::Vulkan, setup.settings);
+    engine.setFramePipelining(setup.pipelined);
+
+    // Upload throughput covers the CPU side copies into the staging ring and
+    // the transfers themselves
+    Clock::time_point uploadStart = Clock::now();
+    size_t uploadBytes = setup.populate(engine);
+    engine.getRenderer()->waitForUploads();
+    double uploadMs = millisecondsSince(uploadStart);
+
+    if (setup.makeUpdate)
+        engine.setUpdate(setup.makeUpdate(engine));
+    engine.setFrameLimit(options.warmupFrames);
+    engine.run();
+
+    Profiler::instance().clearStatistics();
+    uint64_t allocationsBefore = allocationCount();
+    Clock::time_point start = Clock::now();
+    engine.setFrameLimit(options.warmupFrames + options.frames);
+    engine.run();
+    double elapsedMs = millisecondsSince(start);
+    uint64_t allocations = allocationCount() - allocationsBefore;
+
+    const RenderStats& stats = engine.getRenderer()->stats();
+    result.add("frames", options.frames);
+    result.add("cpu_frame_ms", elapsedMs / options.frames);
+    double gpuMs = 0.0;
+    for (const ProfileZoneSummary& zone : Profiler::instance().summary())
+    {
+        std::string_view name = zone.name;
+        if (name == "Draw")
+        {
+            result.add("cpu_render_ms_avg", zone.avgMs);
+            result.add("cpu_render_ms_p99", zone.p99Ms);
+        }
+        else if (name == "Update")
+        {
+            result.add("cpu_update_ms_avg", zone.avgMs);
+        }
+        for (const char* gpuZone : GpuZones)
+        {
+            if (name == gpuZone)
+                gpuMs += zone.avgMs;
+        }
+    }
+#ifdef BALDWIN_PROFILING
+    result.add("gpu_frame_ms", gpuMs);
+    result.add("vertex_invocations", stats.vertexInvocations);
+    result.add("fragment_invocations", stats.fragmentInvocations);
+#endif
+    result.add("objects", stats.objects);
+    result.add("draw_calls", stats.drawCalls);
+    result.add("cpu_culled", stats.cpuCulled);
+    result.add("triangles", stats.triangles);
+    result.add("gpu_visible", stats.visible);
+    result.add("clusters_visible", stats.clustersVisible);
+    result.add("clusters_frustum_culled", stats.clustersFrustumCulled);
+    result.add("clusters_backface_culled", stats.clustersBackfaceCulled);
+    result.add("clusters_occlusion_culled", stats.clustersOcclusionCulled);
+    result.add("allocations_per_frame",
+               static_cast<double>(allocations) / options.frames);
+    result.add("upload_mb", uploadBytes / 1e6);
+    result.add("upload_ms", uploadMs);
+    result.add("upload_mb_per_s", uploadBytes / 1e3 / uploadMs);
+}
+
+Scenario frameScenario(std::string name, std::string description,
+                       std::function<SceneSetup(const BenchOptions&)> setup)
+{
+    return { .name = std::move(name),
+             .description = std::move(description),
+             .run =
+               [setup](const BenchOptions& options, BenchResult& result)
+             {
+                 runFrames(options, setup(options), result);
+             } };
+}
+
+SceneSetup suzannes(const BenchOptions& options, size_t count,
+                    const GLTFLoadOptions& loadOptions = {})
+{
+    std::shared_ptr<Mesh> suzanne = loadSuzanne(options, loadOptions);
+    return { .populate = [suzanne, count](Engine& engine)
+             {
+                 return populateInstances(engine, suzanne, count);
+             } };
+}
+
+// Removes a hundredth of the instances every frame and adds them back, so
+// the instance arrays are repacked and handle slots reused
+SceneSetup churnedSuzannes(const BenchOptions& options, size_t count)
+{
+    std::shared_ptr<Mesh> suzanne = loadSuzanne(options);
+    auto handles = std::make_shared<std::vector<InstanceHandle>>();
+    SceneSetup setup{ .populate = [suzanne, count, handles](Engine& engine)
+                      {
+                          *handles = engine.addInstances(
+                            *suzanne, gridTransforms(*suzanne, count));
+                          return geometryBytes(*suzanne);
+                      } };
+    setup.makeUpdate = [handles](Engine&)
+    {
+        auto next = std::make_shared<size_t>(0);
+        return [handles, next](RenderScene& scene, double)
+        {
+            size_t churn = std::max<size_t>(handles->size() / 100, 1);
+            for (size_t i = 0; i < churn; i++)
+            {
+                InstanceHandle& handle = (*handles)[*next];
+                *next = (*next + 1) % handles->size();
+                uint32_t instance = scene.indexOf(handle);
+                uint32_t mesh = scene.instanceMeshes[instance];
+                glm::mat4 transform = scene.instanceTransforms[instance];
+                scene.removeInstance(handle);
+                handle = scene.addInstance(mesh, transform);
+            }
+        };
+    };
+    return setup;
+}
+
+SceneSetup largeMeshes(VertexFormat format = VertexFormat::Standard,
+                       bool meshlets = false)
+{
+    return { .populate = [format, meshlets](Engine& engine)
+             {
+                 return populateLargeMeshes(engine, format, meshlets);
+             } };
+}
+
+SceneSetup tinyMeshes(size_t count, bool indirect)
+{
+    SceneSetup setup{ .populate = [count](Engine& engine)
+                      {
+                          return populateTinyMeshes(engine, count);
+                      } };
+    setup.settings.indirectDraw = indirect;
+    return setup;
+}
+
+} // namespace
+
+std::vector<Scenario> renderScenarios()
+{
+    std::vector<Scenario> scenarios;
+    for (size_t count : { 1000, 10000 })
+    {
+        scenarios.push_back(frameScenario(
+          "suzanne_" + std::to_string(count),
+          "Instances of suzanne.glb sharing one mesh",
+          [count](const BenchOptions& options)
+          {
+              return suzannes(options, count);
+          }));
+    }
+    scenarios.push_back(
+      frameScenario("large_meshes",
+                    "Four procedural spheres of a million triangles",
+                    [](const BenchOptions&)
+                    {
+                        return largeMeshes();
+                    }));
+    scenarios.push_back(
+      frameScenario("tiny_meshes",
+                    "Ten thousand distinct octahedra",
+                    [](const BenchOptions&)
+                    {
+                        return tinyMeshes(10000, true);
+                    }));
+    scenarios.push_back(frameScenario(
+      "resize_storm",
+      "A thousand suzannes with the swapchain resized every frame",
+      [](const BenchOptions& options)
+      {
+          SceneSetup setup = suzannes(options, 1000);
+          // The renderer belongs to the main thread in the serial loop
+          setup.pipelined = false;
+          int width = options.width;
+          int height = options.height;
+          setup.makeUpdate = [width, height](Engine& engine)
+          {
+              Renderer* renderer = engine.getRenderer();
+              auto frame = std::make_shared<int>(0);
+              return [renderer, width, height, frame](RenderScene&, double)
+              {
+                  int shrink = (*frame)++ % 2;
+                  renderer->resizeSwapchain(width - shrink * width / 4,
+                                            height - shrink * height / 4);
+              };
+          };
+          return setup;
+      }));
+
+    // The direct loop against the indirect count path
+    for (size_t count : { 1000, 10000, 100000 })
+    {
+        for (bool indirect : { true, false })
+        {
+            scenarios.push_back(frameScenario(
+              std::string(indirect ? "draw_indirect_" : "draw_direct_") +
+                std::to_string(count),
+              "Distinct octahedra, drawn with vkCmdDrawIndexedIndirectCount "
+              "or one vkCmdDrawIndexed each",
+              [count, indirect](const BenchOptions&)
+              {
+                  return tinyMeshes(count, indirect);
+              }));
+        }
+    }
+
+    // Vertex fetches from device local against host visible memory
+    for (bool hostVisible : { false, true })
+    {
+        scenarios.push_back(frameScenario(
+          hostVisible ? "geometry_host_visible" : "geometry_device_local",
+          "The large meshes with their geometry in either memory",
+          [hostVisible](const BenchOptions&)
+          {
+              SceneSetup setup = largeMeshes();
+              setup.settings.hostVisibleGeometry = hostVisible;
+              return setup;
+          }));
+    }
+
+    // Variants of the same scenes
+    scenarios.push_back(frameScenario(
+      "suzanne_10000_compact",
+      "suzanne_10000 with compact vertices",
+      [](const BenchOptions& options)
+      {
+          return suzannes(options,
+                          10000,
+                          { .vertexFormat = VertexFormat::Compact });
+      }));
+    scenarios.push_back(frameScenario(
+      "suzanne_10000_optimized",
+      "suzanne_10000 loaded through optimizeMesh",
+      [](const BenchOptions& options)
+      {
+          return suzannes(options, 10000, { .optimize = true });
+      }));
+    scenarios.push_back(frameScenario(
+      "suzanne_10000_lods",
+      "suzanne_10000 with generated LODs",
+      [](const BenchOptions& options)
+      {
+          return suzannes(options,
+                          10000,
+                          { .optimize = true, .generateLods = true });
+      }));
+    scenarios.push_back(frameScenario("large_meshes_compact",
+                                      "large_meshes with compact vertices",
+                                      [](const BenchOptions&)
+                                      {
+                                          return largeMeshes(
+                                            VertexFormat::Compact);
+                                      }));
+    for (bool cone : { true, false })
+    {
+        scenarios.push_back(frameScenario(
+          cone ? "large_meshes_clusters" : "large_meshes_clusters_no_cone",
+          "large_meshes split into meshlets and culled cluster by cluster",
+          [cone](const BenchOptions&)
+          {
+              SceneSetup setup = largeMeshes(VertexFormat::Standard, true);
+              setup.settings.coneCulling = cone;
+              return setup;
+          }));
+    }
+
+    // Update and extraction overlapped with recording, or not
+    for (bool pipelined : { true, false })
+    {
+        scenarios.push_back(frameScenario(
+          pipelined ? "loop_pipelined" : "loop_serial",
+          "Ten thousand spinning suzannes",
+          [pipelined](const BenchOptions& options)
+          {
+              SceneSetup setup = suzannes(options, 10000);
+              setup.pipelined = pipelined;
+              setup.makeUpdate = spinInstances;
+              return setup;
+          }));
+    }
+    scenarios.push_back(frameScenario(
+      "suzanne_10000_churn",
+      "suzanne_10000 with a hundred instances removed and added every frame",
+      [](const BenchOptions& options)
+      {
+          return churnedSuzannes(options, 10000);
+      }));
+    return scenarios;
+}
+
+} // namespace bench
+} // namespace baldwin
@@ -0,0 +1,19 @@
+// Global bindless heap, see BindlessHeap in vulkan_bindless.hpp
+#extension GL_EXT_nonuniform_qualifier : require
+
+#define BINDLESS_SET 1
+#define SAMPLER_LINEAR 0
+#define SAMPLER_NEAREST 1
+
+layout(set = BINDLESS_SET, binding = 0) buffer BindlessBuffer {
+    uint data[];
+} bindlessBuffers[];
+layout(set = BINDLESS_SET, binding = 1) uniform texture2D bindlessTextures[];
+layout(set = BINDLESS_SET, binding = 2) uniform sampler bindlessSamplers[];
+
+vec4 sampleBindless(uint texture, uint samplerIndex, vec2 uv)
+{
+    return texture(sampler2D(bindlessTextures[nonuniformEXT(texture)],
+                             bindlessSamplers[nonuniformEXT(samplerIndex)]),
+                   uv);
+}
@@ -0,0 +1,142 @@
+#version 460
+#pragma shader_stage(compute)
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "common_structs.glsl"
+#include "vertex.glsl"
+#include "culling.glsl"
+
+layout (local_size_x = 64) in;
+
+struct DrawData
+{
+	VertexBuffer vertexBuffer;
+	VertexDecode decode;
+};
+struct ClusterObject
+{
+	DrawData draw;
+	uint instance; // slot of its world matrix
+	int vertexOffset;
+	uint firstDraw; // first cluster draw of its block
+	uint block;
+};
+struct ClusterTask
+{
+	uint object;
+	uint meshlet;
+};
+struct Meshlet
+{
+	vec4 boundingSphere; // object space
+	vec4 cone; // axis and cutoff
+	uint firstIndex;
+	uint indexCount;
+	uint pad0;
+	uint pad1;
+};
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout (buffer_reference, std430) readonly buffer TaskBuffer {
+	ClusterTask tasks[];
+};
+layout (buffer_reference, std430) readonly buffer ObjectBuffer {
+	ClusterObject objects[];
+};
+layout (buffer_reference, std430) readonly buffer MeshletBuffer {
+	Meshlet meshlets[];
+};
+layout (buffer_reference, std430) writeonly buffer DrawCommandBuffer {
+	DrawCommand commands[];
+};
+layout (buffer_reference, std430) writeonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+// One count per pool block, zeroed by the CPU
+layout (buffer_reference, std430) buffer DrawCountBuffer {
+	uint counts[];
+};
+layout (buffer_reference, std430) readonly buffer InstanceBuffer {
+	mat4 worldMatrices[];
+};
+layout(push_constant) uniform PushConstants
+{
+	TaskBuffer tasks;
+	ObjectBuffer objects;
+	MeshletBuffer meshlets;
+	DrawCommandBuffer commands;
+	DrawDataBuffer drawData;
+	DrawCountBuffer counts;
+	InstanceBuffer instances;
+	CullStatsBuffer stats;
+	CullDataBuffer cull;
+} pushConstants;
+
+void main()
+{
+	uint id = gl_GlobalInvocationID.x;
+	CullDataBuffer cull = pushConstants.cull;
+	if (id >= cull.clusterTaskCount)
+		return;
+
+	ClusterTask task = pushConstants.tasks.tasks[id];
+	ClusterObject object = pushConstants.objects.objects[task.object];
+	Meshlet meshlet = pushConstants.meshlets.meshlets[task.meshlet];
+	mat4 worldMatrix = pushConstants.instances.worldMatrices[object.instance];
+
+	// The radius grows with the largest scale axis
+	vec3 center = (worldMatrix * vec4(meshlet.boundingSphere.xyz, 1.0f)).xyz;
+	vec3 axisScales = vec3(length(worldMatrix[0].xyz),
+	                       length(worldMatrix[1].xyz),
+	                       length(worldMatrix[2].xyz));
+	float scale = max(max(axisScales.x, axisScales.y), axisScales.z);
+	float radius = meshlet.boundingSphere.w * scale;
+
+	if (!insideFrustum(cull, center, radius))
+	{
+		atomicAdd(pushConstants.stats.clustersFrustumCulled, 1);
+		return;
+	}
+
+	// Every triangle of the meshlet faces away from the camera. Non-uniform
+	// scale bends the normals the cutoff was computed from, so those
+	// instances skip the test.
+	float minScale = min(min(axisScales.x, axisScales.y), axisScales.z);
+	bool uniformScale = scale - minScale <= 1e-3f * scale;
+	if (cull.coneCullingEnabled != 0 && meshlet.cone.w < 1.0f && uniformScale)
+	{
+		vec3 axis = transformNormal(worldMatrix, meshlet.cone.xyz);
+		vec3 view = center - cull.cameraPosition.xyz;
+		if (dot(view, axis) >= meshlet.cone.w * length(view) + radius)
+		{
+			atomicAdd(pushConstants.stats.clustersBackfaceCulled, 1);
+			return;
+		}
+	}
+
+	if (cull.occlusionEnabled != 0 && occluded(cull, center, radius))
+	{
+		atomicAdd(pushConstants.stats.clustersOcclusionCulled, 1);
+		return;
+	}
+	atomicAdd(pushConstants.stats.clustersVisible, 1);
+
+	// Survivors are compacted into the cluster draws of their block
+	uint draw = object.firstDraw +
+	            atomicAdd(pushConstants.counts.counts[object.block], 1);
+	pushConstants.commands.commands[draw] = DrawCommand(meshlet.indexCount,
+	                                                    1,
+	                                                    meshlet.firstIndex,
+	                                                    object.vertexOffset,
+	                                                    object.instance);
+	pushConstants.drawData.draws[draw] = object.draw;
+}
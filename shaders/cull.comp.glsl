@@ -0,0 +1,78 @@
+#version 460
+#pragma shader_stage(compute)
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "culling.glsl"
+
+layout (local_size_x = 64) in;
+
+struct CullObject
+{
+	mat4 worldMatrix;
+	vec4 boundingSphere; // world space
+	uint drawIndex;
+	uint pad0;
+	uint pad1;
+	uint pad2;
+};
+struct DrawCommand
+{
+	uint indexCount;
+	uint instanceCount;
+	uint firstIndex;
+	int vertexOffset;
+	uint firstInstance;
+};
+
+layout (buffer_reference, std430) readonly buffer ObjectBuffer {
+	CullObject objects[];
+};
+// Written by the CPU with no instances, every visible instance adds itself
+layout (buffer_reference, std430) buffer DrawCommandBuffer {
+	DrawCommand commands[];
+};
+layout (buffer_reference, std430) writeonly buffer InstanceBuffer {
+	mat4 worldMatrices[];
+};
+layout(push_constant) uniform PushConstants
+{
+	ObjectBuffer objects;
+	DrawCommandBuffer commands;
+	InstanceBuffer instances;
+	CullStatsBuffer stats;
+	CullDataBuffer cull;
+} pushConstants;
+
+void main()
+{
+	uint id = gl_GlobalInvocationID.x;
+	CullDataBuffer cull = pushConstants.cull;
+	if (id >= cull.objectCount)
+		return;
+
+	CullObject object = pushConstants.objects.objects[id];
+	vec3 center = object.boundingSphere.xyz;
+	float radius = object.boundingSphere.w;
+
+	if (!insideFrustum(cull, center, radius))
+	{
+		atomicAdd(pushConstants.stats.frustumCulled, 1);
+		return;
+	}
+
+	if (cull.occlusionEnabled != 0 && occluded(cull, center, radius))
+	{
+		atomicAdd(pushConstants.stats.occlusionCulled, 1);
+		return;
+	}
+	atomicAdd(pushConstants.stats.visible, 1);
+
+	// Compact the survivors into the instance range of their draw
+	DrawCommandBuffer commands = pushConstants.commands;
+	uint instance = atomicAdd(commands.commands[object.drawIndex].instanceCount,
+	                          1);
+	uint slot = commands.commands[object.drawIndex].firstInstance + instance;
+	pushConstants.instances.worldMatrices[slot] = object.worldMatrix;
+}
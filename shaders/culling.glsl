@@ -0,0 +1,102 @@
+// Culling shared by cull.comp.glsl and cluster_cull.comp.glsl, see CullData
+// and CullStats in vulkan_types.hpp
+#extension GL_EXT_buffer_reference : require
+
+layout (buffer_reference, std430) buffer CullStatsBuffer {
+	uint visible;
+	uint frustumCulled;
+	uint occlusionCulled;
+	uint clustersVisible;
+	uint clustersFrustumCulled;
+	uint clustersBackfaceCulled;
+	uint clustersOcclusionCulled;
+};
+layout (buffer_reference, std430) readonly buffer CullDataBuffer {
+	vec4 frustumPlanes[6];
+	vec4 cameraPosition;
+	mat4 pyramidView;
+	vec4 pyramidProj; // P00, P11, P22, P32
+	vec2 pyramidSize;
+	float znear;
+	uint objectCount;
+	uint occlusionEnabled;
+	uint clusterTaskCount;
+	uint coneCullingEnabled;
+};
+
+layout(set = 0, binding = 0) uniform sampler2D depthPyramid;
+
+bool insideFrustum(CullDataBuffer cull, vec3 center, float radius)
+{
+	bool inside = true;
+	for (int i = 0; i < 6; i++)
+	{
+		vec4 plane = cull.frustumPlanes[i];
+		inside = inside && dot(plane.xyz, center) + plane.w > -radius;
+	}
+	return inside;
+}
+
+// Screen space bounds of a view space sphere (z pointing forward), in uv
+// coordinates. 2D Polyhedral Bounds of a Clipped, Perspective-Projected 3D
+// Sphere, Mara and McGuire 2013.
+bool projectSphere(vec3 c, float r, float znear, float P00, float P11,
+                   out vec4 aabb)
+{
+	if (c.z < r + znear)
+		return false;
+
+	vec3 cr = c * r;
+	float czr2 = c.z * c.z - r * r;
+
+	float vx = sqrt(c.x * c.x + czr2);
+	float minx = (vx * c.x - cr.z) / (vx * c.z + cr.x);
+	float maxx = (vx * c.x + cr.z) / (vx * c.z - cr.x);
+
+	float vy = sqrt(c.y * c.y + czr2);
+	float miny = (vy * c.y - cr.z) / (vy * c.z + cr.y);
+	float maxy = (vy * c.y + cr.z) / (vy * c.z - cr.y);
+
+	aabb = vec4(minx * P00, miny * P11, maxx * P00, maxy * P11);
+	// Clip space y points up here, uv y points down
+	aabb = aabb.xwzy * vec4(0.5f, -0.5f, 0.5f, -0.5f) + vec4(0.5f);
+	return true;
+}
+
+bool occluded(CullDataBuffer cull, vec3 center, float radius)
+{
+	vec3 c = (cull.pyramidView * vec4(center, 1.0f)).xyz;
+	c.z = -c.z;
+
+	// The projection flips y for Vulkan, undo it to get a regular P11
+	float P00 = cull.pyramidProj.x;
+	float P11 = -cull.pyramidProj.y;
+	vec4 aabb;
+	if (!projectSphere(c, radius, cull.znear, P00, P11, aabb))
+		return false; // Crosses the near plane
+
+	aabb = clamp(aabb, 0.0f, 1.0f);
+	float width = (aabb.z - aabb.x) * cull.pyramidSize.x;
+	float height = (aabb.w - aabb.y) * cull.pyramidSize.y;
+
+	// At this level the box covers at most 2x2 texels
+	int levels = textureQueryLevels(depthPyramid);
+	int level = clamp(int(ceil(log2(max(max(width, height), 1.0f)))),
+	                  0,
+	                  levels - 1);
+	ivec2 size = textureSize(depthPyramid, level);
+	ivec2 lo = clamp(ivec2(aabb.xy * vec2(size)), ivec2(0), size - 1);
+	ivec2 hi = clamp(ivec2(aabb.zw * vec2(size)), ivec2(0), size - 1);
+
+	float depth = max(
+	  max(texelFetch(depthPyramid, lo, level).r,
+	      texelFetch(depthPyramid, ivec2(hi.x, lo.y), level).r),
+	  max(texelFetch(depthPyramid, ivec2(lo.x, hi.y), level).r,
+	      texelFetch(depthPyramid, hi, level).r));
+
+	// Depth of the sphere point closest to the camera
+	float z = -(c.z - radius);
+	float sphereDepth = (cull.pyramidProj.z * z + cull.pyramidProj.w) / -z;
+
+	return sphereDepth > depth;
+}
@@ -0,0 +1,39 @@
+#version 460
+#pragma shader_stage(compute)
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D inImage;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D outImage;
+
+layout(push_constant) uniform PushConstants
+{
+	ivec2 srcSize;
+	ivec2 dstSize;
+} pushConstants;
+
+// Keeps the farthest depth of every source texel the output texel covers.
+// Sizes are not always an exact multiple of each other (mip 0 is a power of
+// two below the depth image), so the footprint is rounded outwards to stay
+// conservative.
+void main()
+{
+	ivec2 pos = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 srcSize = pushConstants.srcSize;
+	ivec2 dstSize = pushConstants.dstSize;
+	if (any(greaterThanEqual(pos, dstSize)))
+		return;
+
+	ivec2 lo = pos * srcSize / dstSize;
+	ivec2 hi = max(((pos + 1) * srcSize + dstSize - 1) / dstSize, lo + 1);
+	hi = min(hi, srcSize);
+
+	float depth = 0.0f;
+	for (int y = lo.y; y < hi.y; y++)
+	{
+		for (int x = lo.x; x < hi.x; x++)
+			depth = max(depth, texelFetch(inImage, ivec2(x, y), 0).r);
+	}
+
+	imageStore(outImage, pos, vec4(depth));
+}
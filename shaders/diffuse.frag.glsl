@@ -4,6 +4,7 @@
 #extension GL_GOOGLE_include_directive : require
 
 #include "common_structs.glsl"
+#include "bindless.glsl"
 
 layout (location = 0) in vec3 inColor;
 layout (location = 1) in vec3 inNormal;
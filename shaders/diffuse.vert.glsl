@@ -5,6 +5,7 @@
 #extension GL_EXT_buffer_reference : require
 
 #include "common_structs.glsl"
+#include "vertex.glsl"
 
 layout (location = 0) out vec3 outColor;
 layout (location = 1) out vec3 outNormal;
@@ -12,19 +13,22 @@ layout (location = 1) out vec3 outNormal;
 layout(set = 0, binding = 0) uniform SceneBuffer {
 	SceneData sceneData;
 };
-layout (buffer_reference, std430) readonly buffer VertexBuffer {
-	Vertex vertices[];
+layout (buffer_reference, std430) readonly buffer InstanceBuffer {
+	mat4 worldMatrices[];
 };
 layout(push_constant) uniform PushConstants
 {	
-	mat4 worldMatrix;
 	VertexBuffer vertexBuffer;
+	InstanceBuffer instances;
+	VertexDecode decode;
 } pushConstants;
 
 void main() 
 {
-	Vertex v = pushConstants.vertexBuffer.vertices[gl_VertexIndex];
-	gl_Position = sceneData.viewproj * pushConstants.worldMatrix * vec4(v.pos, 1.0f);
+	Vertex v = loadVertex(pushConstants.vertexBuffer, pushConstants.decode,
+	                      gl_VertexIndex);
+	mat4 worldMatrix = pushConstants.instances.worldMatrices[gl_InstanceIndex];
+	gl_Position = sceneData.viewproj * worldMatrix * vec4(v.pos, 1.0f);
 	outColor = v.color.rgb;
-	outNormal = v.normal.rgb;
+	outNormal = transformNormal(worldMatrix, v.normal);
 }
@@ -0,0 +1,43 @@
+#version 460
+#pragma shader_stage(vertex)
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+
+#include "common_structs.glsl"
+#include "vertex.glsl"
+
+layout (location = 0) out vec3 outColor;
+layout (location = 1) out vec3 outNormal;
+
+layout(set = 0, binding = 0) uniform SceneBuffer {
+	SceneData sceneData;
+};
+layout (buffer_reference, std430) readonly buffer InstanceBuffer {
+	mat4 worldMatrices[];
+};
+struct DrawData
+{
+	VertexBuffer vertexBuffer;
+	VertexDecode decode;
+};
+layout (buffer_reference, std430) readonly buffer DrawDataBuffer {
+	DrawData draws[];
+};
+// drawData points at the first draw of the current indirect call,
+// gl_InstanceIndex already includes the firstInstance of the draw
+layout(push_constant) uniform PushConstants
+{
+	DrawDataBuffer drawData;
+	InstanceBuffer instances;
+} pushConstants;
+
+void main() 
+{
+	DrawData draw = pushConstants.drawData.draws[gl_DrawID];
+	Vertex v = loadVertex(draw.vertexBuffer, draw.decode, gl_VertexIndex);
+	mat4 worldMatrix = pushConstants.instances.worldMatrices[gl_InstanceIndex];
+	gl_Position = sceneData.viewproj * worldMatrix * vec4(v.pos, 1.0f);
+	outColor = v.color.rgb;
+	outNormal = transformNormal(worldMatrix, v.normal);
+}
@@ -0,0 +1,65 @@
+// Vertex pulling for both vertex formats, see VertexDecode in
+// vulkan_types.hpp and CompactVertex in render_types.hpp. Needs Vertex from
+// common_structs.glsl.
+#extension GL_EXT_buffer_reference : require
+
+#define VERTEX_FORMAT_STANDARD 0
+#define VERTEX_FORMAT_COMPACT 1
+
+struct VertexDecode
+{
+	vec3 positionOffset;
+	uint format;
+	vec3 positionScale;
+	uint pad;
+};
+
+layout (buffer_reference, std430) readonly buffer VertexBuffer {
+	Vertex vertices[];
+};
+// 16 bit position xy, position z and octahedral normal, half uv, RGBA8
+layout (buffer_reference, std430) readonly buffer CompactVertexBuffer {
+	uvec4 vertices[];
+};
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+// The format is the same for the whole draw, the branch stays uniform
+Vertex loadVertex(VertexBuffer buffer, VertexDecode decode, int index)
+{
+	if (decode.format == VERTEX_FORMAT_STANDARD)
+		return buffer.vertices[index];
+
+	uvec4 packed = CompactVertexBuffer(buffer).vertices[index];
+	vec3 quantized = vec3(packed.x & 0xffffu, packed.x >> 16,
+	                      packed.y & 0xffffu);
+	vec2 uv = unpackHalf2x16(packed.z);
+
+	Vertex v;
+	v.pos = decode.positionOffset + quantized * decode.positionScale;
+	v.normal = decodeOctahedral(unpackSnorm4x8(packed.y).zw);
+	v.uv1 = uv.x;
+	v.uv2 = uv.y;
+	v.color = unpackUnorm4x8(packed.w);
+	return v;
+}
+
+// Normals go through the inverse transpose of the world matrix so they stay
+// perpendicular under non-uniform scale. The cofactor matrix is that up to a
+// factor of det, whose sign is kept for mirroring transforms.
+vec3 transformNormal(mat4 worldMatrix, vec3 normal)
+{
+	mat3 m = mat3(worldMatrix);
+	mat3 cofactor = mat3(cross(m[1], m[2]),
+	                     cross(m[2], m[0]),
+	                     cross(m[0], m[1]));
+	float det = dot(m[0], cofactor[0]);
+	return normalize(cofactor * normal) * (det < 0.0f ? -1.0f : 1.0f);
+}
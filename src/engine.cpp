@@ -1,10 +1,15 @@
 #include "engine.hpp"
 
+#include <chrono>
+#include <exception>
 #include <cassert>
+#include <format>
 #include <iostream>
 #include <stdexcept>
 
 #include "renderer/vulkan/vulkan_renderer.hpp"
+#include "utils/profiler.hpp"
+#include "utils/uuid.hpp"
 
 namespace baldwin
 {
@@ -12,7 +17,8 @@ namespace baldwin
 Engine* loadedEngine = nullptr;
 Engine& get() { return *loadedEngine; }
 
-Engine::Engine(int width, int height, RenderAPI api)
+Engine::Engine(int width, int height, RenderAPI api,
+               const RendererSettings& settings)
   : _width(width)
   , _height(height)
   , _api(api)
@@ -23,7 +29,8 @@ Engine::Engine(int width, int height, RenderAPI api)
     std::cout << "=== Engine init === \n";
 #endif
 
-    if (!initWindow())
+    // Headless engines never touch GLFW
+    if (!settings.headless && !initWindow())
         throw(::std::runtime_error("Could not init GLFW window"));
 
     switch (_api)
@@ -31,7 +38,7 @@ Engine::Engine(int width, int height, RenderAPI api)
         // NOTE: Always defaults to vulkan for now
         default:
             _renderer = std::make_unique<vk::VulkanRenderer>(
-              _window, _width, _height, false);
+              _window, _width, _height, _jobs, settings);
     }
 }
 
@@ -59,7 +66,12 @@ void Engine::resizeCallback(GLFWwindow* w, int width, int height)
         Engine* engine = static_cast<Engine*>(glfwGetWindowUserPointer(w));
 
         if (engine)
-            engine->getRenderer()->resizeSwapchain(width, height);
+        {
+            std::lock_guard lock(engine->_frameMutex);
+            engine->_resizePending = true;
+            engine->_pendingWidth = width;
+            engine->_pendingHeight = height;
+        }
     }
 }
 
@@ -67,10 +79,47 @@ void Engine::addToScene(const std::vector<std::shared_ptr<Mesh>>& meshes)
 {
     for (auto& mesh : meshes)
     {
-        _scene.push_back(mesh);
-        _renderer->uploadMesh(mesh);
+        MeshHandle handle = _renderer->uploadMesh(*mesh);
+        _scene.addInstance(_scene.addMesh(mesh->uuid, handle, mesh->bounds),
+                           glm::mat4(1.0f));
     }
-    std::cout << "Scene size :" << _scene.size() << std::endl;
+    _sceneVersion++;
+    std::cerr << "Scene size :" << _scene.instanceCount() << std::endl;
+}
+
+void Engine::addToScene(const MappedMeshCache& cache)
+{
+    for (size_t i = 0; i < cache.meshCount(); i++)
+    {
+        std::string uuid = generateUUID();
+        MeshHandle handle = _renderer->uploadMeshData(uuid,
+                                                      cache.vertices(i),
+                                                      cache.indices(i),
+                                                      VertexFormat::Standard);
+        _scene.addInstance(_scene.addMesh(uuid, handle, cache.bounds(i)),
+                           glm::mat4(1.0f));
+    }
+    _sceneVersion++;
+    std::cerr << "Scene size :" << _scene.instanceCount() << std::endl;
+}
+
+std::vector<InstanceHandle> Engine::addInstances(
+  const Mesh& mesh, std::span<const glm::mat4> transforms)
+{
+    MeshHandle handle = _renderer->uploadMesh(mesh);
+    uint32_t meshIndex = _scene.addMesh(mesh.uuid, handle, mesh.bounds);
+    std::vector<InstanceHandle> instances;
+    instances.reserve(transforms.size());
+    for (const glm::mat4& transform : transforms)
+        instances.push_back(_scene.addInstance(meshIndex, transform));
+    _sceneVersion++;
+    return instances;
+}
+
+void Engine::removeInstance(InstanceHandle instance)
+{
+    _scene.removeInstance(instance);
+    _sceneVersion++;
 }
 
 void Engine::run()
@@ -78,15 +127,248 @@ void Engine::run()
 #ifndef NDEBUG
     std::cout << "=== Engine run === \n";
 #endif
+    BALDWIN_PROFILE_THREAD("Main");
 
-    while (!glfwWindowShouldClose(_window))
-    {
+    if (_pipelined)
+        runPipelined();
+    else
+        runSerial();
+}
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+
+} // namespace
+
+bool Engine::keepRunning() const
+{
+    if (_frameLimit > 0 && _frame >= _frameLimit)
+        return false;
+    return !_window || !glfwWindowShouldClose(_window);
+}
+
+void Engine::pollEvents()
+{
+    if (_window)
         glfwPollEvents();
+}
+
+void Engine::updateScene(double dt)
+{
+    if (!_update)
+        return;
+
+    BALDWIN_PROFILE_ZONE("Update");
+    _update(_scene, dt);
+    // Nothing tells us what the update touched
+    _sceneVersion++;
+}
+
+void Engine::applyPendingResize()
+{
+    int width, height;
+    {
+        std::lock_guard lock(_frameMutex);
+        if (!_resizePending)
+            return;
+        _resizePending = false;
+        width = _pendingWidth;
+        height = _pendingHeight;
+    }
+    _renderer->resizeSwapchain(width, height);
+}
+
+void Engine::runSerial()
+{
+    Clock::time_point lastFrame = Clock::now();
+    while (keepRunning())
+    {
+        Clock::time_point frameStart = Clock::now();
+        double dt = std::chrono::duration<double>(frameStart - lastFrame)
+                      .count();
+        lastFrame = frameStart;
+
+        pollEvents();
+        updateScene(dt);
+        double updateMs = millisecondsSince(frameStart);
+
+        Clock::time_point renderStart = Clock::now();
+        applyPendingResize();
         _renderer->render(_frame, _scene);
         _frame++;
+        BALDWIN_PROFILE_FRAME();
+
+        recordTimings(millisecondsSince(frameStart),
+                      updateMs,
+                      millisecondsSince(renderStart) -
+                        _renderer->stats().waitMs);
+    }
+}
+
+void Engine::runPipelined()
+{
+    {
+        std::lock_guard lock(_frameMutex);
+        _running = true;
+    }
+    _renderThread = std::thread(&Engine::renderLoop, this);
+
+    Clock::time_point lastFrame = Clock::now();
+    while (keepRunning())
+    {
+        Clock::time_point frameStart = Clock::now();
+        double dt = std::chrono::duration<double>(frameStart - lastFrame)
+                      .count();
+        lastFrame = frameStart;
+
+        // Input and update only touch the main scene
+        pollEvents();
+        updateScene(dt);
+
+        // Wait for the render thread to pick up the previous snapshot, then
+        // fill the one it is not drawing
+        int slot;
+        double renderMs;
+        Clock::time_point waitStart = Clock::now();
+        {
+            std::unique_lock lock(_frameMutex);
+            _frameCondition.wait(lock,
+                                 [this]()
+                                 {
+                                     return _readySnapshot == -1 ||
+                                            _renderError;
+                                 });
+            if (_renderError)
+                break;
+            slot = _renderingSnapshot == 0 ? 1 : 0;
+            renderMs = _renderMs;
+        }
+        // Idle time, not part of the update
+        double waitMs = millisecondsSince(waitStart);
+
+        FrameSnapshot& snapshot = _snapshots[slot];
+        // Static scenes are only copied once into each snapshot
+        if (snapshot.sceneVersion != _sceneVersion)
+        {
+            BALDWIN_PROFILE_ZONE("Extract scene");
+            _scene.extractTo(snapshot.scene);
+            snapshot.sceneVersion = _sceneVersion;
+        }
+        snapshot.frame = _frame++;
+        double updateMs = millisecondsSince(frameStart) - waitMs;
+
+        {
+            std::lock_guard lock(_frameMutex);
+            _readySnapshot = slot;
+        }
+        _frameCondition.notify_all();
+
+        // The render time is the one of the frame drawn meanwhile
+        recordTimings(millisecondsSince(frameStart), updateMs, renderMs);
+    }
+
+    {
+        std::lock_guard lock(_frameMutex);
+        _running = false;
+    }
+    _frameCondition.notify_all();
+    _renderThread.join();
+
+    if (_renderError)
+        std::rethrow_exception(_renderError);
+}
+
+void Engine::renderLoop()
+{
+    BALDWIN_PROFILE_THREAD("Render");
+    while (true)
+    {
+        int slot;
+        {
+            std::unique_lock lock(_frameMutex);
+            _frameCondition.wait(lock,
+                                 [this]()
+                                 {
+                                     return _readySnapshot != -1 || !_running;
+                                 });
+            // Frames already extracted are dropped on exit
+            if (!_running)
+                return;
+            slot = _readySnapshot;
+            _readySnapshot = -1;
+            _renderingSnapshot = slot;
+        }
+        _frameCondition.notify_all();
+
+        Clock::time_point renderStart = Clock::now();
+        try
+        {
+            applyPendingResize();
+            const FrameSnapshot& snapshot = _snapshots[slot];
+            _renderer->render(snapshot.frame, snapshot.scene);
+        }
+        catch (...)
+        {
+            // Handed over to the main thread, which rethrows it from run()
+            {
+                std::lock_guard lock(_frameMutex);
+                _renderError = std::current_exception();
+                _renderingSnapshot = -1;
+            }
+            _frameCondition.notify_all();
+            return;
+        }
+        double renderMs = millisecondsSince(renderStart) -
+                          _renderer->stats().waitMs;
+        BALDWIN_PROFILE_FRAME();
+
+        std::lock_guard lock(_frameMutex);
+        _renderingSnapshot = -1;
+        _renderMs = renderMs;
     }
 }
 
+void Engine::recordTimings(double frameMs, double updateMs, double renderMs)
+{
+    constexpr int ReportFrames = 500;
+
+    _timingSums.frameMs += frameMs;
+    _timingSums.updateMs += updateMs;
+    _timingSums.renderMs += renderMs;
+    if (++_timedFrames < ReportFrames)
+        return;
+
+    _timings = {
+        .frameMs = _timingSums.frameMs / _timedFrames,
+        .updateMs = _timingSums.updateMs / _timedFrames,
+        .renderMs = _timingSums.renderMs / _timedFrames,
+        .cpuUtilisation = (_timingSums.updateMs + _timingSums.renderMs) /
+                          _timingSums.frameMs,
+    };
+    _timingSums = {};
+    _timedFrames = 0;
+
+#ifndef NDEBUG
+    std::cout << std::format("Frame {:.2f} ms | update {:.2f} ms | render "
+                             "{:.2f} ms | cpu {:.0f}%\n",
+                             _timings.frameMs,
+                             _timings.updateMs,
+                             _timings.renderMs,
+                             _timings.cpuUtilisation * 100.0);
+#ifdef BALDWIN_PROFILING
+    Profiler::instance().printSummary();
+#endif
+#endif
+}
+
 Engine::~Engine()
 {
 #ifndef NDEBUG
@@ -95,8 +377,11 @@ Engine::~Engine()
 
     loadedEngine = nullptr;
     _renderer.reset();
-    glfwDestroyWindow(_window);
-    glfwTerminate();
+    if (_window)
+    {
+        glfwDestroyWindow(_window);
+        glfwTerminate();
+    }
 }
 
 } // namespace baldwin
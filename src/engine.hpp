@@ -1,10 +1,18 @@
 #pragma once
 
+#include <span>
+#include <mutex>
 #include <memory>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
 #include <GLFW/glfw3.h>
 
 #include "renderer/renderer.hpp"
 #include "renderer/render_types.hpp"
+#include "loader/mesh_cache.hpp"
+#include "utils/job_system.hpp"
 
 namespace baldwin
 {
@@ -15,27 +23,109 @@ enum RenderAPI
     DirectX12 = 1
 };
 
+// CPU time spent per frame, averaged over the last reporting period
+struct FrameTimings
+{
+    double frameMs = 0.0;
+    // Input, update and snapshot extraction on the main thread, without the
+    // wait for the render thread
+    double updateMs = 0.0;
+    // Recording and submission on the render thread, without the waits for
+    // the frame fence and the swapchain image
+    double renderMs = 0.0;
+    // Busy time of both threads over the frame time, 1.0 is one full core
+    double cpuUtilisation = 0.0;
+};
+
 class Engine
 {
   public:
     static Engine& get();
-    Engine(int width, int height, RenderAPI api);
+    Engine(int width, int height, RenderAPI api,
+           const RendererSettings& settings = {});
     ~Engine();
     void run();
 
+    // Called on the main thread every frame before the scene is handed to
+    // the renderer. It may move instances but must not add meshes, uploads
+    // go through the renderer which belongs to the render thread.
+    using UpdateFunction = std::function<void(RenderScene& scene, double dt)>;
+    void setUpdate(UpdateFunction update) { _update = std::move(update); }
+    // Runs update and rendering in lockstep on the main thread when off,
+    // mostly to compare against the pipelined loop
+    void setFramePipelining(bool enabled) { _pipelined = enabled; }
+    const FrameTimings& frameTimings() const { return _timings; }
+    // run returns after this many frames, 0 runs until the window closes.
+    // Headless engines have no window and need one.
+    void setFrameLimit(int frames) { _frameLimit = frames; }
+
     Renderer* getRenderer() { return _renderer.get(); }
+    // Shared by the loader, the culling and the command recording
+    JobSystem& getJobs() { return _jobs; }
     void addToScene(const std::vector<std::shared_ptr<Mesh>>& meshes);
+    // Uploads baked meshes straight from the mapped cache, the scene meshes
+    // only carry their uuid and hold no CPU side geometry
+    void addToScene(const MappedMeshCache& cache);
+    // Places the mesh once per transform, all copies share its geometry and
+    // are drawn together. The handles stay valid until their instance is
+    // removed, the update function can resolve them on its scene.
+    std::vector<InstanceHandle> addInstances(
+      const Mesh& mesh, std::span<const glm::mat4> transforms);
+    void removeInstance(InstanceHandle instance);
 
   private:
+    // A copy of the scene owned by the render thread while it is drawn
+    struct FrameSnapshot
+    {
+        RenderScene scene;
+        uint64_t sceneVersion = UINT64_MAX;
+        int frame = 0;
+    };
+
     bool initWindow();
+    bool keepRunning() const;
+    void pollEvents();
     static void resizeCallback(GLFWwindow* w, int width, int height);
     bool initImgui();
+    void runSerial();
+    void runPipelined();
+    void renderLoop();
+    void applyPendingResize();
+    void updateScene(double dt);
+    void recordTimings(double frameMs, double updateMs, double renderMs);
 
-    std::vector<std::shared_ptr<Mesh>> _scene;
+    RenderScene _scene;
+    uint64_t _sceneVersion = 0;
+    UpdateFunction _update;
+    bool _pipelined = true;
     int _frame = 0;
+    int _frameLimit = 0;
+
+    // The main thread fills one snapshot while the render thread draws the
+    // other, so the update of frame N + 1 overlaps the recording of frame N
+    FrameSnapshot _snapshots[2];
+    std::mutex _frameMutex;
+    std::condition_variable _frameCondition;
+    int _readySnapshot = -1;
+    int _renderingSnapshot = -1;
+    bool _running = false;
+    double _renderMs = 0.0;
+    std::exception_ptr _renderError;
+    std::thread _renderThread;
+
+    // GLFW reports resizes on the main thread, the render thread applies them
+    bool _resizePending = false;
+    int _pendingWidth = 0;
+    int _pendingHeight = 0;
+
+    FrameTimings _timings{};
+    FrameTimings _timingSums{};
+    int _timedFrames = 0;
+
     int _width, _height;
     GLFWwindow* _window = nullptr;
     const RenderAPI _api;
+    JobSystem _jobs;
     std::unique_ptr<Renderer> _renderer;
 };
 
@@ -1,6 +1,7 @@
 #include "gltf.hpp"
 
 #include <cstdint>
+#include <algorithm>
 #include <iostream>
 #include <format>
 #include <fastgltf/core.hpp>
@@ -8,19 +9,121 @@
 #include <fastgltf/types.hpp>
 #include <fastgltf/tools.hpp>
 #include "utils/uuid.hpp"
+#include "utils/job_system.hpp"
+#include "renderer/bounds.hpp"
+#include "loader/mesh_optimizer.hpp"
+#include "loader/mesh_simplifier.hpp"
+#include "loader/meshlet_builder.hpp"
 
 namespace baldwin
 {
 
+namespace
+{
+
+// One primitive to decode, along with where its data lands in the already
+// sized vertex and index arrays of its mesh
+struct PrimitiveTask
+{
+    Mesh* mesh;
+    const fastgltf::Primitive* primitive;
+    size_t firstVertex;
+    size_t firstIndex;
+};
+
+void decodePrimitive(const fastgltf::Asset& asset, const PrimitiveTask& task)
+{
+    const fastgltf::Primitive& p = *task.primitive;
+    Vertex* vertices = task.mesh->vertices.data() + task.firstVertex;
+    uint32_t* indices = task.mesh->indices.data() + task.firstIndex;
+    const uint32_t initialVtx = static_cast<uint32_t>(task.firstVertex);
+
+    // Access indices
+    fastgltf::iterateAccessorWithIndex<std::uint32_t>(
+      asset,
+      asset.accessors[p.indicesAccessor.value()],
+      [&](std::uint32_t idx, size_t index)
+      {
+          indices[index] = idx + initialVtx;
+      });
+
+    // Access position and create vertex
+    const fastgltf::Accessor&
+      posaccessor = asset.accessors[p.findAttribute("POSITION")->accessorIndex];
+    fastgltf::iterateAccessorWithIndex<glm::vec3>(
+      asset,
+      posaccessor,
+      [&](glm::vec3 p, size_t index)
+      {
+          Vertex& newvtx = vertices[index];
+          newvtx.position = p;
+          newvtx.normal = { 1, 0, 0 };
+          newvtx.color = glm::vec4{ 1.f };
+          newvtx.uv_x = 0;
+          newvtx.uv_y = 0;
+      });
+
+    // Normal
+    auto normals = p.findAttribute("NORMAL");
+    if (normals != p.attributes.end())
+    {
+        fastgltf::iterateAccessorWithIndex<glm::vec3>(
+          asset,
+          asset.accessors[normals->accessorIndex],
+          [&](glm::vec3 n, size_t index)
+          {
+              vertices[index].normal = n;
+          });
+    }
+
+    // UV
+    auto uvs = p.findAttribute("TEXCOORD_0");
+    if (uvs != p.attributes.end())
+    {
+        fastgltf::iterateAccessorWithIndex<glm::vec2>(
+          asset,
+          asset.accessors[uvs->accessorIndex],
+          [&](glm::vec2 uv, size_t index)
+          {
+              vertices[index].uv_x = uv.x;
+              vertices[index].uv_y = uv.y;
+          });
+    }
+
+    // Vertex color
+    auto colors = p.findAttribute("COLOR_0");
+    if (colors != p.attributes.end())
+    {
+        fastgltf::iterateAccessorWithIndex<glm::vec4>(
+          asset,
+          asset.accessors[colors->accessorIndex],
+          [&](glm::vec4 c, size_t index)
+          {
+              vertices[index].color = c;
+          });
+    }
+
+    // NOTE: Used to display vertex normals
+    constexpr bool OverrideColors = true;
+    if (OverrideColors)
+    {
+        for (size_t i = 0; i < posaccessor.count; i++)
+        {
+            vertices[i].color = glm::vec4(vertices[i].normal, 1.f);
+        }
+    }
+}
+
+} // namespace
+
 std::optional<std::vector<std::shared_ptr<Mesh>>> loadGLTFMeshes(
-  const std::filesystem::path& filePath)
+  const std::filesystem::path& filePath, const GLTFLoadOptions& options)
 {
-    std::cout << std::format("Loading GLTF meshes from : {}\n",
+    std::cerr << std::format("Loading GLTF meshes from : {}\n",
                              filePath.string());
 
     fastgltf::Parser parser{};
     constexpr auto gltfOptions = fastgltf::Options::LoadExternalBuffers;
-    auto data = fastgltf::GltfDataBuffer::FromPath(filePath.string());
 
     auto gltfFile = fastgltf::MappedGltfFile::FromPath(filePath);
     if (!bool(gltfFile))
@@ -39,103 +142,111 @@ std::optional<std::vector<std::shared_ptr<Mesh>>> loadGLTFMeshes(
         return {};
     }
 
-    // We start to iterate over gltf meshes
-    std::vector<std::shared_ptr<Mesh>> meshPtrs;
-    for (auto& mesh : asset->meshes)
+    // Lay out every mesh up front from the accessor counts so primitives can
+    // be decoded independently, each one writing to its own slice
+    std::vector<Mesh> meshes(asset->meshes.size());
+    std::vector<PrimitiveTask> tasks;
+    for (size_t i = 0; i < asset->meshes.size(); i++)
     {
-        Mesh newMesh{ .uuid = generateUUID() };
+        Mesh& newMesh = meshes[i];
+        newMesh.uuid = generateUUID();
+        newMesh.vertexFormat = options.vertexFormat;
 
-        int initialVtx = 0;
-        for (auto& p : mesh.primitives)
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        for (auto& p : asset->meshes[i].primitives)
         {
-            // Access indices
-            fastgltf::Accessor&
-              indexaccessor = asset->accessors[p.indicesAccessor.value()];
-            newMesh.indices.reserve(newMesh.indices.size() +
-                                    indexaccessor.count);
-
-            fastgltf::iterateAccessor<std::uint32_t>(
-              asset.get(),
-              indexaccessor,
-              [&](std::uint32_t idx)
-              {
-                  newMesh.indices.push_back(idx + initialVtx);
-              });
-
-            // Access position and create vertex
-            fastgltf::Accessor&
-              posaccessor = asset->accessors[p.findAttribute("POSITION")
-                                               ->accessorIndex];
-            newMesh.vertices.reserve(newMesh.vertices.size() +
-                                     posaccessor.count);
-
-            fastgltf::iterateAccessorWithIndex<glm::vec3>(
-              asset.get(),
-              posaccessor,
-              [&](glm::vec3 p, size_t index)
-              {
-                  Vertex newvtx;
-                  newvtx.position = p;
-                  newvtx.normal = { 1, 0, 0 };
-                  newvtx.color = glm::vec4{ 1.f };
-                  newvtx.uv_x = 0;
-                  newvtx.uv_y = 0;
-                  newMesh.vertices.push_back(newvtx);
-              });
-
-            // Normal
-            auto normals = p.findAttribute("NORMAL");
-            if (normals != p.attributes.end())
-            {
-                fastgltf::iterateAccessorWithIndex<glm::vec3>(
-                  asset.get(),
-                  asset->accessors[normals->accessorIndex],
-                  [&](glm::vec3 n, size_t index)
-                  {
-                      newMesh.vertices[initialVtx + index].normal = n;
-                  });
-            }
-
-            // UV
-            auto uvs = p.findAttribute("TEXCOORD_0");
-            if (uvs != p.attributes.end())
-            {
-                fastgltf::iterateAccessorWithIndex<glm::vec2>(
-                  asset.get(),
-                  asset->accessors[uvs->accessorIndex],
-                  [&](glm::vec2 uv, size_t index)
-                  {
-                      newMesh.vertices[initialVtx + index].uv_x = uv.x;
-                      newMesh.vertices[initialVtx + index].uv_y = uv.y;
-                  });
-            }
-
-            // Vertex color
-            auto colors = p.findAttribute("COLOR_0");
-            if (colors != p.attributes.end())
-            {
-                fastgltf::iterateAccessorWithIndex<glm::vec4>(
-                  asset.get(),
-                  asset->accessors[colors->accessorIndex],
-                  [&](glm::vec4 c, size_t index)
-                  {
-                      newMesh.vertices[initialVtx + index].color = c;
-                  });
-            }
-            initialVtx += posaccessor.count;
+            tasks.push_back({ .mesh = &newMesh,
+                              .primitive = &p,
+                              .firstVertex = vertexCount,
+                              .firstIndex = indexCount });
+
+            indexCount += asset->accessors[p.indicesAccessor.value()].count;
+            vertexCount += asset->accessors[p.findAttribute("POSITION")
+                                              ->accessorIndex]
+                             .count;
         }
+        newMesh.vertices.resize(vertexCount);
+        newMesh.indices.resize(indexCount);
+    }
 
-        // NOTE: Used to display vertex normals
-        constexpr bool OverrideColors = true;
-        if (OverrideColors)
+    std::unique_ptr<JobSystem> ownJobs;
+    if (!options.jobs)
+    {
+        ownJobs = std::make_unique<JobSystem>(std::min<size_t>(
+          options.threadCount == 0 ? std::thread::hardware_concurrency()
+                                   : options.threadCount,
+          std::max<size_t>(tasks.size(), 1)));
+    }
+    JobSystem& jobs = options.jobs ? *options.jobs : *ownJobs;
+    jobs.parallelFor(tasks.size(),
+                     [&](size_t i)
+                     {
+                         decodePrimitive(asset.get(), tasks[i]);
+                     });
+    std::vector<MeshOptimizationStatistics> optimization(meshes.size());
+    jobs.parallelFor(meshes.size(),
+                     [&](size_t i)
+                     {
+                         if (options.optimize)
+                             optimization[i] = optimizeMesh(meshes[i]);
+                         if (options.generateLods)
+                             generateLods(meshes[i]);
+                         if (options.buildMeshlets)
+                             buildMeshlets(meshes[i]);
+                         meshes[i].bounds = computeBounds(meshes[i].vertices);
+                     });
+#ifndef NDEBUG
+    if (options.optimize)
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
         {
-            for (Vertex& vtx : newMesh.vertices)
+            const MeshOptimizationStatistics& stats = optimization[i];
+            std::cout << std::format("Optimized mesh {} : ACMR {:.3f} -> "
+                                     "{:.3f}, ATVR {:.3f} -> {:.3f}, {} -> "
+                                     "{} vertices\n",
+                                     i,
+                                     stats.before.acmr,
+                                     stats.after.acmr,
+                                     stats.before.atvr,
+                                     stats.after.atvr,
+                                     stats.verticesBefore,
+                                     stats.verticesAfter);
+        }
+    }
+#endif
+#ifndef NDEBUG
+    if (options.generateLods)
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            std::cout << std::format("Mesh {} LODs :", i);
+            for (const MeshLod& lod : meshes[i].lods)
             {
-                vtx.color = glm::vec4(vtx.normal, 1.f);
+                std::cout << std::format(" {} ({:.4f})",
+                                         lod.indexCount / 3,
+                                         lod.error);
             }
+            std::cout << '\n';
         }
-        /*std::cout << newMesh.indices.size() << std::endl;*/
-        meshPtrs.emplace_back(std::make_shared<Mesh>(std::move(newMesh)));
+    }
+#endif
+#ifndef NDEBUG
+    if (options.buildMeshlets)
+    {
+        for (size_t i = 0; i < meshes.size(); i++)
+        {
+            std::cout << std::format(
+              "Mesh {} : {} meshlets\n", i, meshes[i].meshlets.size());
+        }
+    }
+#endif
+
+    std::vector<std::shared_ptr<Mesh>> meshPtrs;
+    meshPtrs.reserve(meshes.size());
+    for (Mesh& mesh : meshes)
+    {
+        meshPtrs.emplace_back(std::make_shared<Mesh>(std::move(mesh)));
     }
 
     return meshPtrs;
@@ -6,10 +6,30 @@
 #include <filesystem>
 
 #include "renderer/render_types.hpp"
+#include "utils/job_system.hpp"
 
 namespace baldwin
 {
 
+struct GLTFLoadOptions
+{
+    // Threads used to decode primitives, 0 uses every hardware thread and
+    // 1 decodes everything on the calling thread
+    unsigned int threadCount = 0;
+    // Decodes on these threads instead, threadCount is then ignored
+    JobSystem* jobs = nullptr;
+    // How the meshes are stored once uploaded, Compact quantizes them to a
+    // third of the size
+    VertexFormat vertexFormat = VertexFormat::Standard;
+    // Merges duplicate vertices and reorders triangles and vertices for the
+    // vertex cache, overdraw and fetch locality, see optimizeMesh
+    bool optimize = false;
+    // Appends simplified LODs to every mesh, see generateLods
+    bool generateLods = false;
+    // Splits every mesh into meshlets for cluster culling, see buildMeshlets
+    bool buildMeshlets = false;
+};
+
 std::optional<std::vector<std::shared_ptr<Mesh>>> loadGLTFMeshes(
-  const std::filesystem::path& filePath);
+  const std::filesystem::path& filePath, const GLTFLoadOptions& options = {});
 }
@@ -0,0 +1,320 @@
+#include "mesh_cache.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <format>
+#include <iostream>
+#include <optional>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BALDWIN_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "gltf.hpp"
+#include "utils/hash.hpp"
+
+namespace baldwin
+{
+
+namespace
+{
+
+constexpr size_t DataAlignment = 16;
+
+size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+struct SourceInfo
+{
+    uint64_t size;
+    int64_t mtime;
+};
+
+std::optional<SourceInfo> getSourceInfo(const std::filesystem::path& path)
+{
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec)
+        return {};
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec)
+        return {};
+
+    return SourceInfo{ .size = size,
+                       .mtime = static_cast<int64_t>(
+                         mtime.time_since_epoch().count()) };
+}
+
+std::optional<uint64_t> hashFile(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        return {};
+
+    std::vector<char> chunk(1 << 20);
+    uint64_t hash = FNV1aSeed;
+    while (file)
+    {
+        file.read(chunk.data(), chunk.size());
+        hash = fnv1a(chunk.data(), file.gcount(), hash);
+    }
+    return hash;
+}
+
+// Whether count elements starting at offset fit in size bytes, written so
+// that corrupted offsets and counts cannot overflow
+bool rangeFits(uint64_t offset, uint64_t count, size_t elementSize,
+               size_t size)
+{
+    return offset <= size && count <= (size - offset) / elementSize;
+}
+
+// Stores the current size and modification time of the source so the next
+// open does not hash it again. Best effort, a failure only costs a rehash.
+void refreshSourceInfo(const std::filesystem::path& cachePath,
+                       MeshCacheHeader header, const SourceInfo& source)
+{
+    header.sourceMtime = source.mtime;
+    header.sourceSize = source.size;
+    std::fstream file(cachePath,
+                      std::ios::in | std::ios::out | std::ios::binary);
+    if (file.is_open())
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+} // namespace
+
+std::unique_ptr<MappedMeshCache> MappedMeshCache::open(
+  const std::filesystem::path& cachePath,
+  const std::filesystem::path& sourcePath)
+{
+    std::unique_ptr<MappedMeshCache> cache(new MappedMeshCache());
+
+#ifdef BALDWIN_HAS_MMAP
+    int fd = ::open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        ::close(fd);
+        return nullptr;
+    }
+
+    void* mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return nullptr;
+
+    cache->_data = static_cast<const char*>(mapped);
+    cache->_size = st.st_size;
+#else
+    std::ifstream file(cachePath, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+        return nullptr;
+
+    cache->_fallbackData.resize(file.tellg());
+    file.seekg(0);
+    file.read(cache->_fallbackData.data(), cache->_fallbackData.size());
+    cache->_data = cache->_fallbackData.data();
+    cache->_size = cache->_fallbackData.size();
+#endif
+
+    // Header
+    if (cache->_size < sizeof(MeshCacheHeader))
+        return nullptr;
+
+    MeshCacheHeader header;
+    memcpy(&header, cache->_data, sizeof(MeshCacheHeader));
+    if (header.magic != MeshCacheMagic ||
+        header.version != MeshCacheVersion ||
+        header.vertexStride != sizeof(Vertex))
+    {
+        return nullptr;
+    }
+
+    // Source invalidation
+    auto source = getSourceInfo(sourcePath);
+    if (source && (source->size != header.sourceSize ||
+                   source->mtime != header.sourceMtime))
+    {
+        auto hash = hashFile(sourcePath);
+        if (!hash || *hash != header.sourceHash)
+        {
+            std::cerr << std::format("Mesh cache {} is stale\n",
+                                     cachePath.string());
+            return nullptr;
+        }
+        // Touched but unchanged, e.g. copied or checked out again
+        refreshSourceInfo(cachePath, header, *source);
+    }
+
+    // Mesh table, every range has to stay inside the file
+    if (!rangeFits(sizeof(MeshCacheHeader),
+                   header.meshCount,
+                   sizeof(MeshCacheEntry),
+                   cache->_size))
+    {
+        return nullptr;
+    }
+
+    cache->_entries = std::span<const MeshCacheEntry>(
+      reinterpret_cast<const MeshCacheEntry*>(cache->_data +
+                                              sizeof(MeshCacheHeader)),
+      header.meshCount);
+    for (const MeshCacheEntry& entry : cache->_entries)
+    {
+        if (entry.vertexOffset % alignof(Vertex) != 0 ||
+            entry.indexOffset % alignof(uint32_t) != 0 ||
+            !rangeFits(entry.vertexOffset,
+                       entry.vertexCount,
+                       sizeof(Vertex),
+                       cache->_size) ||
+            !rangeFits(entry.indexOffset,
+                       entry.indexCount,
+                       sizeof(uint32_t),
+                       cache->_size))
+        {
+            return nullptr;
+        }
+    }
+
+    return cache;
+}
+
+std::span<const Vertex> MappedMeshCache::vertices(size_t mesh) const
+{
+    const MeshCacheEntry& entry = _entries[mesh];
+    return { reinterpret_cast<const Vertex*>(_data + entry.vertexOffset),
+             entry.vertexCount };
+}
+
+std::span<const uint32_t> MappedMeshCache::indices(size_t mesh) const
+{
+    const MeshCacheEntry& entry = _entries[mesh];
+    return { reinterpret_cast<const uint32_t*>(_data + entry.indexOffset),
+             entry.indexCount };
+}
+
+MappedMeshCache::~MappedMeshCache()
+{
+#ifdef BALDWIN_HAS_MMAP
+    if (_data)
+        munmap(const_cast<char*>(_data), _size);
+#endif
+}
+
+bool bakeMeshCache(const std::vector<std::shared_ptr<Mesh>>& meshes,
+                   const std::filesystem::path& sourcePath,
+                   const std::filesystem::path& cachePath)
+{
+    auto source = getSourceInfo(sourcePath);
+    auto hash = hashFile(sourcePath);
+    if (!source || !hash)
+    {
+        std::cerr << "Could not read mesh cache source "
+                  << sourcePath.string() << '\n';
+        return false;
+    }
+
+    MeshCacheHeader header = {
+        .magic = MeshCacheMagic,
+        .version = MeshCacheVersion,
+        .vertexStride = sizeof(Vertex),
+        .meshCount = static_cast<uint32_t>(meshes.size()),
+        .sourceHash = *hash,
+        .sourceMtime = source->mtime,
+        .sourceSize = source->size,
+    };
+
+    // Lay out the data blocks after the mesh table
+    std::vector<MeshCacheEntry> entries;
+    entries.reserve(meshes.size());
+    size_t offset = alignUp(sizeof(MeshCacheHeader) +
+                              meshes.size() * sizeof(MeshCacheEntry),
+                            DataAlignment);
+    for (auto& mesh : meshes)
+    {
+        MeshCacheEntry entry = { .vertexOffset = offset,
+                                 .vertexCount = mesh->vertices.size() };
+        offset = alignUp(offset + mesh->vertices.size() * sizeof(Vertex),
+                         DataAlignment);
+        // LODs are not cached, only the full detail indices are kept
+        entry.indexOffset = offset;
+        entry.indexCount = mesh->lods.empty() ? mesh->indices.size()
+                                              : mesh->lods[0].indexCount;
+        entry.bounds = mesh->bounds;
+        offset = alignUp(offset + entry.indexCount * sizeof(uint32_t),
+                         DataAlignment);
+        entries.push_back(entry);
+    }
+
+    std::vector<char> blob(offset, 0);
+    memcpy(blob.data(), &header, sizeof(MeshCacheHeader));
+    memcpy(blob.data() + sizeof(MeshCacheHeader),
+           entries.data(),
+           entries.size() * sizeof(MeshCacheEntry));
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        memcpy(blob.data() + entries[i].vertexOffset,
+               meshes[i]->vertices.data(),
+               meshes[i]->vertices.size() * sizeof(Vertex));
+        memcpy(blob.data() + entries[i].indexOffset,
+               meshes[i]->indices.data(),
+               entries[i].indexCount * sizeof(uint32_t));
+    }
+
+    // Write next to the destination and swap it in so a reader never maps a
+    // half written file
+    std::filesystem::path tmpPath = cachePath;
+    tmpPath += ".tmp";
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not write mesh cache " << tmpPath.string()
+                  << '\n';
+        return false;
+    }
+    file.write(blob.data(), blob.size());
+    file.close();
+
+    // Never leave a partial file behind
+    std::error_code ec;
+    if (file.fail())
+    {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    std::filesystem::rename(tmpPath, cachePath, ec);
+    if (ec)
+    {
+        std::filesystem::remove(tmpPath, ec);
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<MappedMeshCache> openOrBakeMeshCache(
+  const std::filesystem::path& sourcePath,
+  const std::filesystem::path& cachePath)
+{
+    if (auto cache = MappedMeshCache::open(cachePath, sourcePath))
+        return cache;
+
+    std::cerr << std::format("Baking mesh cache {}\n", cachePath.string());
+    auto meshes = loadGLTFMeshes(sourcePath);
+    if (!meshes || !bakeMeshCache(*meshes, sourcePath, cachePath))
+        return nullptr;
+
+    return MappedMeshCache::open(cachePath, sourcePath);
+}
+
+} // namespace baldwin
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <filesystem>
+
+#include "renderer/render_types.hpp"
+
+namespace baldwin
+{
+
+// Baked mesh cache layout :
+// [MeshCacheHeader][MeshCacheEntry * meshCount][vertex and index data]
+// Vertex and index blocks are stored exactly as the renderer uploads them, so
+// loading is a single copy per block with no per-vertex work.
+constexpr uint32_t MeshCacheMagic = 0x48534d42; // "BMSH"
+constexpr uint32_t MeshCacheVersion = 2;
+
+struct MeshCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertexStride;
+    uint32_t meshCount;
+    uint64_t sourceHash;
+    int64_t sourceMtime;
+    uint64_t sourceSize;
+};
+
+struct MeshCacheEntry
+{
+    uint64_t vertexOffset; // in bytes from the start of the file
+    uint64_t vertexCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    Bounds bounds;
+};
+
+// Read-only view over a baked cache file mapped in memory. Spans stay valid
+// for the lifetime of the object.
+class MappedMeshCache
+{
+  public:
+    // Returns nullptr if the cache is missing, corrupted or was baked from a
+    // different version of sourcePath. The source is first checked by size
+    // and modification time, and only hashed when those differ. They are
+    // updated when the hash still matches. A missing source file is not an
+    // error, so baked caches can ship on their own.
+    static std::unique_ptr<MappedMeshCache> open(
+      const std::filesystem::path& cachePath,
+      const std::filesystem::path& sourcePath);
+    ~MappedMeshCache();
+
+    MappedMeshCache(const MappedMeshCache&) = delete;
+    MappedMeshCache& operator=(const MappedMeshCache&) = delete;
+
+    size_t meshCount() const { return _entries.size(); }
+    std::span<const Vertex> vertices(size_t mesh) const;
+    std::span<const uint32_t> indices(size_t mesh) const;
+    const Bounds& bounds(size_t mesh) const { return _entries[mesh].bounds; }
+
+  private:
+    MappedMeshCache() = default;
+
+    const char* _data = nullptr;
+    size_t _size = 0;
+    std::vector<char> _fallbackData;
+    std::span<const MeshCacheEntry> _entries;
+};
+
+// Writes meshes in their final layout to cachePath, tagged with the size,
+// modification time and hash of sourcePath
+bool bakeMeshCache(const std::vector<std::shared_ptr<Mesh>>& meshes,
+                   const std::filesystem::path& sourcePath,
+                   const std::filesystem::path& cachePath);
+
+// Opens the cache for a .glb, loading and baking it first if it is missing
+// or stale
+std::unique_ptr<MappedMeshCache> openOrBakeMeshCache(
+  const std::filesystem::path& sourcePath,
+  const std::filesystem::path& cachePath);
+
+} // namespace baldwin
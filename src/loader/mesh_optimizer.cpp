@@ -0,0 +1,301 @@
+#include "mesh_optimizer.hpp"
+
+#include <cstring>
+#include <algorithm>
+#include <glm/geometric.hpp>
+
+#include "utils/hash.hpp"
+
+namespace baldwin
+{
+
+namespace
+{
+
+constexpr uint32_t Unassigned = UINT32_MAX;
+
+} // namespace
+
+VertexCacheStatistics analyzeVertexCache(std::span<const uint32_t> indices,
+                                         size_t vertexCount,
+                                         uint32_t cacheSize)
+{
+    // A vertex is cached until cacheSize other vertices were shaded after it
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    size_t misses = 0;
+    for (uint32_t index : indices)
+    {
+        if (time - timestamps[index] > cacheSize)
+        {
+            timestamps[index] = time++;
+            misses++;
+        }
+    }
+
+    size_t referenced = std::count_if(timestamps.begin(),
+                                      timestamps.end(),
+                                      [](uint32_t t) { return t != 0; });
+    VertexCacheStatistics statistics{};
+    if (indices.size() >= 3)
+        statistics.acmr = static_cast<float>(misses) / (indices.size() / 3);
+    if (referenced > 0)
+        statistics.atvr = static_cast<float>(misses) / referenced;
+    return statistics;
+}
+
+size_t deduplicateVertices(Mesh& mesh)
+{
+    size_t vertexCount = mesh.vertices.size();
+    if (vertexCount == 0)
+        return 0;
+
+    // Open addressing over the unique vertices, at most half full. Vertex
+    // has no padding so bytes can be hashed and compared.
+    static_assert(sizeof(Vertex) == 12 * sizeof(float));
+    size_t capacity = 1;
+    while (capacity < vertexCount * 2)
+        capacity <<= 1;
+    std::vector<uint32_t> table(capacity, Unassigned);
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<Vertex> unique;
+    unique.reserve(vertexCount);
+
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const Vertex& v = mesh.vertices[i];
+        size_t slot = fnv1a(&v, sizeof(Vertex)) & (capacity - 1);
+        while (table[slot] != Unassigned &&
+               std::memcmp(&unique[table[slot]], &v, sizeof(Vertex)) != 0)
+        {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] == Unassigned)
+        {
+            table[slot] = static_cast<uint32_t>(unique.size());
+            unique.push_back(v);
+        }
+        remap[i] = table[slot];
+    }
+
+    for (uint32_t& index : mesh.indices)
+        index = remap[index];
+    size_t removed = vertexCount - unique.size();
+    mesh.vertices = std::move(unique);
+    return removed;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount,
+                         uint32_t cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles around every vertex, packed one vertex after the other
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (uint32_t index : indices)
+        liveTriangles[index]++;
+    std::vector<uint32_t> firstAdjacent(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++)
+        firstAdjacent[v + 1] = firstAdjacent[v] + liveTriangles[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> cursor(firstAdjacent.begin(),
+                                 firstAdjacent.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+        adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    uint32_t time = cacheSize + 1;
+    size_t scan = 0;
+
+    // Recently used vertices first, then the input order
+    auto skipDeadEnd = [&]() -> uint32_t
+    {
+        while (!deadEnds.empty())
+        {
+            uint32_t vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[vertex] > 0)
+                return vertex;
+        }
+        for (; scan < vertexCount; scan++)
+        {
+            if (liveTriangles[scan] > 0)
+                return static_cast<uint32_t>(scan);
+        }
+        return Unassigned;
+    };
+
+    uint32_t fanning = skipDeadEnd();
+    while (fanning != Unassigned)
+    {
+        // Emit every triangle left around the fanning vertex
+        candidates.clear();
+        for (uint32_t a = firstAdjacent[fanning];
+             a < firstAdjacent[fanning + 1];
+             a++)
+        {
+            uint32_t triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = indices[triangle * 3 + k];
+                output.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                    cacheTime[v] = time++;
+            }
+            emitted[triangle] = true;
+        }
+
+        // Next fan around the oldest candidate that stays in the cache
+        // while its own triangles are emitted
+        uint32_t next = Unassigned;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates)
+        {
+            if (liveTriangles[v] == 0)
+                continue;
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                priority = time - cacheTime[v];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        fanning = next != Unassigned ? next : skipDeadEnd();
+    }
+    indices = std::move(output);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices,
+                      std::span<const Vertex> vertices, uint32_t cacheSize)
+{
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    struct Cluster
+    {
+        size_t firstTriangle = 0;
+        size_t triangleCount = 0;
+        glm::vec3 centroid{ 0.0f }; // area weighted sum
+        glm::vec3 normal{ 0.0f };   // area weighted sum
+        float area = 0.0f;
+        float sortKey = 0.0f;
+    };
+    std::vector<Cluster> clusters;
+
+    // A triangle missing all three vertices starts over with a cold cache,
+    // reordering from there costs nothing
+    std::vector<uint32_t> timestamps(vertices.size(), 0);
+    uint32_t time = cacheSize + 1;
+    glm::vec3 meshCentroid{ 0.0f };
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        int misses = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t v = indices[t * 3 + k];
+            if (time - timestamps[v] > cacheSize)
+            {
+                timestamps[v] = time++;
+                misses++;
+            }
+        }
+        if (misses == 3 || clusters.empty())
+            clusters.push_back({ .firstTriangle = t });
+
+        glm::vec3 a = vertices[indices[t * 3]].position;
+        glm::vec3 b = vertices[indices[t * 3 + 1]].position;
+        glm::vec3 c = vertices[indices[t * 3 + 2]].position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float area = glm::length(normal) * 0.5f;
+        glm::vec3 centroid = (a + b + c) / 3.0f;
+
+        Cluster& cluster = clusters.back();
+        cluster.triangleCount++;
+        cluster.centroid += centroid * area;
+        cluster.normal += normal;
+        cluster.area += area;
+        meshCentroid += centroid * area;
+        meshArea += area;
+    }
+    if (clusters.size() < 2 || meshArea <= 0.0f)
+        return;
+    meshCentroid /= meshArea;
+
+    // Clusters far out along their normal are likely to be in front
+    for (Cluster& cluster : clusters)
+    {
+        float normalLength = glm::length(cluster.normal);
+        if (cluster.area <= 0.0f || normalLength <= 0.0f)
+            continue;
+        glm::vec3 centroid = cluster.centroid / cluster.area;
+        cluster.sortKey = glm::dot(centroid - meshCentroid,
+                                   cluster.normal / normalLength);
+    }
+    std::stable_sort(clusters.begin(),
+                     clusters.end(),
+                     [](const Cluster& a, const Cluster& b)
+                     {
+                         return a.sortKey > b.sortKey;
+                     });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    for (const Cluster& cluster : clusters)
+    {
+        auto first = indices.begin() + cluster.firstTriangle * 3;
+        sorted.insert(sorted.end(), first, first + cluster.triangleCount * 3);
+    }
+    indices = std::move(sorted);
+}
+
+void optimizeVertexFetch(Mesh& mesh)
+{
+    std::vector<uint32_t> remap(mesh.vertices.size(), Unassigned);
+    std::vector<Vertex> ordered;
+    ordered.reserve(mesh.vertices.size());
+    for (uint32_t& index : mesh.indices)
+    {
+        if (remap[index] == Unassigned)
+        {
+            remap[index] = static_cast<uint32_t>(ordered.size());
+            ordered.push_back(mesh.vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh.vertices = std::move(ordered);
+}
+
+MeshOptimizationStatistics optimizeMesh(Mesh& mesh)
+{
+    MeshOptimizationStatistics statistics{};
+    statistics.verticesBefore = mesh.vertices.size();
+    statistics.before = analyzeVertexCache(mesh.indices,
+                                           mesh.vertices.size());
+
+    deduplicateVertices(mesh);
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeOverdraw(mesh.indices, mesh.vertices);
+    optimizeVertexFetch(mesh);
+
+    statistics.verticesAfter = mesh.vertices.size();
+    statistics.after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    return statistics;
+}
+
+} // namespace baldwin
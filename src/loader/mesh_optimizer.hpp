@@ -0,0 +1,57 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+#include "renderer/render_types.hpp"
+
+namespace baldwin
+{
+
+// Post-transform vertex cache efficiency of an index buffer, simulated with
+// a FIFO cache. ACMR is the vertices shaded per triangle, 0.5 at best on a
+// regular grid and 3 at worst. ATVR is the vertices shaded per vertex
+// referenced, 1 at best.
+struct VertexCacheStatistics
+{
+    float acmr = 0.0f;
+    float atvr = 0.0f;
+};
+
+constexpr uint32_t VertexCacheSize = 16;
+
+VertexCacheStatistics analyzeVertexCache(std::span<const uint32_t> indices,
+                                         size_t vertexCount,
+                                         uint32_t cacheSize = VertexCacheSize);
+
+// Merges bitwise identical vertices and returns how many were removed
+size_t deduplicateVertices(Mesh& mesh);
+// Reorders triangles so vertices are reused while still in the cache,
+// Tipsify from Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw, Sander et al. 2007
+void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount,
+                         uint32_t cacheSize = VertexCacheSize);
+// Sorts the clusters of a cache optimized index buffer so those facing
+// outwards are drawn first and occlude the rest, clusters start where the
+// cache went cold so the cache efficiency is kept. From the same paper.
+void optimizeOverdraw(std::vector<uint32_t>& indices,
+                      std::span<const Vertex> vertices,
+                      uint32_t cacheSize = VertexCacheSize);
+// Renumbers vertices in the order the index buffer first uses them, so
+// vertex fetches walk memory forward. Unused vertices are dropped.
+void optimizeVertexFetch(Mesh& mesh);
+
+struct MeshOptimizationStatistics
+{
+    VertexCacheStatistics before;
+    VertexCacheStatistics after;
+    size_t verticesBefore = 0;
+    size_t verticesAfter = 0;
+};
+
+// Runs every step above in order. Triangles and their winding are kept, the
+// mesh renders the same.
+MeshOptimizationStatistics optimizeMesh(Mesh& mesh);
+
+} // namespace baldwin
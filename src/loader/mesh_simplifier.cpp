@@ -0,0 +1,374 @@
+#include "mesh_simplifier.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+#include <glm/geometric.hpp>
+
+#include "loader/mesh_optimizer.hpp"
+#include "renderer/bounds.hpp"
+#include "utils/hash.hpp"
+
+namespace baldwin
+{
+
+namespace
+{
+
+constexpr uint32_t Unassigned = UINT32_MAX;
+// Levels under this many triangles save too little to be worth it
+constexpr size_t MinLodTriangles = 32;
+// A level keeping more of the previous one is stuck on locked vertices or
+// on the error budget
+constexpr float MinLodReduction = 0.85f;
+// Error budget of the coarsest level, relative to the radius of the mesh
+constexpr float MaxLodError = 0.05f;
+// Collapses turning a triangle by more than about 75 degrees fold the
+// surface over
+constexpr float MinFlipCosine = 0.25f;
+
+// Sum of squared distances to planes, as the symmetric matrix A, vector b
+// and constant c of p.A.p + 2b.p + c, along with the total plane weight
+struct Quadric
+{
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    // Plane n.p + d = 0 with a unit normal
+    void addPlane(glm::vec3 n, float d, double w)
+    {
+        a00 += w * n.x * n.x;
+        a01 += w * n.x * n.y;
+        a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y;
+        a12 += w * n.y * n.z;
+        a22 += w * n.z * n.z;
+        b0 += w * n.x * d;
+        b1 += w * n.y * d;
+        b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    Quadric& operator+=(const Quadric& q)
+    {
+        a00 += q.a00;
+        a01 += q.a01;
+        a02 += q.a02;
+        a11 += q.a11;
+        a12 += q.a12;
+        a22 += q.a22;
+        b0 += q.b0;
+        b1 += q.b1;
+        b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+        return *this;
+    }
+
+    // Weighted mean of the squared distances to the planes
+    double meanError(glm::vec3 p) const
+    {
+        if (weight <= 0.0)
+            return 0.0;
+        double x = p.x, y = p.y, z = p.z;
+        double error = a00 * x * x + a11 * y * y + a22 * z * z +
+                       2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                       2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return std::max(error, 0.0) / weight;
+    }
+};
+
+// Vertices referenced by indices that share a position get the same id, so
+// the topology ignores attribute seams. wedgeCounts is the number of
+// vertices behind every id.
+std::vector<uint32_t> weldPositions(std::span<const uint32_t> indices,
+                                    std::span<const Vertex> vertices,
+                                    std::vector<uint32_t>& wedgeCounts)
+{
+    std::vector<uint32_t> positionIds(vertices.size(), Unassigned);
+    size_t capacity = 1;
+    while (capacity < vertices.size() * 2)
+        capacity <<= 1;
+    std::vector<uint32_t> table(capacity, Unassigned);
+    wedgeCounts.clear();
+
+    for (uint32_t v : indices)
+    {
+        if (positionIds[v] != Unassigned)
+            continue;
+        const glm::vec3& p = vertices[v].position;
+        size_t slot = fnv1a(&p, sizeof(glm::vec3)) & (capacity - 1);
+        while (table[slot] != Unassigned &&
+               std::memcmp(&vertices[table[slot]].position,
+                           &p,
+                           sizeof(glm::vec3)) != 0)
+        {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        if (table[slot] == Unassigned)
+        {
+            table[slot] = v;
+            positionIds[v] = static_cast<uint32_t>(wedgeCounts.size());
+            wedgeCounts.push_back(0);
+        }
+        positionIds[v] = positionIds[table[slot]];
+        wedgeCounts[positionIds[v]]++;
+    }
+    return positionIds;
+}
+
+struct Collapse
+{
+    uint32_t from; // vertex moved onto to
+    uint32_t to;
+    float error;
+};
+
+} // namespace
+
+float simplifyMesh(std::span<const uint32_t> indices,
+                   std::span<const Vertex> vertices, size_t targetIndexCount,
+                   float maxError, std::vector<uint32_t>& out)
+{
+    out.assign(indices.begin(), indices.end());
+    if (out.size() <= targetIndexCount)
+        return 0.0f;
+
+    std::vector<uint32_t> wedgeCounts;
+    std::vector<uint32_t> positionIds = weldPositions(out,
+                                                      vertices,
+                                                      wedgeCounts);
+    size_t positionCount = wedgeCounts.size();
+
+    // Seams and edges not shared by exactly two triangles lock their
+    // vertices, they can still be collapsed onto
+    std::vector<bool> locked(positionCount, false);
+    for (size_t p = 0; p < positionCount; p++)
+        locked[p] = wedgeCounts[p] > 1;
+    std::unordered_map<uint64_t, uint32_t> edgeUses;
+    edgeUses.reserve(out.size());
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        uint32_t a = positionIds[out[i]];
+        uint32_t b = positionIds[out[i - i % 3 + (i + 1) % 3]];
+        edgeUses[uint64_t(std::min(a, b)) << 32 | std::max(a, b)]++;
+    }
+    for (const auto& [edge, uses] : edgeUses)
+    {
+        if (uses != 2)
+        {
+            locked[edge >> 32] = true;
+            locked[edge & 0xffffffff] = true;
+        }
+    }
+
+    // Planes of the triangles around every position, weighted by area
+    std::vector<Quadric> quadrics(positionCount);
+    for (size_t t = 0; t < out.size() / 3; t++)
+    {
+        glm::vec3 a = vertices[out[t * 3]].position;
+        glm::vec3 b = vertices[out[t * 3 + 1]].position;
+        glm::vec3 c = vertices[out[t * 3 + 2]].position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+        normal /= length;
+        for (int k = 0; k < 3; k++)
+        {
+            quadrics[positionIds[out[t * 3 + k]]].addPlane(
+              normal, -glm::dot(normal, a), length * 0.5);
+        }
+    }
+
+    std::vector<uint32_t> remap(vertices.size());
+    std::iota(remap.begin(), remap.end(), 0);
+    std::vector<uint32_t> firstAdjacent;
+    std::vector<uint32_t> adjacency(out.size());
+    std::vector<uint32_t> cursor;
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched;
+    // Collapse errors are squared distances
+    float errorLimit = maxError * maxError;
+    float resultError = 0.0f;
+
+    // Every pass collapses the cheapest edges that do not share a
+    // neighbourhood, then the quadrics and edges are gathered again
+    while (out.size() > targetIndexCount)
+    {
+        firstAdjacent.assign(positionCount + 1, 0);
+        for (uint32_t v : out)
+            firstAdjacent[positionIds[v] + 1]++;
+        for (size_t p = 0; p < positionCount; p++)
+            firstAdjacent[p + 1] += firstAdjacent[p];
+        cursor.assign(firstAdjacent.begin(), firstAdjacent.end() - 1);
+        for (size_t i = 0; i < out.size(); i++)
+        {
+            adjacency[cursor[positionIds[out[i]]]++] =
+              static_cast<uint32_t>(i / 3);
+        }
+
+        // Cheapest direction of every edge, interior edges appear in both of
+        // their triangles and are kept from one
+        collapses.clear();
+        for (size_t i = 0; i < out.size(); i++)
+        {
+            uint32_t a = out[i];
+            uint32_t b = out[i - i % 3 + (i + 1) % 3];
+            if (positionIds[a] >= positionIds[b])
+                continue;
+
+            Collapse best{ Unassigned,
+                           Unassigned,
+                           std::numeric_limits<float>::max() };
+            for (auto [from, to] : { std::pair(a, b), std::pair(b, a) })
+            {
+                if (locked[positionIds[from]])
+                    continue;
+                Quadric merged = quadrics[positionIds[from]];
+                merged += quadrics[positionIds[to]];
+                float error = static_cast<float>(
+                  merged.meanError(vertices[to].position));
+                if (error < best.error)
+                    best = { from, to, error };
+            }
+            if (best.from != Unassigned)
+                collapses.push_back(best);
+        }
+        if (collapses.empty())
+            break;
+        std::sort(collapses.begin(),
+                  collapses.end(),
+                  [](const Collapse& a, const Collapse& b)
+                  {
+                      return a.error < b.error;
+                  });
+
+        size_t removeGoal = std::max<size_t>(
+          (out.size() - targetIndexCount) / 3, 1);
+        size_t removed = 0;
+        touched.assign(positionCount, false);
+        for (const Collapse& collapse : collapses)
+        {
+            if (removed >= removeGoal || collapse.error > errorLimit)
+                break;
+            uint32_t from = positionIds[collapse.from];
+            uint32_t to = positionIds[collapse.to];
+            if (touched[from] || touched[to])
+                continue;
+
+            // Triangles sharing the edge disappear, the others must not flip
+            glm::vec3 target = vertices[collapse.to].position;
+            size_t shared = 0;
+            bool flips = false;
+            for (uint32_t a = firstAdjacent[from];
+                 a < firstAdjacent[from + 1] && !flips;
+                 a++)
+            {
+                const uint32_t* triangle = &out[adjacency[a] * 3];
+                glm::vec3 p[3];
+                bool sharesEdge = false;
+                for (int k = 0; k < 3; k++)
+                {
+                    p[k] = vertices[triangle[k]].position;
+                    sharesEdge |= positionIds[triangle[k]] == to;
+                }
+                if (sharesEdge)
+                {
+                    shared++;
+                    continue;
+                }
+                glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                for (int k = 0; k < 3; k++)
+                {
+                    if (positionIds[triangle[k]] == from)
+                        p[k] = target;
+                }
+                glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                flips = glm::dot(before, after) <
+                        MinFlipCosine * glm::length(before) *
+                          glm::length(after);
+            }
+            if (flips)
+                continue;
+
+            remap[collapse.from] = collapse.to;
+            quadrics[to] += quadrics[from];
+            resultError = std::max(resultError, collapse.error);
+            removed += shared;
+            touched[to] = true;
+            for (uint32_t a = firstAdjacent[from];
+                 a < firstAdjacent[from + 1];
+                 a++)
+            {
+                for (int k = 0; k < 3; k++)
+                    touched[positionIds[out[adjacency[a] * 3 + k]]] = true;
+            }
+        }
+        if (removed == 0)
+            break;
+
+        // Moves the collapsed vertices and drops the triangles left without
+        // area, in their original order
+        size_t kept = 0;
+        for (size_t t = 0; t < out.size() / 3; t++)
+        {
+            uint32_t a = remap[out[t * 3]];
+            uint32_t b = remap[out[t * 3 + 1]];
+            uint32_t c = remap[out[t * 3 + 2]];
+            uint32_t pa = positionIds[a];
+            uint32_t pb = positionIds[b];
+            uint32_t pc = positionIds[c];
+            if (pa == pb || pb == pc || pa == pc)
+                continue;
+            out[kept++] = a;
+            out[kept++] = b;
+            out[kept++] = c;
+        }
+        out.resize(kept);
+    }
+    return std::sqrt(resultError);
+}
+
+size_t generateLods(Mesh& mesh, size_t maxLods)
+{
+    mesh.lods.clear();
+    const std::vector<uint32_t> source = mesh.indices;
+    mesh.lods.push_back(
+      { .indexCount = static_cast<uint32_t>(source.size()) });
+
+    float maxError = computeBounds(mesh.vertices).radius * MaxLodError;
+    std::vector<uint32_t> simplified;
+    while (mesh.lods.size() < maxLods)
+    {
+        MeshLod previous = mesh.lods.back();
+        size_t target = previous.indexCount / 6 * 3;
+        if (target < MinLodTriangles * 3)
+            break;
+
+        // Always from the full detail, so errors are measured against it
+        float error = simplifyMesh(
+          source, mesh.vertices, target, maxError, simplified);
+        if (simplified.size() > previous.indexCount * MinLodReduction)
+            break;
+        optimizeVertexCache(simplified, mesh.vertices.size());
+        mesh.lods.push_back(
+          { .firstIndex = static_cast<uint32_t>(mesh.indices.size()),
+            .indexCount = static_cast<uint32_t>(simplified.size()),
+            .error = std::max(error, previous.error) });
+        mesh.indices.insert(
+          mesh.indices.end(), simplified.begin(), simplified.end());
+    }
+
+    if (mesh.lods.size() == 1)
+        mesh.lods.clear();
+    return std::max<size_t>(mesh.lods.size(), 1);
+}
+
+} // namespace baldwin
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+#include "renderer/render_types.hpp"
+
+namespace baldwin
+{
+
+// Removes triangles by collapsing edges in order of their quadric error,
+// Surface Simplification Using Quadric Error Metrics, Garland and Heckbert
+// 1997. Vertices collapse onto one of their neighbours instead of a new
+// position, so out indexes the same vertices as indices. Vertices on open
+// borders and attribute seams never move, and no collapse moves the surface
+// further than maxError, so out can keep more than targetIndexCount indices.
+// Returns about how far in object space the result is from the input, the
+// largest RMS distance of a collapsed vertex to its original planes.
+float simplifyMesh(std::span<const uint32_t> indices,
+                   std::span<const Vertex> vertices, size_t targetIndexCount,
+                   float maxError, std::vector<uint32_t>& out);
+
+// Fills mesh.lods with up to maxLods levels, each with about half the
+// triangles of the previous one, and appends their indices to the mesh.
+// Stops early once the mesh no longer simplifies. Must run after anything
+// that rewrites the index buffer, like optimizeMesh. Returns the number of
+// levels, 1 when the mesh was left as is.
+size_t generateLods(Mesh& mesh, size_t maxLods = MaxMeshLods);
+
+} // namespace baldwin
@@ -0,0 +1,184 @@
+#include "meshlet_builder.hpp"
+
+#include <span>
+#include <array>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <glm/geometric.hpp>
+
+namespace baldwin
+{
+
+namespace
+{
+
+constexpr uint32_t Unassigned = UINT32_MAX;
+// Cones wider than about 84 degrees around their axis cull too rarely to be
+// worth testing
+constexpr float MinConeDot = 0.1f;
+
+Meshlet computeMeshletBounds(std::span<const uint32_t> indices,
+                             std::span<const Vertex> vertices)
+{
+    Meshlet meshlet{};
+
+    // Sphere around the box of the vertices
+    glm::vec3 aabbMin = vertices[indices[0]].position;
+    glm::vec3 aabbMax = aabbMin;
+    for (uint32_t v : indices)
+    {
+        aabbMin = glm::min(aabbMin, vertices[v].position);
+        aabbMax = glm::max(aabbMax, vertices[v].position);
+    }
+    meshlet.center = (aabbMin + aabbMax) * 0.5f;
+    for (uint32_t v : indices)
+    {
+        meshlet.radius = std::max(
+          meshlet.radius, glm::length(vertices[v].position - meshlet.center));
+    }
+
+    // Cone around the average of the triangle normals
+    std::array<glm::vec3, MaxMeshletTriangles> normals;
+    size_t normalCount = 0;
+    glm::vec3 axis{ 0.0f };
+    for (size_t t = 0; t < indices.size() / 3; t++)
+    {
+        glm::vec3 a = vertices[indices[t * 3]].position;
+        glm::vec3 b = vertices[indices[t * 3 + 1]].position;
+        glm::vec3 c = vertices[indices[t * 3 + 2]].position;
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float length = glm::length(normal);
+        if (length <= 0.0f)
+            continue;
+        normals[normalCount++] = normal / length;
+        axis += normal / length;
+    }
+    float axisLength = glm::length(axis);
+    if (axisLength <= 0.0f)
+        return meshlet;
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for (size_t n = 0; n < normalCount; n++)
+        minDot = std::min(minDot, glm::dot(normals[n], axis));
+    meshlet.coneAxis = axis;
+    if (minDot >= MinConeDot)
+        meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+    return meshlet;
+}
+
+} // namespace
+
+size_t buildMeshlets(Mesh& mesh)
+{
+    mesh.meshlets.clear();
+    size_t indexCount = mesh.lods.empty() ? mesh.indices.size()
+                                          : mesh.lods[0].indexCount;
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0)
+        return 0;
+    const std::vector<uint32_t> source(mesh.indices.begin(),
+                                       mesh.indices.begin() + indexCount);
+
+    // Triangles around every vertex, packed one vertex after the other
+    size_t vertexCount = mesh.vertices.size();
+    std::vector<uint32_t> firstAdjacent(vertexCount + 1, 0);
+    for (uint32_t index : source)
+        firstAdjacent[index + 1]++;
+    for (size_t v = 0; v < vertexCount; v++)
+        firstAdjacent[v + 1] += firstAdjacent[v];
+    std::vector<uint32_t> adjacency(indexCount);
+    std::vector<uint32_t> cursor(firstAdjacent.begin(),
+                                 firstAdjacent.end() - 1);
+    for (size_t i = 0; i < indexCount; i++)
+        adjacency[cursor[source[i]]++] = static_cast<uint32_t>(i / 3);
+
+    std::vector<bool> emitted(triangleCount, false);
+    // Last meshlet that used every vertex
+    std::vector<uint32_t> vertexMeshlet(vertexCount, Unassigned);
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(indexCount);
+    size_t scan = 0;
+
+    while (true)
+    {
+        // Every meshlet starts at the first triangle left in input order
+        while (scan < triangleCount && emitted[scan])
+            scan++;
+        if (scan == triangleCount)
+            break;
+
+        uint32_t meshletIndex = static_cast<uint32_t>(mesh.meshlets.size());
+        size_t firstIndex = output.size();
+        uint32_t meshletVertices = 0;
+        uint32_t meshletTriangles = 0;
+        candidates.assign(1, static_cast<uint32_t>(scan));
+        auto newVertices = [&](uint32_t triangle)
+        {
+            uint32_t count = 0;
+            for (int k = 0; k < 3; k++)
+            {
+                count += vertexMeshlet[source[triangle * 3 + k]] !=
+                         meshletIndex;
+            }
+            return count;
+        };
+
+        // Grows over the triangles around its vertices, those adding the
+        // fewest new vertices first
+        while (meshletTriangles < MaxMeshletTriangles)
+        {
+            size_t best = candidates.size();
+            uint32_t bestAdded = 4;
+            for (size_t c = 0; c < candidates.size() && bestAdded > 0; c++)
+            {
+                if (emitted[candidates[c]])
+                    continue;
+                uint32_t added = newVertices(candidates[c]);
+                if (meshletVertices + added <= MaxMeshletVertices &&
+                    added < bestAdded)
+                {
+                    best = c;
+                    bestAdded = added;
+                }
+            }
+            if (best == candidates.size())
+                break;
+
+            uint32_t triangle = candidates[best];
+            candidates[best] = candidates.back();
+            candidates.pop_back();
+            emitted[triangle] = true;
+            meshletTriangles++;
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t v = source[triangle * 3 + k];
+                output.push_back(v);
+                if (vertexMeshlet[v] == meshletIndex)
+                    continue;
+                vertexMeshlet[v] = meshletIndex;
+                meshletVertices++;
+                for (uint32_t a = firstAdjacent[v]; a < firstAdjacent[v + 1];
+                     a++)
+                {
+                    if (!emitted[adjacency[a]])
+                        candidates.push_back(adjacency[a]);
+                }
+            }
+        }
+
+        Meshlet meshlet = computeMeshletBounds(
+          std::span(output).subspan(firstIndex, meshletTriangles * 3),
+          mesh.vertices);
+        meshlet.firstIndex = static_cast<uint32_t>(firstIndex);
+        meshlet.triangleCount = meshletTriangles;
+        mesh.meshlets.push_back(meshlet);
+    }
+
+    std::copy(output.begin(), output.end(), mesh.indices.begin());
+    return mesh.meshlets.size();
+}
+
+} // namespace baldwin
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+
+#include "renderer/render_types.hpp"
+
+namespace baldwin
+{
+
+// Splits the full detail level of the mesh into meshlets of at most
+// MaxMeshletVertices vertices and MaxMeshletTriangles triangles, grown
+// greedily over shared vertices so they stay compact. The triangles of the
+// level are reordered so every meshlet is a contiguous range, coarser LODs
+// are left alone. Returns the number of meshlets.
+size_t buildMeshlets(Mesh& mesh);
+
+} // namespace baldwin
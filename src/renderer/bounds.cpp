@@ -0,0 +1,96 @@
+#include "bounds.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+namespace baldwin
+{
+
+Bounds computeBounds(std::span<const Vertex> vertices)
+{
+    Bounds bounds{};
+    if (vertices.empty())
+        return bounds;
+
+    bounds.aabbMin = vertices[0].position;
+    bounds.aabbMax = vertices[0].position;
+    for (const Vertex& v : vertices)
+    {
+        bounds.aabbMin = glm::min(bounds.aabbMin, v.position);
+        bounds.aabbMax = glm::max(bounds.aabbMax, v.position);
+    }
+
+    // Centering on the box is not the smallest sphere but it is close enough
+    // and keeps both volumes consistent
+    bounds.center = (bounds.aabbMin + bounds.aabbMax) * 0.5f;
+    float radiusSq = 0.0f;
+    for (const Vertex& v : vertices)
+    {
+        glm::vec3 d = v.position - bounds.center;
+        radiusSq = std::max(radiusSq, glm::dot(d, d));
+    }
+    bounds.radius = std::sqrt(radiusSq);
+
+    return bounds;
+}
+
+Bounds transformBounds(const Bounds& bounds, const glm::mat4& transform)
+{
+    // Arvo, every matrix element pushes the new box along one axis
+    Bounds result{};
+    for (int i = 0; i < 3; i++)
+    {
+        result.aabbMin[i] = transform[3][i];
+        result.aabbMax[i] = transform[3][i];
+        for (int j = 0; j < 3; j++)
+        {
+            float a = transform[j][i] * bounds.aabbMin[j];
+            float b = transform[j][i] * bounds.aabbMax[j];
+            result.aabbMin[i] += std::min(a, b);
+            result.aabbMax[i] += std::max(a, b);
+        }
+    }
+
+    glm::vec4 center = transform * glm::vec4(bounds.center, 1.0f);
+    result.center = glm::vec3(center.x, center.y, center.z);
+
+    float scale = 0.0f;
+    for (int j = 0; j < 3; j++)
+    {
+        glm::vec3 axis(transform[j][0], transform[j][1], transform[j][2]);
+        scale = std::max(scale, glm::dot(axis, axis));
+    }
+    result.radius = bounds.radius * std::sqrt(scale);
+
+    return result;
+}
+
+Frustum extractFrustum(const glm::mat4& viewproj)
+{
+    // Gribb / Hartmann, rows of the matrix combined. glm is column major so
+    // row i is (m[0][i], m[1][i], m[2][i], m[3][i]).
+    auto row = [&](int i)
+    {
+        return glm::vec4(
+          viewproj[0][i], viewproj[1][i], viewproj[2][i], viewproj[3][i]);
+    };
+
+    Frustum frustum{};
+    frustum.planes[0] = row(3) + row(0);
+    frustum.planes[1] = row(3) - row(0);
+    frustum.planes[2] = row(3) + row(1);
+    frustum.planes[3] = row(3) - row(1);
+    frustum.planes[4] = row(2);
+    frustum.planes[5] = row(3) - row(2);
+
+    for (glm::vec4& plane : frustum.planes)
+    {
+        float length = std::sqrt(plane.x * plane.x + plane.y * plane.y +
+                                 plane.z * plane.z);
+        plane = plane / length;
+    }
+
+    return frustum;
+}
+
+} // namespace baldwin
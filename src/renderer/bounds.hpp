@@ -0,0 +1,29 @@
+#pragma once
+
+#include <span>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "render_types.hpp"
+
+namespace baldwin
+{
+
+Bounds computeBounds(std::span<const Vertex> vertices);
+// Bounds of the transformed volume, the box stays axis aligned and the
+// radius grows with the largest scale axis
+Bounds transformBounds(const Bounds& bounds, const glm::mat4& transform);
+
+// Normalized planes pointing inwards, a point p is inside plane i when
+// dot(planes[i].xyz, p) + planes[i].w >= 0. Order is left, right, bottom,
+// top, near, far.
+struct Frustum
+{
+    glm::vec4 planes[6];
+};
+
+// Extracts the planes of a Vulkan style clip space (depth in [0, 1])
+Frustum extractFrustum(const glm::mat4& viewproj);
+
+} // namespace baldwin
@@ -0,0 +1,236 @@
+#include "culling.hpp"
+
+#include <bit>
+#include <cassert>
+#include <cfloat>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||           \
+  defined(_M_IX86)
+#define BALDWIN_CULL_X86
+#include <immintrin.h>
+#endif
+
+// The AVX loop is compiled for AVX on its own and only called after a
+// runtime check, the rest of the library keeps the baseline instruction set
+#if defined(__GNUC__) || defined(__clang__)
+#define BALDWIN_TARGET_AVX __attribute__((target("avx")))
+#else
+#define BALDWIN_TARGET_AVX
+#endif
+
+namespace baldwin
+{
+
+void SceneBounds::push(const Bounds& bounds)
+{
+    if (_count == radius.size())
+    {
+        // A -FLT_MAX radius fails every plane test, and unlike -inf it stays
+        // finite if a caller ever scales it
+        size_t padded = radius.size() + SceneBoundsWidth;
+        centerX.resize(padded, 0.0f);
+        centerY.resize(padded, 0.0f);
+        centerZ.resize(padded, 0.0f);
+        radius.resize(padded, -FLT_MAX);
+    }
+
+    centerX[_count] = bounds.center.x;
+    centerY[_count] = bounds.center.y;
+    centerZ[_count] = bounds.center.z;
+    radius[_count] = bounds.radius;
+    _count++;
+}
+
+void SceneBounds::set(size_t index, const Bounds& bounds)
+{
+    centerX[index] = bounds.center.x;
+    centerY[index] = bounds.center.y;
+    centerZ[index] = bounds.center.z;
+    radius[index] = bounds.radius;
+}
+
+void SceneBounds::swapRemove(size_t index)
+{
+    // The last slot becomes padding again
+    size_t last = _count - 1;
+    centerX[index] = centerX[last];
+    centerY[index] = centerY[last];
+    centerZ[index] = centerZ[last];
+    radius[index] = radius[last];
+    centerX[last] = 0.0f;
+    centerY[last] = 0.0f;
+    centerZ[last] = 0.0f;
+    radius[last] = -FLT_MAX;
+    _count--;
+}
+
+void SceneBounds::clear()
+{
+    centerX.clear();
+    centerY.clear();
+    centerZ.clear();
+    radius.clear();
+    _count = 0;
+}
+
+namespace
+{
+
+// Reference implementation, the SIMD versions must match it exactly
+size_t cullSpheresScalar(const Frustum& frustum, const SceneBounds& bounds,
+                         size_t first, size_t end, uint32_t* visible)
+{
+    size_t visibleCount = 0;
+    for (size_t i = first; i < end; i++)
+    {
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            float d = plane.x * bounds.centerX[i] +
+                      plane.y * bounds.centerY[i] +
+                      plane.z * bounds.centerZ[i] + plane.w;
+            inside = inside && d > -bounds.radius[i];
+        }
+        if (inside)
+            visible[visibleCount++] = static_cast<uint32_t>(i);
+    }
+    return visibleCount;
+}
+
+#ifdef BALDWIN_CULL_X86
+
+size_t cullSpheresSSE(const Frustum& frustum, const SceneBounds& bounds,
+                      size_t first, size_t end, uint32_t* visible)
+{
+    __m128 planes[6][4];
+    for (int p = 0; p < 6; p++)
+    {
+        for (int c = 0; c < 4; c++)
+            planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+    }
+
+    size_t visibleCount = 0;
+    for (size_t i = first; i < end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&bounds.centerX[i]);
+        __m128 y = _mm_loadu_ps(&bounds.centerY[i]);
+        __m128 z = _mm_loadu_ps(&bounds.centerZ[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(),
+                                      _mm_loadu_ps(&bounds.radius[i]));
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 d = _mm_add_ps(
+              _mm_add_ps(_mm_mul_ps(planes[p][0], x),
+                         _mm_mul_ps(planes[p][1], y)),
+              _mm_add_ps(_mm_mul_ps(planes[p][2], z), planes[p][3]));
+            inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negRadius));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        while (mask)
+        {
+            int lane = std::countr_zero(static_cast<unsigned>(mask));
+            mask &= mask - 1;
+            visible[visibleCount++] = static_cast<uint32_t>(i + lane);
+        }
+    }
+    return visibleCount;
+}
+
+BALDWIN_TARGET_AVX
+size_t cullSpheresAVX(const Frustum& frustum, const SceneBounds& bounds,
+                      size_t first, size_t end, uint32_t* visible)
+{
+    __m256 planes[6][4];
+    for (int p = 0; p < 6; p++)
+    {
+        for (int c = 0; c < 4; c++)
+            planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+    }
+
+    size_t visibleCount = 0;
+    for (size_t i = first; i < end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(&bounds.centerX[i]);
+        __m256 y = _mm256_loadu_ps(&bounds.centerY[i]);
+        __m256 z = _mm256_loadu_ps(&bounds.centerZ[i]);
+        __m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(),
+                                         _mm256_loadu_ps(&bounds.radius[i]));
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 d = _mm256_add_ps(
+              _mm256_add_ps(_mm256_mul_ps(planes[p][0], x),
+                            _mm256_mul_ps(planes[p][1], y)),
+              _mm256_add_ps(_mm256_mul_ps(planes[p][2], z), planes[p][3]));
+            inside = _mm256_and_ps(inside,
+                                   _mm256_cmp_ps(d, negRadius, _CMP_GT_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        while (mask)
+        {
+            int lane = std::countr_zero(static_cast<unsigned>(mask));
+            mask &= mask - 1;
+            visible[visibleCount++] = static_cast<uint32_t>(i + lane);
+        }
+    }
+    return visibleCount;
+}
+
+#endif
+
+} // namespace
+
+CullBackend bestCullBackend()
+{
+#if defined(BALDWIN_CULL_X86) && (defined(__GNUC__) || defined(__clang__))
+    static const CullBackend backend = __builtin_cpu_supports("avx")
+                                         ? CullBackend::AVX
+                                         : CullBackend::SSE;
+    return backend;
+#elif defined(BALDWIN_CULL_X86) && defined(__AVX__)
+    return CullBackend::AVX;
+#elif defined(BALDWIN_CULL_X86)
+    return CullBackend::SSE;
+#else
+    return CullBackend::Scalar;
+#endif
+}
+
+size_t cullSphereRange(const Frustum& frustum, const SceneBounds& bounds,
+                       size_t first, size_t count, uint32_t* visible,
+                       CullBackend backend)
+{
+    assert(first % SceneBoundsWidth == 0);
+    assert(count % SceneBoundsWidth == 0 || first + count == bounds.size());
+
+    size_t end = first + count;
+    switch (backend)
+    {
+#ifdef BALDWIN_CULL_X86
+        case CullBackend::AVX:
+            return cullSpheresAVX(frustum, bounds, first, end, visible);
+        case CullBackend::SSE:
+            return cullSpheresSSE(frustum, bounds, first, end, visible);
+#endif
+        default:
+            return cullSpheresScalar(frustum, bounds, first, end, visible);
+    }
+}
+
+size_t cullSpheres(const Frustum& frustum, const SceneBounds& bounds,
+                   std::vector<uint32_t>& visible, CullBackend backend)
+{
+    // SIMD loops write whole lanes, never more than the padded size
+    visible.resize(bounds.paddedSize());
+    size_t visibleCount = cullSphereRange(
+      frustum, bounds, 0, bounds.size(), visible.data(), backend);
+    visible.resize(visibleCount);
+    return visibleCount;
+}
+
+} // namespace baldwin
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "bounds.hpp"
+#include "render_types.hpp"
+
+namespace baldwin
+{
+
+// Bounding spheres in SoA layout, padded to a multiple of SceneBoundsWidth so
+// the SIMD loops never need a scalar tail. Padding spheres can never be
+// visible.
+constexpr size_t SceneBoundsWidth = 8;
+
+struct SceneBounds
+{
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+
+    void push(const Bounds& bounds);
+    void set(size_t index, const Bounds& bounds);
+    // Moves the last sphere into index
+    void swapRemove(size_t index);
+    void clear();
+    size_t size() const { return _count; }
+    size_t paddedSize() const { return radius.size(); }
+
+  private:
+    size_t _count = 0;
+};
+
+enum class CullBackend
+{
+    Scalar,
+    SSE, // 4 spheres per iteration
+    AVX, // 8 spheres per iteration
+};
+
+// Widest backend the CPU supports
+CullBackend bestCullBackend();
+
+// Writes the indices of the spheres intersecting the frustum to visible, in
+// increasing order, and returns how many there are. visible keeps its
+// capacity between calls so steady state culling does not allocate.
+size_t cullSpheres(const Frustum& frustum, const SceneBounds& bounds,
+                   std::vector<uint32_t>& visible,
+                   CullBackend backend = bestCullBackend());
+
+// Culls the spheres [first, first + count) only, to split a scene across
+// jobs. first must be a multiple of SceneBoundsWidth, and so must count
+// unless the range ends the scene. visible needs room for count rounded up
+// to SceneBoundsWidth entries.
+size_t cullSphereRange(const Frustum& frustum, const SceneBounds& bounds,
+                       size_t first, size_t count, uint32_t* visible,
+                       CullBackend backend = bestCullBackend());
+
+} // namespace baldwin
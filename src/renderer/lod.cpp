@@ -0,0 +1,44 @@
+#include "lod.hpp"
+
+#include <cmath>
+#include <glm/geometric.hpp>
+
+namespace baldwin
+{
+
+LodProjection makeLodProjection(const SceneData& scene, float viewportHeight)
+{
+    // The camera sits at -transpose(R) * t for a view matrix [R | t]
+    const glm::mat4& view = scene.view;
+    glm::vec3 translation(view[3]);
+    LodProjection projection;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        projection.cameraPosition[axis] = -glm::dot(glm::vec3(view[axis]),
+                                                    translation);
+    }
+    // proj[1][1] is the cotangent of half the vertical field of view, negated
+    // when y is flipped for Vulkan
+    projection.pixelsPerUnit = std::abs(scene.proj[1][1]) * viewportHeight *
+                               0.5f;
+    return projection;
+}
+
+uint32_t selectLod(std::span<const MeshLod> lods,
+                   const LodProjection& projection, glm::vec3 center,
+                   float radius, float scale, float maxErrorPixels)
+{
+    float distance = glm::length(center - projection.cameraPosition) - radius;
+    if (distance <= 0.0f)
+        return 0;
+
+    // Largest object space error that projects to maxErrorPixels
+    float maxError = maxErrorPixels * distance /
+                     (scale * projection.pixelsPerUnit);
+    uint32_t lod = 0;
+    while (lod + 1 < lods.size() && lods[lod + 1].error <= maxError)
+        lod++;
+    return lod;
+}
+
+} // namespace baldwin
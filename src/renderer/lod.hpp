@@ -0,0 +1,30 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <glm/vec3.hpp>
+
+#include "render_types.hpp"
+
+namespace baldwin
+{
+
+// Turns object space errors into pixels for a perspective camera
+struct LodProjection
+{
+    glm::vec3 cameraPosition{ 0.0f };
+    // Pixels covered by one unit seen from a distance of one
+    float pixelsPerUnit = 0.0f;
+};
+
+// The view matrix must be a rigid transform
+LodProjection makeLodProjection(const SceneData& scene, float viewportHeight);
+
+// Coarsest of lods whose error, scaled by scale and seen from the closest
+// point of the sphere, covers at most maxErrorPixels. Level 0 when the
+// camera is inside the sphere.
+uint32_t selectLod(std::span<const MeshLod> lods,
+                   const LodProjection& projection, glm::vec3 center,
+                   float radius, float scale, float maxErrorPixels);
+
+} // namespace baldwin
@@ -0,0 +1,134 @@
+#include "render_scene.hpp"
+
+#include <cfloat>
+#include <cassert>
+
+#include "bounds.hpp"
+
+namespace baldwin
+{
+
+uint32_t RenderScene::addMesh(const std::string& uuid, MeshHandle handle,
+                              const Bounds& bounds)
+{
+    auto [it, inserted] = _meshIndices.try_emplace(
+      uuid, static_cast<uint32_t>(meshHandles.size()));
+    if (inserted)
+    {
+        meshHandles.push_back(handle);
+        meshBounds.push_back(bounds);
+    }
+    return it->second;
+}
+
+InstanceHandle RenderScene::addInstance(uint32_t mesh,
+                                        const glm::mat4& transform,
+                                        uint8_t flags)
+{
+    uint32_t instance = static_cast<uint32_t>(instanceMeshes.size());
+    uint32_t slot;
+    if (!_freeSlots.empty())
+    {
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+        _slotInstances[slot] = instance;
+    }
+    else
+    {
+        slot = static_cast<uint32_t>(_slotInstances.size());
+        _slotInstances.push_back(instance);
+        _slotGenerations.push_back(0);
+    }
+
+    instanceMeshes.push_back(mesh);
+    instanceTransforms.push_back(transform);
+    instanceFlags.push_back(flags);
+    _instanceSlots.push_back(slot);
+    bounds.push({});
+    updateBounds(instance);
+    if (flags & InstanceHidden)
+        _hiddenCount++;
+    return { .slot = slot, .generation = _slotGenerations[slot] };
+}
+
+void RenderScene::removeInstance(InstanceHandle handle)
+{
+    assert(contains(handle));
+    uint32_t instance = _slotInstances[handle.slot];
+    uint32_t last = static_cast<uint32_t>(instanceMeshes.size() - 1);
+    if (instanceFlags[instance] & InstanceHidden)
+        _hiddenCount--;
+
+    instanceMeshes[instance] = instanceMeshes[last];
+    instanceTransforms[instance] = instanceTransforms[last];
+    instanceFlags[instance] = instanceFlags[last];
+    _instanceSlots[instance] = _instanceSlots[last];
+    _slotInstances[_instanceSlots[instance]] = instance;
+    bounds.swapRemove(instance);
+
+    instanceMeshes.pop_back();
+    instanceTransforms.pop_back();
+    instanceFlags.pop_back();
+    _instanceSlots.pop_back();
+    _slotGenerations[handle.slot]++;
+    _freeSlots.push_back(handle.slot);
+}
+
+bool RenderScene::contains(InstanceHandle handle) const
+{
+    return handle.slot < _slotGenerations.size() &&
+           _slotGenerations[handle.slot] == handle.generation;
+}
+
+uint32_t RenderScene::indexOf(InstanceHandle handle) const
+{
+    assert(contains(handle));
+    return _slotInstances[handle.slot];
+}
+
+void RenderScene::setTransform(uint32_t instance, const glm::mat4& transform)
+{
+    instanceTransforms[instance] = transform;
+    updateBounds(instance);
+}
+
+void RenderScene::setTransform(InstanceHandle handle,
+                               const glm::mat4& transform)
+{
+    setTransform(indexOf(handle), transform);
+}
+
+void RenderScene::setFlags(InstanceHandle handle, uint8_t flags)
+{
+    uint32_t instance = indexOf(handle);
+    if (instanceFlags[instance] & InstanceHidden)
+        _hiddenCount--;
+    if (flags & InstanceHidden)
+        _hiddenCount++;
+    instanceFlags[instance] = flags;
+    updateBounds(instance);
+}
+
+void RenderScene::updateBounds(uint32_t instance)
+{
+    Bounds world = transformBounds(meshBounds[instanceMeshes[instance]],
+                                   instanceTransforms[instance]);
+    // Fails every plane test, like the padding
+    if (instanceFlags[instance] & InstanceHidden)
+        world.radius = -FLT_MAX;
+    bounds.set(instance, world);
+}
+
+void RenderScene::extractTo(RenderScene& snapshot) const
+{
+    // The lookups are only needed to add and remove, snapshots never do
+    snapshot.meshHandles = meshHandles;
+    snapshot.meshBounds = meshBounds;
+    snapshot.instanceMeshes = instanceMeshes;
+    snapshot.instanceTransforms = instanceTransforms;
+    snapshot.instanceFlags = instanceFlags;
+    snapshot.bounds = bounds;
+    snapshot._hiddenCount = _hiddenCount;
+}
+
+} // namespace baldwin
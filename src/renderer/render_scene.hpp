@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <glm/mat4x4.hpp>
+
+#include "render_types.hpp"
+#include "culling.hpp"
+
+namespace baldwin
+{
+
+// Refers to an instance across removals of other instances. Slots are reused
+// once their instance is removed, the generation then no longer matches.
+struct InstanceHandle
+{
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    bool operator==(const InstanceHandle&) const = default;
+};
+
+enum InstanceFlags : uint8_t
+{
+    InstanceHidden = 1 << 0, // skipped by every culling path
+};
+
+// Everything the renderer draws. Meshes are referred to by their renderer
+// handle and placed in the world by any number of instances. Instance data
+// and bounds are kept in SoA and packed, removals move the last instance
+// into the hole, so culling and drawing walk them linearly.
+struct RenderScene
+{
+    // One entry per mesh
+    std::vector<MeshHandle> meshHandles;
+    std::vector<Bounds> meshBounds; // object space
+
+    // One entry per instance
+    std::vector<uint32_t> instanceMeshes;
+    std::vector<glm::mat4> instanceTransforms;
+    std::vector<uint8_t> instanceFlags;
+    // World space, hidden instances have a -FLT_MAX radius like the padding
+    SceneBounds bounds;
+
+    // Returns the index of the mesh, adding it if this is its first use
+    uint32_t addMesh(const std::string& uuid, MeshHandle handle,
+                     const Bounds& bounds);
+    InstanceHandle addInstance(uint32_t mesh, const glm::mat4& transform,
+                               uint8_t flags = 0);
+    void removeInstance(InstanceHandle instance);
+    bool contains(InstanceHandle instance) const;
+    // Position of the instance in the arrays above, until the next removal
+    uint32_t indexOf(InstanceHandle instance) const;
+
+    void setTransform(uint32_t instance, const glm::mat4& transform);
+    void setTransform(InstanceHandle instance, const glm::mat4& transform);
+    void setFlags(InstanceHandle instance, uint8_t flags);
+
+    // Copies what the renderer reads into snapshot, reusing its storage
+    void extractTo(RenderScene& snapshot) const;
+
+    size_t instanceCount() const { return instanceMeshes.size(); }
+    size_t hiddenCount() const { return _hiddenCount; }
+
+  private:
+    void updateBounds(uint32_t instance);
+
+    std::unordered_map<std::string, uint32_t> _meshIndices;
+    // Handle slot of every instance, and instance and generation of every
+    // slot. Free slots are reused last in, first out.
+    std::vector<uint32_t> _instanceSlots;
+    std::vector<uint32_t> _slotInstances;
+    std::vector<uint32_t> _slotGenerations;
+    std::vector<uint32_t> _freeSlots;
+    size_t _hiddenCount = 0;
+};
+
+} // namespace baldwin
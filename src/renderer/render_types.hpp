@@ -19,11 +19,82 @@ struct Vertex
     glm::vec4 color;
 };
 
+// How a mesh is stored on the GPU, meshes keep full precision vertices on
+// the CPU either way
+enum class VertexFormat : uint32_t
+{
+    Standard = 0, // Vertex as is, 48 bytes
+    Compact = 1,  // CompactVertex, 16 bytes
+};
+
+// Positions are quantized to 16 bits over the box of the mesh, normals are
+// octahedral encoded in two bytes, uvs are half floats and the color is
+// RGBA8. Decoded by loadVertex in vertex.glsl.
+struct CompactVertex
+{
+    uint16_t position[3];
+    int8_t normal[2];
+    uint16_t uv[2];
+    uint8_t color[4];
+};
+static_assert(sizeof(CompactVertex) == 16);
+
+// Object space bounds of a mesh, the sphere is centered on the box
+struct Bounds
+{
+    glm::vec3 aabbMin{ 0.0f };
+    glm::vec3 aabbMax{ 0.0f };
+    glm::vec3 center{ 0.0f };
+    float radius = 0.0f;
+};
+
+// A level of detail of a mesh, a range of its index buffer over the same
+// vertices. error is how far in object space the simplified surface can be
+// from the full detail one.
+struct MeshLod
+{
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    float error = 0.0f;
+};
+
+constexpr uint32_t MaxMeshLods = 8;
+
+// A cluster of neighbouring triangles of the full detail level, a range of
+// the index buffer culled on its own. Every triangle faces away from a
+// camera at p when dot(center - p, coneAxis) >= coneCutoff * length(center -
+// p) + radius, a cutoff of 1 never passes.
+struct Meshlet
+{
+    glm::vec3 center{ 0.0f };
+    float radius = 0.0f;
+    glm::vec3 coneAxis{ 0.0f };
+    float coneCutoff = 1.0f;
+    uint32_t firstIndex = 0;
+    uint32_t triangleCount = 0;
+};
+
+// What a mesh shader workgroup handles comfortably
+constexpr uint32_t MaxMeshletVertices = 64;
+constexpr uint32_t MaxMeshletTriangles = 124;
+
+// Index of an uploaded mesh in the renderer, stable for its whole lifetime
+using MeshHandle = uint32_t;
+constexpr MeshHandle InvalidMeshHandle = UINT32_MAX;
+
 struct Mesh
 {
     std::string uuid;
     std::vector<Vertex> vertices;
     std::vector<uint32_t> indices;
+    Bounds bounds{};
+    VertexFormat vertexFormat = VertexFormat::Standard;
+    // Empty when the mesh only has its full detail. Otherwise lods[0] covers
+    // the original indices and the coarser levels follow with increasing
+    // errors, their indices appended after it.
+    std::vector<MeshLod> lods;
+    // Empty unless built at import, they cover the full detail level
+    std::vector<Meshlet> meshlets;
 };
 
 struct SceneData
@@ -1,11 +1,16 @@
 #pragma once
 
 #include <deque>
+#include <span>
+#include <string>
+#include <vector>
 #include <memory>
+#include <cstdint>
 #include <functional>
 #include <GLFW/glfw3.h>
 
 #include "render_types.hpp"
+#include "render_scene.hpp"
 
 namespace baldwin
 {
@@ -27,14 +32,101 @@ struct DeletionQueue
         deletors.clear();
     }
 };
+struct RendererSettings
+{
+    bool tripleBuffering = false;
+    // Keeps mesh geometry in host visible memory instead of device local
+    // memory, vertex fetches then go over the bus. Only useful to measure.
+    bool hostVisibleGeometry = false;
+    // Sends the scene through a few vkCmdDrawIndexedIndirectCount calls,
+    // otherwise every mesh is recorded with its own vkCmdDrawIndexed
+    bool indirectDraw = true;
+    // Culls the indirect draws in a compute pass against the camera frustum,
+    // and against the depth of the previous frame with occlusionCulling
+    bool gpuCulling = true;
+    bool occlusionCulling = true;
+    // With gpuCulling, full detail instances of meshes split into meshlets
+    // are culled and drawn meshlet by meshlet. Cone culling drops meshlets
+    // facing away from the camera, which assumes closed meshes wound counter
+    // clockwise like glTF since both faces of triangles are drawn.
+    bool clusterCulling = true;
+    bool coneCulling = true;
+    // Frustum culls the scene bounds with SIMD before anything is recorded
+    bool cpuCulling = true;
+    // Direct draws are recorded into secondary command buffers across the
+    // job threads once a frame has more than this many of them
+    uint32_t parallelRecordThreshold = 1024;
+    // Caps the number of recording threads, 0 uses every job thread
+    unsigned int recordThreads = 0;
+    // Compiled pipelines are kept there between launches, empty disables it
+    std::string pipelineCachePath = "pipeline_cache.bin";
+    // No window, surface or swapchain, frames stay in the draw image and are
+    // read back with Renderer::readFrame. Runs on software implementations
+    // like lavapipe, for benchmarks and image tests.
+    bool headless = false;
+    // Bytes of transient GPU data each frame in flight can allocate
+    uint32_t frameAllocatorSize = 4 << 20;
+    // Meshes with LODs are drawn with their coarsest level whose error
+    // covers at most this many pixels, 0 always draws the full detail
+    float lodErrorPixels = 1.0f;
+};
+
+struct RenderStats
+{
+    uint32_t objects = 0;
+    uint32_t drawCalls = 0;
+    uint32_t cpuCulled = 0;
+    // Of the instances left after CPU culling, at their selected LOD
+    uint64_t triangles = 0;
+    // 0 when the frame was recorded on a single thread
+    uint32_t secondaryCommandBuffers = 0;
+    // CPU time blocked on the frame fence and the swapchain acquire
+    double waitMs = 0.0;
+    // GPU culling counters, read back once the frame retired so they lag
+    // behind by the number of frames in flight
+    uint32_t visible = 0;
+    uint32_t frustumCulled = 0;
+    uint32_t occlusionCulled = 0;
+    uint32_t clustersVisible = 0;
+    uint32_t clustersFrustumCulled = 0;
+    uint32_t clustersBackfaceCulled = 0;
+    uint32_t clustersOcclusionCulled = 0;
+    // Pipeline statistics of the culling and main passes, with the same lag,
+    // zero without BALDWIN_PROFILING or device support
+    uint64_t vertexInvocations = 0;
+    uint64_t clippingPrimitives = 0;
+    uint64_t fragmentInvocations = 0;
+};
+
+// RGBA8 pixels of a frame, rows tightly packed from the top
+struct FrameCapture
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<uint8_t> pixels;
+};
+
 class Renderer
 {
   public:
     virtual ~Renderer() {};
-    virtual void render(int frameNum,
-                        const std::vector<std::shared_ptr<Mesh>>& scene) = 0;
-    virtual void uploadMesh(const std::shared_ptr<Mesh> mesh) = 0;
+    virtual void render(int frameNum, const RenderScene& scene) = 0;
+    // Uploads return the handle scenes refer to the mesh by, the same one
+    // for every upload of a uuid. Meshes without geometry get
+    // InvalidMeshHandle.
+    virtual MeshHandle uploadMesh(const Mesh& mesh) = 0;
+    virtual MeshHandle uploadMeshData(const std::string& uuid,
+                                      std::span<const Vertex> vertices,
+                                      std::span<const uint32_t> indices,
+                                      VertexFormat format) = 0;
     virtual void resizeSwapchain(int width, int height) = 0;
+    // Blocks until every mesh uploaded so far can be drawn
+    virtual void waitForUploads() = 0;
+    // Numbers of the last recorded frame
+    virtual const RenderStats& stats() const = 0;
+    // Copies the last drawn frame back, empty before the first one. Stalls
+    // the GPU and must not run while a frame is recorded.
+    virtual FrameCapture readFrame() = 0;
 };
 
 } // namespace baldwin
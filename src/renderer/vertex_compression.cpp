@@ -0,0 +1,227 @@
+#include "vertex_compression.hpp"
+
+#include <bit>
+#include <cmath>
+#include <algorithm>
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+
+namespace baldwin
+{
+
+namespace
+{
+
+constexpr float PositionSteps = 65535.0f;
+constexpr float NormalSteps = 127.0f;
+
+// Round to nearest even, like the GPU conversions
+uint16_t floatToHalf(float value)
+{
+    uint32_t bits = std::bit_cast<uint32_t>(value);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t floatExponent = (bits >> 23) & 0xff;
+    int32_t exponent = static_cast<int32_t>(floatExponent) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if (floatExponent == 0xff) // infinity or NaN
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 31)
+        return sign | 0x7c00;
+    if (exponent <= 0)
+    {
+        // Subnormal half, or zero once too small
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return sign | half;
+    }
+
+    // A carry out of the mantissa correctly bumps the exponent
+    uint32_t half = (exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++;
+    return sign | half;
+}
+
+float halfToFloat(uint16_t half)
+{
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+
+    if (exponent == 0)
+    {
+        float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+    uint32_t bits = exponent == 31
+                      ? sign | 0x7f800000 | (mantissa << 13)
+                      : sign | ((exponent + 112) << 23) | (mantissa << 13);
+    return std::bit_cast<float>(bits);
+}
+
+int8_t toSnorm8(float value)
+{
+    return static_cast<int8_t>(
+      std::round(std::clamp(value, -1.0f, 1.0f) * NormalSteps));
+}
+
+uint8_t toUnorm8(float value)
+{
+    return static_cast<uint8_t>(
+      std::round(std::clamp(value, 0.0f, 1.0f) * 255.0f));
+}
+
+float signNotZero(float value) { return value >= 0.0f ? 1.0f : -1.0f; }
+
+// Folds the unit sphere onto an octahedron and unwraps it to a square,
+// A Survey of Efficient Representations for Independent Unit Vectors,
+// Cigolle et al. 2014
+void encodeNormal(glm::vec3 n, int8_t out[2])
+{
+    float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (length == 0.0f)
+    {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+    float x = n.x / length;
+    float y = n.y / length;
+    if (n.z < 0.0f)
+    {
+        float foldedX = (1.0f - std::abs(y)) * signNotZero(x);
+        float foldedY = (1.0f - std::abs(x)) * signNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
+    out[0] = toSnorm8(x);
+    out[1] = toSnorm8(y);
+}
+
+glm::vec3 decodeNormal(const int8_t in[2])
+{
+    float x = std::max(in[0] / NormalSteps, -1.0f);
+    float y = std::max(in[1] / NormalSteps, -1.0f);
+    glm::vec3 n{ x, y, 1.0f - std::abs(x) - std::abs(y) };
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+} // namespace
+
+PositionQuantization compressVertices(std::span<const Vertex> vertices,
+                                      std::vector<CompactVertex>& out)
+{
+    out.resize(vertices.size());
+    if (vertices.empty())
+        return {};
+
+    glm::vec3 aabbMin = vertices[0].position;
+    glm::vec3 aabbMax = vertices[0].position;
+    for (const Vertex& v : vertices)
+    {
+        aabbMin = glm::min(aabbMin, v.position);
+        aabbMax = glm::max(aabbMax, v.position);
+    }
+    PositionQuantization quantization{ .offset = aabbMin,
+                                       .scale = (aabbMax - aabbMin) /
+                                                PositionSteps };
+    // Flat axes quantize to 0
+    glm::vec3 inverseScale{ 0.0f };
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (quantization.scale[axis] > 0.0f)
+            inverseScale[axis] = 1.0f / quantization.scale[axis];
+    }
+
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const Vertex& v = vertices[i];
+        CompactVertex& c = out[i];
+        glm::vec3 q = (v.position - aabbMin) * inverseScale;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            c.position[axis] = static_cast<uint16_t>(
+              std::round(std::clamp(q[axis], 0.0f, PositionSteps)));
+        }
+        encodeNormal(v.normal, c.normal);
+        c.uv[0] = floatToHalf(v.uv_x);
+        c.uv[1] = floatToHalf(v.uv_y);
+        for (int channel = 0; channel < 4; channel++)
+            c.color[channel] = toUnorm8(v.color[channel]);
+    }
+    return quantization;
+}
+
+Vertex decompressVertex(const CompactVertex& vertex,
+                        const PositionQuantization& quantization)
+{
+    glm::vec3 q(vertex.position[0], vertex.position[1], vertex.position[2]);
+    return { .position = quantization.offset + q * quantization.scale,
+             .uv_x = halfToFloat(vertex.uv[0]),
+             .normal = decodeNormal(vertex.normal),
+             .uv_y = halfToFloat(vertex.uv[1]),
+             .color = glm::vec4(vertex.color[0],
+                                vertex.color[1],
+                                vertex.color[2],
+                                vertex.color[3]) /
+                      255.0f };
+}
+
+CompressionError measureCompression(std::span<const Vertex> vertices)
+{
+    CompressionError error{};
+    std::vector<CompactVertex> compact;
+    PositionQuantization quantization = compressVertices(vertices, compact);
+    float diagonal = glm::length(quantization.scale * PositionSteps);
+
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        const Vertex& v = vertices[i];
+        Vertex decoded = decompressVertex(compact[i], quantization);
+
+        if (diagonal > 0.0f)
+        {
+            error.position = std::max(
+              error.position,
+              glm::length(decoded.position - v.position) / diagonal);
+        }
+        float normalLength = glm::length(v.normal);
+        if (normalLength > 0.0f)
+        {
+            float cosine = std::clamp(
+              glm::dot(v.normal / normalLength, decoded.normal), -1.0f, 1.0f);
+            error.normalDegrees = std::max(
+              error.normalDegrees, glm::degrees(std::acos(cosine)));
+        }
+        error.uv = std::max({ error.uv,
+                              std::abs(decoded.uv_x - v.uv_x),
+                              std::abs(decoded.uv_y - v.uv_y) });
+        for (int channel = 0; channel < 4; channel++)
+        {
+            float expected = std::clamp(v.color[channel], 0.0f, 1.0f);
+            error.color = std::max(
+              error.color, std::abs(decoded.color[channel] - expected));
+        }
+    }
+    return error;
+}
+
+size_t vertexSize(VertexFormat format)
+{
+    return format == VertexFormat::Compact ? sizeof(CompactVertex)
+                                           : sizeof(Vertex);
+}
+
+} // namespace baldwin
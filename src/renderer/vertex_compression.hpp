@@ -0,0 +1,39 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <glm/vec3.hpp>
+
+#include "render_types.hpp"
+
+namespace baldwin
+{
+
+// Maps 16 bit positions back to object space,
+// position = offset + quantized * scale
+struct PositionQuantization
+{
+    glm::vec3 offset{ 0.0f };
+    glm::vec3 scale{ 0.0f };
+};
+
+// Replaces the content of out with the compact encoding of vertices
+PositionQuantization compressVertices(std::span<const Vertex> vertices,
+                                      std::vector<CompactVertex>& out);
+Vertex decompressVertex(const CompactVertex& vertex,
+                        const PositionQuantization& quantization);
+
+// Worst errors of the compact encoding over a mesh
+struct CompressionError
+{
+    float position = 0.0f; // relative to the diagonal of the mesh box
+    float normalDegrees = 0.0f;
+    float uv = 0.0f;
+    float color = 0.0f;
+};
+
+CompressionError measureCompression(std::span<const Vertex> vertices);
+
+size_t vertexSize(VertexFormat format);
+
+} // namespace baldwin
@@ -0,0 +1,245 @@
+#include "vulkan_bindless.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+#include "vulkan_descriptors.hpp"
+#include "vulkan_utils.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+namespace
+{
+
+// Upper bounds, lowered to the device limits
+constexpr uint32_t MaxStorageBuffers = 16384;
+constexpr uint32_t MaxSampledImages = 65536;
+constexpr uint32_t MaxSamplers = 256;
+// Per stage resources left to the other sets of a pipeline layout
+constexpr uint32_t ReservedStageResources = 64;
+
+} // namespace
+
+uint32_t BindlessHeap::SlotAllocator::allocate()
+{
+    if (!freeSlots.empty())
+    {
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    if (next == capacity)
+        return InvalidBindlessIndex;
+    return next++;
+}
+
+void BindlessHeap::SlotAllocator::free(uint32_t slot)
+{
+    assert(slot < next);
+    freeSlots.push_back(slot);
+}
+
+void BindlessHeap::init(VulkanDevice& device)
+{
+    _device = &device;
+
+    VkPhysicalDeviceDescriptorIndexingProperties limits = {
+        .sType =
+          VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES
+    };
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &limits,
+    };
+    vkGetPhysicalDeviceProperties2(device.physicalDevice(), &properties);
+
+    // Every binding is visible to each stage, so the per stage limits apply
+    // on top of the per set ones
+    _storageBuffers.capacity = std::min(
+      { MaxStorageBuffers,
+        limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+        limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+    _sampledImages.capacity = std::min(
+      { MaxSampledImages,
+        limits.maxDescriptorSetUpdateAfterBindSampledImages,
+        limits.maxPerStageDescriptorUpdateAfterBindSampledImages });
+    _samplers.capacity = std::min(
+      { MaxSamplers,
+        limits.maxDescriptorSetUpdateAfterBindSamplers,
+        limits.maxPerStageDescriptorUpdateAfterBindSamplers });
+
+    // Together they also have to fit the per stage resource limit, shrink
+    // them in proportion when they do not
+    uint64_t total = uint64_t(_storageBuffers.capacity) +
+                     _sampledImages.capacity + _samplers.capacity;
+    uint32_t stageResources = limits.maxPerStageUpdateAfterBindResources;
+    uint32_t budget = stageResources -
+                      std::min(ReservedStageResources, stageResources / 2);
+    if (total > budget)
+    {
+        for (SlotAllocator* slots :
+             { &_storageBuffers, &_sampledImages, &_samplers })
+        {
+            slots->capacity = std::max<uint32_t>(
+              1, slots->capacity * uint64_t(budget) / total);
+        }
+    }
+
+    DescriptorLayoutBuilder layoutBuilder;
+    layoutBuilder.addBinding(BindlessStorageBufferBinding,
+                             VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                             _storageBuffers.capacity);
+    layoutBuilder.addBinding(BindlessSampledImageBinding,
+                             VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                             _sampledImages.capacity);
+    layoutBuilder.addBinding(BindlessSamplerBinding,
+                             VK_DESCRIPTOR_TYPE_SAMPLER,
+                             _samplers.capacity);
+
+    // Unused slots are never accessed, written slots may change while bound
+    VkDescriptorBindingFlags flags =
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+    VkDescriptorBindingFlags bindingFlags[] = { flags, flags, flags };
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {
+        .sType =
+          VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = 3,
+        .pBindingFlags = bindingFlags
+    };
+    _layout = layoutBuilder.build(
+      device.handle(),
+      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT |
+        VK_SHADER_STAGE_COMPUTE_BIT,
+      &bindingFlagsInfo,
+      VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+
+    VkDescriptorPoolSize poolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, _storageBuffers.capacity },
+        { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, _sampledImages.capacity },
+        { VK_DESCRIPTOR_TYPE_SAMPLER, _samplers.capacity },
+    };
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+        .maxSets = 1,
+        .poolSizeCount = 3,
+        .pPoolSizes = poolSizes,
+    };
+    VK_CHECK(
+      vkCreateDescriptorPool(device.handle(), &poolInfo, nullptr, &_pool),
+      "Could not create bindless descriptor pool");
+
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_layout,
+    };
+    VK_CHECK(vkAllocateDescriptorSets(device.handle(), &allocInfo, &_set),
+             "Could not allocate bindless descriptor set");
+
+#ifndef NDEBUG
+    std::cout << "Bindless heap : " << _storageBuffers.capacity
+              << " buffers, " << _sampledImages.capacity << " images, "
+              << _samplers.capacity << " samplers\n";
+#endif
+}
+
+void BindlessHeap::queueWrite(uint32_t binding, uint32_t slot,
+                              VkDescriptorType type)
+{
+    VkWriteDescriptorSet write = {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _set,
+        .dstBinding = binding,
+        .dstArrayElement = slot,
+        .descriptorCount = 1,
+        .descriptorType = type,
+    };
+    if (type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER)
+        write.pBufferInfo = &_bufferInfos.back();
+    else
+        write.pImageInfo = &_imageInfos.back();
+    _writes.push_back(write);
+}
+
+uint32_t BindlessHeap::addStorageBuffer(const Buffer& buffer)
+{
+    uint32_t slot = _storageBuffers.allocate();
+    if (slot == InvalidBindlessIndex)
+        throw std::runtime_error("Bindless storage buffer slots exhausted");
+
+    _bufferInfos.push_back(
+      { .buffer = buffer.handle, .offset = 0, .range = VK_WHOLE_SIZE });
+    queueWrite(
+      BindlessStorageBufferBinding, slot, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    return slot;
+}
+
+uint32_t BindlessHeap::addSampledImage(VkImageView view, VkImageLayout layout)
+{
+    uint32_t slot = _sampledImages.allocate();
+    if (slot == InvalidBindlessIndex)
+        throw std::runtime_error("Bindless sampled image slots exhausted");
+
+    _imageInfos.push_back({ .imageView = view, .imageLayout = layout });
+    queueWrite(
+      BindlessSampledImageBinding, slot, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE);
+    return slot;
+}
+
+uint32_t BindlessHeap::addSampler(VkSampler sampler)
+{
+    uint32_t slot = _samplers.allocate();
+    if (slot == InvalidBindlessIndex)
+        throw std::runtime_error("Bindless sampler slots exhausted");
+
+    _imageInfos.push_back({ .sampler = sampler });
+    queueWrite(BindlessSamplerBinding, slot, VK_DESCRIPTOR_TYPE_SAMPLER);
+    return slot;
+}
+
+// Partially bound slots do not need to be cleared, shaders simply stop
+// indexing them
+void BindlessHeap::removeStorageBuffer(uint32_t index)
+{
+    _storageBuffers.free(index);
+}
+
+void BindlessHeap::removeSampledImage(uint32_t index)
+{
+    _sampledImages.free(index);
+}
+
+void BindlessHeap::removeSampler(uint32_t index) { _samplers.free(index); }
+
+void BindlessHeap::flush()
+{
+    if (_writes.empty())
+        return;
+
+    vkUpdateDescriptorSets(_device->handle(),
+                           static_cast<uint32_t>(_writes.size()),
+                           _writes.data(),
+                           0,
+                           nullptr);
+    _writes.clear();
+    _bufferInfos.clear();
+    _imageInfos.clear();
+}
+
+void BindlessHeap::destroy()
+{
+    // Frees the set along with the pool
+    vkDestroyDescriptorPool(_device->handle(), _pool, nullptr);
+    vkDestroyDescriptorSetLayout(_device->handle(), _layout, nullptr);
+}
+
+} // namespace vk
+} // namespace baldwin
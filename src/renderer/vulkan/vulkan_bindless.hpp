@@ -0,0 +1,81 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+#include "vulkan_device.hpp"
+#include "vulkan_types.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+// Bindings of the bindless set, mirrored in shaders/bindless.glsl
+constexpr uint32_t BindlessStorageBufferBinding = 0;
+constexpr uint32_t BindlessSampledImageBinding = 1;
+constexpr uint32_t BindlessSamplerBinding = 2;
+
+constexpr uint32_t InvalidBindlessIndex = UINT32_MAX;
+
+// One descriptor set holding large partially bound arrays of storage
+// buffers, sampled images and samplers, bound once and indexed from
+// shaders. Resources keep their slot until they are removed, and only the
+// slots that changed are written, in a single update per frame. The set is
+// update-after-bind, so slots can be written while frames using others are
+// in flight.
+class BindlessHeap
+{
+  public:
+    void init(VulkanDevice& device);
+    void destroy();
+
+    // Returned indices are stable. A slot must only be removed once the GPU
+    // is done with it, through the frame deletion queues.
+    uint32_t addStorageBuffer(const Buffer& buffer);
+    uint32_t addSampledImage(VkImageView view, VkImageLayout layout);
+    uint32_t addSampler(VkSampler sampler);
+    void removeStorageBuffer(uint32_t index);
+    void removeSampledImage(uint32_t index);
+    void removeSampler(uint32_t index);
+
+    // Writes the slots changed since the last call, does nothing otherwise
+    void flush();
+
+    VkDescriptorSetLayout layout() { return _layout; }
+    VkDescriptorSet set() { return _set; }
+
+  private:
+    // Slots of one binding, freed slots are handed out again first
+    struct SlotAllocator
+    {
+        uint32_t capacity = 0;
+        uint32_t next = 0;
+        std::vector<uint32_t> freeSlots;
+
+        uint32_t allocate();
+        void free(uint32_t slot);
+    };
+
+    void queueWrite(uint32_t binding, uint32_t slot, VkDescriptorType type);
+
+    VulkanDevice* _device = nullptr;
+    VkDescriptorPool _pool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout _layout = VK_NULL_HANDLE;
+    VkDescriptorSet _set = VK_NULL_HANDLE;
+
+    SlotAllocator _storageBuffers{};
+    SlotAllocator _sampledImages{};
+    SlotAllocator _samplers{};
+
+    // Pending writes, the infos live in deques so the writes can point at
+    // them
+    std::deque<VkDescriptorBufferInfo> _bufferInfos;
+    std::deque<VkDescriptorImageInfo> _imageInfos;
+    std::vector<VkWriteDescriptorSet> _writes;
+};
+
+} // namespace vk
+} // namespace baldwin
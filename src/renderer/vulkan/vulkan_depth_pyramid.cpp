@@ -0,0 +1,263 @@
+#include "vulkan_depth_pyramid.hpp"
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+
+#include "vulkan_images.hpp"
+#include "vulkan_infos.hpp"
+#include "vulkan_utils.hpp"
+#include "vulkan_descriptors.hpp"
+#include "renderer/shaders.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+namespace
+{
+
+struct DepthReducePushConstants
+{
+    int32_t srcWidth;
+    int32_t srcHeight;
+    int32_t dstWidth;
+    int32_t dstHeight;
+};
+
+uint32_t previousPow2(uint32_t value)
+{
+    uint32_t result = 1;
+    while (result * 2 <= value)
+        result *= 2;
+    return result;
+}
+
+} // namespace
+
+void DepthPyramid::init(VulkanDevice& device, const Image& depthImage)
+{
+    _device = &device;
+
+    // Power of two sizes make every reduction step exactly 2x2 texels
+    _extent = { previousPow2(depthImage.extent.width),
+                previousPow2(depthImage.extent.height) };
+    _image = device.createImage(
+      { _extent.width, _extent.height, 1 },
+      VK_FORMAT_R32_SFLOAT,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+      true);
+    _mipCount = static_cast<uint32_t>(std::floor(
+                  std::log2(std::max(_extent.width, _extent.height)))) +
+                1;
+
+    for (uint32_t mip = 0; mip < _mipCount; mip++)
+    {
+        VkImageViewCreateInfo viewInfo = getImageViewCreateInfo(
+          VK_FORMAT_R32_SFLOAT, _image.handle, VK_IMAGE_ASPECT_COLOR_BIT);
+        viewInfo.subresourceRange.baseMipLevel = mip;
+        VkImageView view;
+        VK_CHECK(vkCreateImageView(device.handle(), &viewInfo, nullptr, &view),
+                 "Could not create depth pyramid mip view");
+        _mipViews.push_back(view);
+    }
+
+    // Reductions fetch exact texels, the sampler only exists to bind them
+    VkSamplerCreateInfo samplerInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_NEAREST,
+        .minFilter = VK_FILTER_NEAREST,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .minLod = 0.0f,
+        .maxLod = VK_LOD_CLAMP_NONE,
+    };
+    VK_CHECK(
+      vkCreateSampler(device.handle(), &samplerInfo, nullptr, &_sampler),
+      "Could not create depth pyramid sampler");
+
+    // Descriptors, one reduce set per mip and a read set for the culling
+    DescriptorLayoutBuilder layoutBuilder;
+    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    layoutBuilder.addBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    _reduceLayout = layoutBuilder.build(device.handle(),
+                                        VK_SHADER_STAGE_COMPUTE_BIT);
+    layoutBuilder.clear();
+    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    _readLayout = layoutBuilder.build(device.handle(),
+                                      VK_SHADER_STAGE_COMPUTE_BIT);
+
+    VkDescriptorPoolSize poolSizes[] = {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, _mipCount + 1 },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, _mipCount },
+    };
+    VkDescriptorPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = _mipCount + 1,
+        .poolSizeCount = 2,
+        .pPoolSizes = poolSizes,
+    };
+    VK_CHECK(vkCreateDescriptorPool(
+               device.handle(), &poolInfo, nullptr, &_descriptorPool),
+             "Could not create depth pyramid descriptor pool");
+
+    std::vector<VkDescriptorSetLayout> layouts(_mipCount, _reduceLayout);
+    layouts.push_back(_readLayout);
+    std::vector<VkDescriptorSet> sets(layouts.size());
+    VkDescriptorSetAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = _descriptorPool,
+        .descriptorSetCount = static_cast<uint32_t>(layouts.size()),
+        .pSetLayouts = layouts.data(),
+    };
+    VK_CHECK(vkAllocateDescriptorSets(device.handle(), &allocInfo, sets.data()),
+             "Could not allocate depth pyramid descriptor sets");
+    _readSet = sets.back();
+    sets.pop_back();
+    _reduceSets = sets;
+
+    DescriptorWriter writer{};
+    writer.reserve(2, 0);
+    for (uint32_t mip = 0; mip < _mipCount; mip++)
+    {
+        writer.clear();
+        if (mip == 0)
+        {
+            writer.writeImage(0,
+                              depthImage.view,
+                              _sampler,
+                              VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                              VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        }
+        else
+        {
+            writer.writeImage(0,
+                              _mipViews[mip - 1],
+                              _sampler,
+                              VK_IMAGE_LAYOUT_GENERAL,
+                              VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        }
+        writer.writeImage(1,
+                          _mipViews[mip],
+                          VK_NULL_HANDLE,
+                          VK_IMAGE_LAYOUT_GENERAL,
+                          VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        writer.updateSet(device.handle(), _reduceSets[mip]);
+    }
+
+    writer.clear();
+    writer.writeImage(0,
+                      _image.view,
+                      _sampler,
+                      VK_IMAGE_LAYOUT_GENERAL,
+                      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    writer.updateSet(device.handle(), _readSet);
+
+    // Reduce pipeline
+    VkPushConstantRange range = { .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+                                  .offset = 0,
+                                  .size = sizeof(DepthReducePushConstants) };
+    VkPipelineLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &_reduceLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &range
+    };
+    VK_CHECK(vkCreatePipelineLayout(
+               device.handle(), &layoutInfo, nullptr, &_reducePipelineLayout),
+             "Could not create depth reduce pipeline layout");
+
+    auto code = readShaderFile("shaders/depth_reduce.comp.spv");
+    assert(!code.empty());
+    VkShaderModule module = device.createShaderModule(code);
+    VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = getPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT,
+                                                  module),
+        .layout = _reducePipelineLayout,
+    };
+    _reducePipeline = device.createComputePipeline(pipelineInfo);
+    device.destroyShaderModule(module);
+
+    // Culling binds the pyramid before the first one is built, give it a
+    // valid layout
+    device.immediateSubmit(
+      [&](VkCommandBuffer cmd)
+      {
+          createImageBarrierWithTransition(cmd,
+                                           _image.handle,
+                                           VK_IMAGE_LAYOUT_UNDEFINED,
+                                           VK_IMAGE_LAYOUT_GENERAL);
+      });
+}
+
+void DepthPyramid::destroy()
+{
+    VkDevice device = _device->handle();
+    vkDestroyPipeline(device, _reducePipeline, nullptr);
+    vkDestroyPipelineLayout(device, _reducePipelineLayout, nullptr);
+    vkDestroyDescriptorPool(device, _descriptorPool, nullptr);
+    vkDestroyDescriptorSetLayout(device, _readLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, _reduceLayout, nullptr);
+    vkDestroySampler(device, _sampler, nullptr);
+    for (VkImageView view : _mipViews)
+        vkDestroyImageView(device, view, nullptr);
+    _mipViews.clear();
+    _device->destroyImage(_image);
+}
+
+void DepthPyramid::build(VkCommandBuffer cmd, VkExtent2D srcExtent)
+{
+    // Every mip is rewritten, the previous content can go. This also waits
+    // for the culling of the previous frame to be done reading it.
+    createImageBarrierWithTransition(
+      cmd, _image.handle, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _reducePipeline);
+
+    VkExtent2D src = srcExtent;
+    VkExtent2D dst = _extent;
+    for (uint32_t mip = 0; mip < _mipCount; mip++)
+    {
+        vkCmdBindDescriptorSets(cmd,
+                                VK_PIPELINE_BIND_POINT_COMPUTE,
+                                _reducePipelineLayout,
+                                0,
+                                1,
+                                &_reduceSets[mip],
+                                0,
+                                nullptr);
+
+        DepthReducePushConstants pc = {
+            .srcWidth = static_cast<int32_t>(src.width),
+            .srcHeight = static_cast<int32_t>(src.height),
+            .dstWidth = static_cast<int32_t>(dst.width),
+            .dstHeight = static_cast<int32_t>(dst.height),
+        };
+        vkCmdPushConstants(cmd,
+                           _reducePipelineLayout,
+                           VK_SHADER_STAGE_COMPUTE_BIT,
+                           0,
+                           sizeof(DepthReducePushConstants),
+                           &pc);
+        vkCmdDispatch(cmd, (dst.width + 7) / 8, (dst.height + 7) / 8, 1);
+
+        // The next mip reads this one, the last barrier publishes the
+        // whole pyramid to the culling shader
+        createMemoryBarrier(cmd,
+                            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                            VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+
+        src = dst;
+        dst = { std::max(dst.width / 2, 1u), std::max(dst.height / 2, 1u) };
+    }
+}
+
+} // namespace vk
+} // namespace baldwin
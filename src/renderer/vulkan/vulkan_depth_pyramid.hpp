@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+#include "vulkan_device.hpp"
+#include "vulkan_types.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+// Hierarchical depth buffer used for occlusion culling. Every texel holds the
+// farthest depth of the area it covers, so an object whose nearest depth is
+// behind it is hidden. Mip 0 is a power of two below the depth image size.
+class DepthPyramid
+{
+  public:
+    void init(VulkanDevice& device, const Image& depthImage);
+    void destroy();
+
+    // Reduces the srcExtent area of the depth image, which must be in
+    // VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL. The pyramid is left in
+    // VK_IMAGE_LAYOUT_GENERAL and readable by compute shaders.
+    void build(VkCommandBuffer cmd, VkExtent2D srcExtent);
+
+    // Single combined image sampler over the whole mip chain
+    VkDescriptorSetLayout readLayout() { return _readLayout; }
+    VkDescriptorSet readSet() { return _readSet; }
+    VkExtent2D extent() { return _extent; }
+
+  private:
+    VulkanDevice* _device = nullptr;
+    Image _image{};
+    VkExtent2D _extent{};
+    uint32_t _mipCount = 0;
+    std::vector<VkImageView> _mipViews;
+    VkSampler _sampler = VK_NULL_HANDLE;
+
+    VkDescriptorPool _descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout _reduceLayout = VK_NULL_HANDLE;
+    VkDescriptorSetLayout _readLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> _reduceSets;
+    VkDescriptorSet _readSet = VK_NULL_HANDLE;
+    VkPipelineLayout _reducePipelineLayout = VK_NULL_HANDLE;
+    VkPipeline _reducePipeline = VK_NULL_HANDLE;
+};
+
+} // namespace vk
+} // namespace baldwin
@@ -1,6 +1,7 @@
 #include "vulkan_descriptors.hpp"
 
 #include "vulkan_utils.hpp"
+#include "utils/hash.hpp"
 #include <vulkan/vulkan_core.h>
 
 namespace baldwin
@@ -51,17 +52,16 @@ VkDescriptorSetLayout DescriptorLayoutBuilder::build(
 void DescriptorWriter::writeBuffer(int binding, VkBuffer buffer, size_t size,
                                    size_t offset, VkDescriptorType type)
 {
-    VkDescriptorBufferInfo& info = bufferInfos.emplace_back(
-      VkDescriptorBufferInfo{
-        .buffer = buffer, .offset = offset, .range = size });
+    bufferInfos.push_back(VkDescriptorBufferInfo{
+      .buffer = buffer, .offset = offset, .range = size });
 
+    // pBufferInfo is set in updateSet, the vector may still grow
     VkWriteDescriptorSet write = {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .dstSet = VK_NULL_HANDLE, // left empty for now until we need to
                                   // write it
         .descriptorCount = 1,
         .descriptorType = type,
-        .pBufferInfo = &info,
     };
     write.dstBinding = binding;
 
@@ -72,22 +72,29 @@ void DescriptorWriter::writeImage(int binding, VkImageView imageView,
                                   VkSampler sampler, VkImageLayout layout,
                                   VkDescriptorType type)
 {
-    VkDescriptorImageInfo& info = imageInfos.emplace_back(VkDescriptorImageInfo{
+    imageInfos.push_back(VkDescriptorImageInfo{
       .sampler = sampler, .imageView = imageView, .imageLayout = layout });
 
+    // pImageInfo is set in updateSet, the vector may still grow
     VkWriteDescriptorSet write = {
         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
         .dstSet = VK_NULL_HANDLE, // left empty for now until we need to
                                   // write it
         .descriptorCount = 1,
         .descriptorType = type,
-        .pImageInfo = &info,
     };
     write.dstBinding = binding;
 
     writes.push_back(write);
 }
 
+void DescriptorWriter::reserve(size_t imageCount, size_t bufferCount)
+{
+    imageInfos.reserve(imageCount);
+    bufferInfos.reserve(bufferCount);
+    writes.reserve(imageCount + bufferCount);
+}
+
 void DescriptorWriter::clear()
 {
     imageInfos.clear();
@@ -95,16 +102,76 @@ void DescriptorWriter::clear()
     writes.clear();
 }
 
+namespace
+{
+
+bool isBufferDescriptor(VkDescriptorType type)
+{
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER ||
+           type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+           type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC ||
+           type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+}
+
+template<typename T> uint64_t hashValue(const T& value, uint64_t seed)
+{
+    return fnv1a(&value, sizeof(value), seed);
+}
+
+} // namespace
+
 void DescriptorWriter::updateSet(VkDevice device, VkDescriptorSet set)
 {
+    // Infos were appended in the same order as their writes
+    size_t image = 0;
+    size_t buffer = 0;
     for (VkWriteDescriptorSet& write : writes)
     {
         write.dstSet = set;
+        if (isBufferDescriptor(write.descriptorType))
+            write.pBufferInfo = &bufferInfos[buffer++];
+        else
+            write.pImageInfo = &imageInfos[image++];
     }
     vkUpdateDescriptorSets(
       device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
 }
 
+bool DescriptorWriter::updateSet(VkDevice device, TrackedDescriptorSet& set)
+{
+    uint64_t contentHash = hash();
+    if (contentHash == set.contentHash)
+        return false;
+
+    updateSet(device, set.set);
+    set.contentHash = contentHash;
+    return true;
+}
+
+uint64_t DescriptorWriter::hash() const
+{
+    // Field by field, the info structs have padding
+    uint64_t hash = FNV1aSeed;
+    for (const VkWriteDescriptorSet& write : writes)
+    {
+        hash = hashValue(write.dstBinding, hash);
+        hash = hashValue(write.descriptorType, hash);
+    }
+    for (const VkDescriptorImageInfo& info : imageInfos)
+    {
+        hash = hashValue(info.sampler, hash);
+        hash = hashValue(info.imageView, hash);
+        hash = hashValue(info.imageLayout, hash);
+    }
+    for (const VkDescriptorBufferInfo& info : bufferInfos)
+    {
+        hash = hashValue(info.buffer, hash);
+        hash = hashValue(info.offset, hash);
+        hash = hashValue(info.range, hash);
+    }
+    return hash;
+}
+
 // === Growable Descriptor Allocator ===
 void DescriptorManager::init(VkDevice device, uint32_t maxSets,
                              std::span<PoolSizeRatio> poolRatios)
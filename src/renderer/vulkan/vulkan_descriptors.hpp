@@ -1,8 +1,8 @@
 #pragma once
 
-#include <deque>
 #include <vector>
 #include <span>
+#include <cstdint>
 #include <vulkan/vulkan.h>
 
 namespace baldwin
@@ -23,10 +23,20 @@ struct DescriptorLayoutBuilder
                                 VkDescriptorSetLayoutCreateFlags flags = 0);
 };
 
+// A set along with the hash of what was last written to it
+struct TrackedDescriptorSet
+{
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    uint64_t contentHash = 0;
+};
+
+// Infos are stored in vectors and only pointed at in updateSet, so a writer
+// kept around and cleared between uses stops allocating once it reached its
+// largest size
 struct DescriptorWriter
 {
-    std::deque<VkDescriptorImageInfo> imageInfos;
-    std::deque<VkDescriptorBufferInfo> bufferInfos;
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    std::vector<VkDescriptorBufferInfo> bufferInfos;
     std::vector<VkWriteDescriptorSet> writes;
 
     void writeImage(int binding, VkImageView image, VkSampler sampler,
@@ -34,8 +44,14 @@ struct DescriptorWriter
     void writeBuffer(int binding, VkBuffer buffer, size_t size, size_t offset,
                      VkDescriptorType type);
 
+    void reserve(size_t imageCount, size_t bufferCount);
+    // Keeps the capacity
     void clear();
     void updateSet(VkDevice device, VkDescriptorSet set);
+    // Skips the update when the set already holds the same descriptors,
+    // returns whether it was written
+    bool updateSet(VkDevice device, TrackedDescriptorSet& set);
+    uint64_t hash() const;
 };
 
 struct DescriptorManager
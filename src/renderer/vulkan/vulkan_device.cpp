@@ -1,6 +1,7 @@
 #include "vulkan_device.hpp"
 
 #include <cmath>
+#include <chrono>
 #include <iostream>
 #include <VkBootstrap.h>
 #include <vulkan/vulkan_core.h>
@@ -13,11 +14,33 @@ namespace baldwin
 namespace vk
 {
 
-VulkanDevice::VulkanDevice(GLFWwindow* window)
+namespace
 {
-    uint32_t extensionCount;
-    const char** extensions = glfwGetRequiredInstanceExtensions(
-      &extensionCount);
+
+// Same output as the vk-bootstrap default messenger, on stderr so stdout
+// stays usable for reports
+VkBool32 debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+                       VkDebugUtilsMessageTypeFlagsEXT type,
+                       const VkDebugUtilsMessengerCallbackDataEXT* data,
+                       void*)
+{
+    std::cerr << '[' << vkb::to_string_message_severity(severity) << ": "
+              << vkb::to_string_message_type(type) << "]\n"
+              << data->pMessage << '\n';
+    return VK_FALSE;
+}
+
+} // namespace
+
+VulkanDevice::VulkanDevice(GLFWwindow* window,
+                           const std::filesystem::path& pipelineCachePath)
+{
+    // Headless without a window, no surface extensions are needed then
+    bool headless = window == nullptr;
+    uint32_t extensionCount = 0;
+    const char** extensions = nullptr;
+    if (!headless)
+        extensions = glfwGetRequiredInstanceExtensions(&extensionCount);
 #ifndef NDEBUG
     std::cout << "Required Vulkan Instance Extensions : \n";
     for (int i = 0; i < extensionCount; i++)
@@ -30,10 +53,11 @@ VulkanDevice::VulkanDevice(GLFWwindow* window)
     vkb::InstanceBuilder builder;
     builder.set_app_name("Baldwin Engine Application")
       .request_validation_layers()
-      .use_default_debug_messenger()
-      .require_api_version(1, 3, 0);
+      .set_debug_callback(debugCallback)
+      .require_api_version(1, 3, 0)
+      .set_headless(headless);
 
-    if (_enableValidationLayers)
+    if (_enableValidationLayers && extensionCount > 0)
     {
         builder.enable_extensions(extensionCount, extensions);
     }
@@ -42,7 +66,8 @@ VulkanDevice::VulkanDevice(GLFWwindow* window)
     _debugMessenger = vkbInst.debug_messenger;
 
     // Surface
-    glfwCreateWindowSurface(_instance, window, nullptr, &_surface);
+    if (!headless)
+        glfwCreateWindowSurface(_instance, window, nullptr, &_surface);
 
     // Physical and logical devices
     VkPhysicalDeviceVulkan13Features features13 = {
@@ -57,15 +82,46 @@ VulkanDevice::VulkanDevice(GLFWwindow* window)
     features12.bufferDeviceAddress = true;
     features12.descriptorIndexing = true;
     features12.descriptorBindingUniformBufferUpdateAfterBind = true;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = true;
+    features12.descriptorBindingSampledImageUpdateAfterBind = true;
+    features12.descriptorBindingPartiallyBound = true;
+    features12.runtimeDescriptorArray = true;
+    features12.shaderSampledImageArrayNonUniformIndexing = true;
+    features12.shaderStorageBufferArrayNonUniformIndexing = true;
+    features12.timelineSemaphore = true;
+    features12.drawIndirectCount = true;
+
+    VkPhysicalDeviceVulkan11Features features11 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES
+    };
+    features11.shaderDrawParameters = true;
+
+    VkPhysicalDeviceFeatures features = {};
+    features.multiDrawIndirect = true;
+    features.drawIndirectFirstInstance = true;
 
     vkb::PhysicalDeviceSelector selector{ vkbInst };
     vkb::PhysicalDevice physicalDevice = selector.set_minimum_version(1, 3)
                                            .set_required_features_13(features13)
                                            .set_required_features_12(features12)
+                                           .set_required_features_11(features11)
+                                           .set_required_features(features)
                                            .set_surface(_surface)
                                            .select()
                                            .value();
-    std::cout << "Selected GPU :" << physicalDevice.name << std::endl;
+    std::cerr << "Selected GPU :" << physicalDevice.name << std::endl;
+
+    // Optional, only the profiler uses it
+    VkPhysicalDeviceFeatures optionalFeatures = {};
+    optionalFeatures.pipelineStatisticsQuery = true;
+    _pipelineStatistics = physicalDevice.enable_features_if_present(
+      optionalFeatures);
+    // Lets secondary command buffers run while the statistics are queried
+    VkPhysicalDeviceFeatures inheritedFeatures = {};
+    inheritedFeatures.inheritedQueries = true;
+    _inheritedQueries = physicalDevice.enable_features_if_present(
+      inheritedFeatures);
+
     vkb::DeviceBuilder deviceBuilder{ physicalDevice };
     vkb::Device vkbDevice = deviceBuilder.build().value();
 
@@ -76,9 +132,40 @@ VulkanDevice::VulkanDevice(GLFWwindow* window)
     _queueFamilies
       .graphics = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
     _graphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
-    _queueFamilies.present = vkbDevice.get_queue_index(vkb::QueueType::present)
-                               .value();
-    _presentQueue = vkbDevice.get_queue(vkb::QueueType::present).value();
+    if (headless)
+    {
+        // Nothing is presented, keeps the queue accessors valid
+        _queueFamilies.present = _queueFamilies.graphics;
+        _presentQueue = _graphicsQueue;
+    }
+    else
+    {
+        _queueFamilies.present = vkbDevice
+                                   .get_queue_index(vkb::QueueType::present)
+                                   .value();
+        _presentQueue = vkbDevice.get_queue(vkb::QueueType::present).value();
+    }
+
+    // Prefer a transfer only queue for uploads so copies run alongside
+    // graphics work, fall back to the graphics queue otherwise
+    auto transferIndex = vkbDevice.get_dedicated_queue_index(
+      vkb::QueueType::transfer);
+    if (transferIndex.has_value())
+    {
+        _queueFamilies.transfer = transferIndex.value();
+        _transferQueue = vkbDevice
+                           .get_dedicated_queue(vkb::QueueType::transfer)
+                           .value();
+    }
+    else
+    {
+        _queueFamilies.transfer = _queueFamilies.graphics;
+        _transferQueue = _graphicsQueue;
+    }
+#ifndef NDEBUG
+    std::cout << "Transfer queue family : " << _queueFamilies.transfer
+              << std::endl;
+#endif
 
     // Allocator
     VmaAllocatorCreateInfo allocatorInfo = {
@@ -90,7 +177,30 @@ VulkanDevice::VulkanDevice(GLFWwindow* window)
     VK_CHECK(vmaCreateAllocator(&allocatorInfo, &_allocator),
              "Could not create VMA Allocator");
 
+    // A host visible device local heap bigger than the legacy 256MiB BAR
+    // window means the whole VRAM is mappable
+    const VkPhysicalDeviceMemoryProperties* memoryProperties;
+    vmaGetMemoryProperties(_allocator, &memoryProperties);
+    constexpr VkMemoryPropertyFlags
+      barFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++)
+    {
+        const VkMemoryType& type = memoryProperties->memoryTypes[i];
+        if ((type.propertyFlags & barFlags) == barFlags &&
+            memoryProperties->memoryHeaps[type.heapIndex].size >
+              256ull * 1024 * 1024)
+        {
+            _resizableBar = true;
+        }
+    }
+#ifndef NDEBUG
+    std::cout << "Resizable BAR : " << (_resizableBar ? "yes" : "no")
+              << std::endl;
+#endif
+
     initImmediate();
+    _pipelineCache.init(_device, _gpu, pipelineCachePath);
 }
 
 void VulkanDevice::initImmediate()
@@ -210,17 +320,64 @@ void VulkanDevice::destroyImage(Image& image)
 }
 
 Buffer VulkanDevice::createBuffer(size_t size, VkBufferUsageFlags usageFlags,
-                                  VmaMemoryUsage memoryUsage)
+                                  MemoryPlacement placement,
+                                  bool sharedWithTransfer)
 {
     VkBufferCreateInfo bufferInfo = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size = size,
         .usage = usageFlags,
     };
-    VmaAllocationCreateInfo allocInfo = {
-        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
-        .usage = memoryUsage,
-    };
+
+    uint32_t families[] = { _queueFamilies.graphics, _queueFamilies.transfer };
+    if (sharedWithTransfer && families[0] != families[1])
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = families;
+    }
+    // Mapped placements stay coherent so writes never need a flush
+    constexpr VkMemoryPropertyFlags
+      mappedFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VmaAllocationCreateInfo allocInfo = {};
+    switch (placement)
+    {
+        case MemoryPlacement::GpuOnly:
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+            break;
+        case MemoryPlacement::Upload:
+            allocInfo.flags =
+              VMA_ALLOCATION_CREATE_MAPPED_BIT |
+              VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+            allocInfo.requiredFlags = mappedFlags;
+            break;
+        case MemoryPlacement::Readback:
+            allocInfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT |
+                              VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT;
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+            allocInfo.requiredFlags = mappedFlags;
+            allocInfo.preferredFlags = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            break;
+        case MemoryPlacement::DeviceUpload:
+            allocInfo.flags =
+              VMA_ALLOCATION_CREATE_MAPPED_BIT |
+              VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+            allocInfo.requiredFlags = mappedFlags;
+            // A legacy BAR is too small for every per frame buffer to
+            // compete for it, they stay in host memory then
+            if (_resizableBar)
+            {
+                allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+                allocInfo.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            }
+            else
+            {
+                allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+            }
+            break;
+    }
 
     Buffer newBuffer = {};
     VK_CHECK(vmaCreateBuffer(_allocator,
@@ -230,6 +387,8 @@ Buffer VulkanDevice::createBuffer(size_t size, VkBufferUsageFlags usageFlags,
                              &newBuffer.allocation,
                              &newBuffer.allocationInfo),
              "Could not create buffer");
+    vmaGetAllocationMemoryProperties(
+      _allocator, newBuffer.allocation, &newBuffer.memoryFlags);
 
     return newBuffer;
 }
@@ -239,6 +398,15 @@ void VulkanDevice::destroyBuffer(Buffer& buffer)
     vmaDestroyBuffer(_allocator, buffer.handle, buffer.allocation);
 }
 
+VkDeviceAddress VulkanDevice::getBufferAddress(const Buffer& buffer)
+{
+    VkBufferDeviceAddressInfo addressInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .buffer = buffer.handle
+    };
+    return vkGetBufferDeviceAddress(_device, &addressInfo);
+}
+
 VkShaderModule VulkanDevice::createShaderModule(const std::vector<char>& code)
 {
     VkShaderModule module;
@@ -258,18 +426,73 @@ void VulkanDevice::destroyShaderModule(VkShaderModule& module)
     vkDestroyShaderModule(_device, module, nullptr);
 }
 
+VkPipeline VulkanDevice::createGraphicsPipeline(
+  VkGraphicsPipelineCreateInfo info)
+{
+    // Tells whether the driver found the pipeline in the cache
+    VkPipelineCreationFeedback feedback = {};
+    VkPipelineCreationFeedbackCreateInfo feedbackInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+        .pNext = info.pNext,
+        .pPipelineCreationFeedback = &feedback,
+    };
+    info.pNext = &feedbackInfo;
+
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateGraphicsPipelines(
+               _device, _pipelineCache.handle(), 1, &info, nullptr, &pipeline),
+             "Failed to create graphics pipeline");
+    _pipelineCache.record(
+      feedback,
+      std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start)
+        .count());
+
+    return pipeline;
+}
+
+VkPipeline VulkanDevice::createComputePipeline(
+  VkComputePipelineCreateInfo info)
+{
+    VkPipelineCreationFeedback feedback = {};
+    VkPipelineCreationFeedbackCreateInfo feedbackInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO,
+        .pNext = info.pNext,
+        .pPipelineCreationFeedback = &feedback,
+    };
+    info.pNext = &feedbackInfo;
+
+    auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VK_CHECK(vkCreateComputePipelines(
+               _device, _pipelineCache.handle(), 1, &info, nullptr, &pipeline),
+             "Failed to create compute pipeline");
+    _pipelineCache.record(
+      feedback,
+      std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start)
+        .count());
+
+    return pipeline;
+}
+
 VulkanDevice::~VulkanDevice()
 {
 #ifndef NDEBUG
     std::cout << "-- VulkanDevice cleanup\n";
 #endif
 
+    _pipelineCache.save();
+    _pipelineCache.destroy();
+
     vkDestroyFence(_device, _immediateFence, nullptr);
     vkFreeCommandBuffers(
       _device, _immediateCommandPool, 1, &_immediateCommandBuffer);
     vkDestroyCommandPool(_device, _immediateCommandPool, nullptr);
     vmaDestroyAllocator(_allocator);
-    vkDestroySurfaceKHR(_instance, _surface, nullptr);
+    if (_surface != VK_NULL_HANDLE)
+        vkDestroySurfaceKHR(_instance, _surface, nullptr);
     vkDestroyDevice(_device, nullptr);
     vkb::destroy_debug_utils_messenger(_instance, _debugMessenger);
     vkDestroyInstance(_instance, nullptr);
@@ -3,12 +3,14 @@
 #include <cstdint>
 #include <vector>
 #include <functional>
+#include <filesystem>
 #include <vk_mem_alloc.h>
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan_core.h>
 
 #include "vulkan_types.hpp"
+#include "vulkan_pipeline_cache.hpp"
 
 namespace baldwin
 {
@@ -19,6 +21,7 @@ struct QueueFamilies
 {
     uint32_t graphics;
     uint32_t present;
+    uint32_t transfer; // same as graphics without a dedicated transfer queue
 };
 
 class VulkanDevice
@@ -30,7 +33,11 @@ class VulkanDevice
     const bool _enableValidationLayers = false;
 #endif
 
-    VulkanDevice(GLFWwindow* window);
+    // Pipelines are cached at pipelineCachePath across launches, an empty
+    // path keeps the cache in memory. Without a window the device is
+    // headless, it has no surface and presents nothing.
+    VulkanDevice(GLFWwindow* window,
+                 const std::filesystem::path& pipelineCachePath = {});
     ~VulkanDevice();
 
     VulkanDevice(const VulkanDevice&) = delete;
@@ -42,18 +49,32 @@ class VulkanDevice
     VkDevice handle() { return _device; };
     VkPhysicalDevice physicalDevice() { return _gpu; };
     VkSurfaceKHR surface() { return _surface; }
+    bool headless() { return _surface == VK_NULL_HANDLE; }
     VkQueue graphicsQueue() { return _graphicsQueue; }
     VkQueue presentQueue() { return _presentQueue; }
+    VkQueue transferQueue() { return _transferQueue; }
     QueueFamilies queueFamilies() { return _queueFamilies; };
+    // True when a large device local heap is host visible (ReBAR / SAM)
+    bool hasResizableBar() { return _resizableBar; }
+    bool hasPipelineStatistics() { return _pipelineStatistics; }
+    bool hasInheritedQueries() { return _inheritedQueries; }
 
     Image createImage(VkExtent3D size, VkFormat format, VkImageUsageFlags usage,
                       bool mipmapped = false);
     void destroyImage(Image& image);
+    // Buffers filled by the upload manager must be shared with the transfer
+    // queue family, which makes them concurrent if it is a separate family
     Buffer createBuffer(size_t size, VkBufferUsageFlags usageFlags,
-                        VmaMemoryUsage memoryUsage);
+                        MemoryPlacement placement,
+                        bool sharedWithTransfer = false);
     void destroyBuffer(Buffer& buffer);
+    VkDeviceAddress getBufferAddress(const Buffer& buffer);
     VkShaderModule createShaderModule(const std::vector<char>& code);
     void destroyShaderModule(VkShaderModule& module);
+    // Every pipeline is created through these, against the pipeline cache
+    VkPipeline createGraphicsPipeline(VkGraphicsPipelineCreateInfo info);
+    VkPipeline createComputePipeline(VkComputePipelineCreateInfo info);
+    PipelineCacheStats pipelineCacheStats() { return _pipelineCache.stats(); }
 
     void immediateSubmit(std::function<void(VkCommandBuffer cmd)>&& function);
 
@@ -65,12 +86,17 @@ class VulkanDevice
     VkSurfaceKHR _surface = VK_NULL_HANDLE;
     VkQueue _graphicsQueue = VK_NULL_HANDLE;
     VkQueue _presentQueue = VK_NULL_HANDLE;
+    VkQueue _transferQueue = VK_NULL_HANDLE;
     QueueFamilies _queueFamilies = {};
     VkDebugUtilsMessengerEXT _debugMessenger = VK_NULL_HANDLE;
     VmaAllocator _allocator = VK_NULL_HANDLE;
+    bool _resizableBar = false;
+    bool _pipelineStatistics = false;
+    bool _inheritedQueries = false;
     VkCommandPool _immediateCommandPool = VK_NULL_HANDLE;
     VkCommandBuffer _immediateCommandBuffer = VK_NULL_HANDLE;
     VkFence _immediateFence = VK_NULL_HANDLE;
+    PipelineCache _pipelineCache{};
 };
 
 } // namespace vk
@@ -0,0 +1,78 @@
+#include "vulkan_frame_allocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <format>
+#include <stdexcept>
+
+namespace baldwin
+{
+namespace vk
+{
+
+namespace
+{
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+} // namespace
+
+void FrameAllocator::init(VulkanDevice& device, uint32_t frameCount,
+                          VkDeviceSize frameSize)
+{
+    _device = &device;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device.physicalDevice(), &properties);
+    const VkPhysicalDeviceLimits& limits = properties.limits;
+    _minAlignment = std::max(limits.minUniformBufferOffsetAlignment,
+                             limits.minStorageBufferOffsetAlignment);
+
+    // Regions start aligned so offsets inside them are too
+    _frameSize = alignUp(frameSize, _minAlignment);
+    _buffer = device.createBuffer(
+      _frameSize * frameCount,
+      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+      MemoryPlacement::DeviceUpload);
+    _address = device.getBufferAddress(_buffer);
+    _frameBegin = 0;
+    _cursor = 0;
+}
+
+void FrameAllocator::beginFrame(uint32_t frame)
+{
+    _frameBegin = frame * _frameSize;
+    _cursor = _frameBegin;
+}
+
+FrameAllocation FrameAllocator::allocate(VkDeviceSize size,
+                                         VkDeviceSize alignment)
+{
+    assert(alignment == 0 || (alignment & (alignment - 1)) == 0);
+    VkDeviceSize offset = alignUp(_cursor, std::max(alignment, _minAlignment));
+    if (offset + size > _frameBegin + _frameSize)
+        throw std::runtime_error(
+          std::format("Frame allocator out of space, {} of {} bytes used",
+                      _cursor - _frameBegin,
+                      _frameSize));
+    _cursor = offset + size;
+
+    char* mapped = static_cast<char*>(_buffer.allocationInfo.pMappedData);
+    return { .data = mapped + offset,
+             .offset = offset,
+             .address = _address + offset };
+}
+
+void FrameAllocator::destroy()
+{
+    _device->destroyBuffer(_buffer);
+    _buffer = {};
+}
+
+} // namespace vk
+} // namespace baldwin
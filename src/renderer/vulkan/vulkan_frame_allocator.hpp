@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+#include "vulkan_device.hpp"
+#include "vulkan_types.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+struct FrameAllocation
+{
+    void* data = nullptr;
+    VkDeviceSize offset = 0; // from the start of the allocator buffer
+    VkDeviceAddress address = 0;
+};
+
+// Linear allocator for the data a frame throws away once it retired :
+// scene uniforms, per draw constants, dynamic vertices. One mapped buffer is
+// split in a region per frame in flight, a frame only writes its own region
+// and rewinds it once its fence signaled, so the CPU never overwrites what
+// the GPU may still read. Uniforms are bound with dynamic offsets, so the
+// descriptors are written once.
+class FrameAllocator
+{
+  public:
+    void init(VulkanDevice& device, uint32_t frameCount,
+              VkDeviceSize frameSize);
+    void destroy();
+
+    // Only once the fence of the frame signaled, drops its allocations
+    void beginFrame(uint32_t frame);
+
+    // Render thread only. Offsets are aligned for uniform and storage use.
+    FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+    template<typename T> FrameAllocation push(const T& value)
+    {
+        FrameAllocation allocation = allocate(sizeof(T), alignof(T));
+        *static_cast<T*>(allocation.data) = value;
+        return allocation;
+    }
+
+    const Buffer& buffer() const { return _buffer; }
+    VkDeviceSize frameSize() const { return _frameSize; }
+    // Bytes used by the current frame
+    VkDeviceSize used() const { return _cursor - _frameBegin; }
+
+  private:
+    VulkanDevice* _device = nullptr;
+    Buffer _buffer{};
+    VkDeviceAddress _address = 0;
+    VkDeviceSize _frameSize = 0;
+    VkDeviceSize _minAlignment = 1;
+
+    VkDeviceSize _frameBegin = 0;
+    VkDeviceSize _cursor = 0;
+};
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,107 @@
+#include "vulkan_geometry_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "renderer/render_types.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+void GeometryPool::init(VulkanDevice& device, MemoryPlacement placement,
+                        uint32_t blockVertexCount, uint32_t blockIndexCount)
+{
+    _device = &device;
+    _placement = placement;
+    _blockVertexCount = blockVertexCount;
+    _blockIndexCount = blockIndexCount;
+}
+
+void GeometryPool::destroy()
+{
+    for (GeometryBlock& block : _blocks)
+    {
+        _device->destroyBuffer(block.vertexBuffer);
+        _device->destroyBuffer(block.indexBuffer);
+    }
+    _blocks.clear();
+}
+
+GeometryRange GeometryPool::allocate(uint32_t vertexCount,
+                                     uint32_t indexCount)
+{
+    assert(vertexCount > 0 && indexCount > 0);
+
+    for (uint32_t i = 0; i < _blocks.size(); i++)
+    {
+        GeometryBlock& block = _blocks[i];
+        if (block.vertices.largestFreeRange() < vertexCount ||
+            block.indices.largestFreeRange() < indexCount)
+        {
+            continue;
+        }
+
+        uint64_t vertexOffset = block.vertices.allocate(vertexCount);
+        uint64_t firstIndex = block.indices.allocate(indexCount);
+        assert(vertexOffset != OffsetAllocator::InvalidOffset &&
+               firstIndex != OffsetAllocator::InvalidOffset);
+
+        return { .block = i,
+                 .firstIndex = static_cast<uint32_t>(firstIndex),
+                 .indexCount = indexCount,
+                 .vertexOffset = static_cast<int32_t>(vertexOffset),
+                 .vertexCount = vertexCount };
+    }
+
+    // No room left anywhere
+    uint32_t i = createBlock(std::max(vertexCount, _blockVertexCount),
+                             std::max(indexCount, _blockIndexCount));
+    GeometryBlock& block = _blocks[i];
+    return { .block = i,
+             .firstIndex = static_cast<uint32_t>(
+               block.indices.allocate(indexCount)),
+             .indexCount = indexCount,
+             .vertexOffset = static_cast<int32_t>(
+               block.vertices.allocate(vertexCount)),
+             .vertexCount = vertexCount };
+}
+
+void GeometryPool::free(const GeometryRange& range)
+{
+    GeometryBlock& block = _blocks[range.block];
+    block.vertices.free(range.vertexOffset, range.vertexCount);
+    block.indices.free(range.firstIndex, range.indexCount);
+}
+
+uint32_t GeometryPool::createBlock(uint32_t vertexCount, uint32_t indexCount)
+{
+    GeometryBlock block;
+    block.vertexBuffer = _device->createBuffer(
+      static_cast<size_t>(vertexCount) * sizeof(Vertex),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+        VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+      _placement,
+      true);
+    block.indexBuffer = _device->createBuffer(
+      static_cast<size_t>(indexCount) * sizeof(uint32_t),
+      VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      _placement,
+      true);
+
+    VkBufferDeviceAddressInfo deviceAdressInfo = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+        .buffer = block.vertexBuffer.handle
+    };
+    block.vertexBufferAddress = vkGetBufferDeviceAddress(_device->handle(),
+                                                         &deviceAdressInfo);
+    block.vertices.reset(vertexCount);
+    block.indices.reset(indexCount);
+
+    _blocks.push_back(std::move(block));
+    return static_cast<uint32_t>(_blocks.size() - 1);
+}
+
+} // namespace vk
+} // namespace baldwin
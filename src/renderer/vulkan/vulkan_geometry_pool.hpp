@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+#include "utils/offset_allocator.hpp"
+#include "vulkan_device.hpp"
+#include "vulkan_types.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+// A pair of large vertex and index buffers meshes are carved out of
+struct GeometryBlock
+{
+    Buffer vertexBuffer{};
+    Buffer indexBuffer{};
+    VkDeviceAddress vertexBufferAddress = 0;
+    OffsetAllocator vertices;
+    OffsetAllocator indices;
+};
+
+// Sub-allocates mesh geometry out of a handful of big buffers, so meshes
+// don't cost two allocations each and draws sharing a block share the same
+// index buffer binding. Blocks are created on demand, and a mesh too big
+// for the default block size gets a block of its own.
+class GeometryPool
+{
+  public:
+    void init(VulkanDevice& device, MemoryPlacement placement,
+              uint32_t blockVertexCount = 1 << 20,
+              uint32_t blockIndexCount = 1 << 22);
+    void destroy();
+
+    GeometryRange allocate(uint32_t vertexCount, uint32_t indexCount);
+    void free(const GeometryRange& range);
+
+    const GeometryBlock& block(uint32_t index) const { return _blocks[index]; }
+    size_t blockCount() const { return _blocks.size(); }
+
+  private:
+    uint32_t createBlock(uint32_t vertexCount, uint32_t indexCount);
+
+    VulkanDevice* _device = nullptr;
+    MemoryPlacement _placement = MemoryPlacement::GpuOnly;
+    uint32_t _blockVertexCount = 0;
+    uint32_t _blockIndexCount = 0;
+    std::vector<GeometryBlock> _blocks;
+};
+
+} // namespace vk
+} // namespace baldwin
@@ -66,10 +66,11 @@ void createImageBarrierWithTransition(VkCommandBuffer cmd, VkImage image,
         .image = image
     };
 
-    VkImageAspectFlags aspectMask = (newLayout ==
-                                     VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
-                                      ? VK_IMAGE_ASPECT_DEPTH_BIT
-                                      : VK_IMAGE_ASPECT_COLOR_BIT;
+    bool depth = currentLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ||
+                 newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ||
+                 newLayout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+    VkImageAspectFlags aspectMask = depth ? VK_IMAGE_ASPECT_DEPTH_BIT
+                                          : VK_IMAGE_ASPECT_COLOR_BIT;
     imageBarrier.subresourceRange = getImageSubresourceRange(aspectMask);
 
     VkDependencyInfo depInfo = {
@@ -81,6 +82,28 @@ void createImageBarrierWithTransition(VkCommandBuffer cmd, VkImage image,
     vkCmdPipelineBarrier2(cmd, &depInfo);
 }
 
+void createMemoryBarrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStage,
+                         VkAccessFlags2 srcAccess,
+                         VkPipelineStageFlags2 dstStage,
+                         VkAccessFlags2 dstAccess)
+{
+    VkMemoryBarrier2 memoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2,
+        .srcStageMask = srcStage,
+        .srcAccessMask = srcAccess,
+        .dstStageMask = dstStage,
+        .dstAccessMask = dstAccess,
+    };
+
+    VkDependencyInfo depInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .memoryBarrierCount = 1,
+        .pMemoryBarriers = &memoryBarrier,
+    };
+
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
 void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destination,
                       VkExtent2D srcSize, VkExtent2D dstSize)
 {
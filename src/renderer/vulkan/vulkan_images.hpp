@@ -13,6 +13,10 @@ void createImageBarrier(VkCommandBuffer cmd, VkImage image,
 void createImageBarrierWithTransition(VkCommandBuffer cmd, VkImage image,
                                       VkImageLayout currentLayout,
                                       VkImageLayout newLayout);
+void createMemoryBarrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStage,
+                         VkAccessFlags2 srcAccess,
+                         VkPipelineStageFlags2 dstStage,
+                         VkAccessFlags2 dstAccess);
 void copyImageToImage(VkCommandBuffer cmd, VkImage source, VkImage destination,
                       VkExtent2D srcSize, VkExtent2D dstSize);
 
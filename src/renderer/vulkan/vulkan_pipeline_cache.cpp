@@ -0,0 +1,184 @@
+#include "vulkan_pipeline_cache.hpp"
+
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "vulkan_utils.hpp"
+#include "utils/hash.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+namespace
+{
+
+PipelineCacheFileHeader makeHeader(const VkPhysicalDeviceProperties& gpu)
+{
+    PipelineCacheFileHeader header = {
+        .magic = PipelineCacheMagic,
+        .version = PipelineCacheVersion,
+        .vendorID = gpu.vendorID,
+        .deviceID = gpu.deviceID,
+        .driverVersion = gpu.driverVersion,
+    };
+    memcpy(header.pipelineCacheUUID, gpu.pipelineCacheUUID, VK_UUID_SIZE);
+    return header;
+}
+
+// Returns the driver blob of the file if it was written by this GPU and
+// driver, an empty vector otherwise
+std::vector<char> readCacheFile(const std::filesystem::path& path,
+                                const VkPhysicalDeviceProperties& gpu)
+{
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+    if (!file.is_open())
+        return {};
+
+    size_t fileSize = file.tellg();
+    if (fileSize < sizeof(PipelineCacheFileHeader))
+        return {};
+
+    PipelineCacheFileHeader header;
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+    PipelineCacheFileHeader expected = makeHeader(gpu);
+    if (header.magic != expected.magic ||
+        header.version != expected.version ||
+        header.vendorID != expected.vendorID ||
+        header.deviceID != expected.deviceID ||
+        header.driverVersion != expected.driverVersion ||
+        memcmp(header.pipelineCacheUUID,
+               expected.pipelineCacheUUID,
+               VK_UUID_SIZE) != 0)
+    {
+        std::cerr << std::format("Pipeline cache {} belongs to another "
+                                 "device or driver\n",
+                                 path.string());
+        return {};
+    }
+    if (header.dataSize != fileSize - sizeof(PipelineCacheFileHeader))
+        return {};
+
+    std::vector<char> data(header.dataSize);
+    file.read(data.data(), data.size());
+    if (!file || fnv1a(data.data(), data.size()) != header.dataHash)
+    {
+        std::cerr << std::format("Pipeline cache {} is corrupted\n",
+                                 path.string());
+        return {};
+    }
+    return data;
+}
+
+} // namespace
+
+void PipelineCache::init(VkDevice device, VkPhysicalDevice gpu,
+                         const std::filesystem::path& path)
+{
+    _device = device;
+    _path = path;
+    vkGetPhysicalDeviceProperties(gpu, &_properties);
+
+    std::vector<char> data;
+    if (!_path.empty())
+        data = readCacheFile(_path, _properties);
+
+    VkPipelineCacheCreateInfo cacheInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = data.size(),
+        .pInitialData = data.empty() ? nullptr : data.data(),
+    };
+    VK_CHECK(vkCreatePipelineCache(_device, &cacheInfo, nullptr, &_cache),
+             "Could not create pipeline cache");
+
+#ifndef NDEBUG
+    std::cout << std::format("Pipeline cache : {} bytes loaded\n",
+                             data.size());
+#endif
+}
+
+void PipelineCache::record(const VkPipelineCreationFeedback& feedback,
+                           double elapsedMs)
+{
+    constexpr VkPipelineCreationFeedbackFlags hitFlags =
+      VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT |
+      VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT;
+    std::lock_guard lock(_statsMutex);
+    if ((feedback.flags & hitFlags) == hitFlags)
+        _stats.hits++;
+    else
+        _stats.misses++;
+    _stats.creationMs += elapsedMs;
+}
+
+PipelineCacheStats PipelineCache::stats() const
+{
+    std::lock_guard lock(_statsMutex);
+    return _stats;
+}
+
+void PipelineCache::save()
+{
+    // Everything came from the file, it is already up to date
+    if (_path.empty() || _stats.misses == 0)
+        return;
+
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(_device, _cache, &size, nullptr),
+             "Could not get pipeline cache size");
+    std::vector<char> data(size);
+    VK_CHECK(vkGetPipelineCacheData(_device, _cache, &size, data.data()),
+             "Could not get pipeline cache data");
+    data.resize(size);
+
+    PipelineCacheFileHeader header = makeHeader(_properties);
+    header.dataSize = data.size();
+    header.dataHash = fnv1a(data.data(), data.size());
+
+    // Same swap as the mesh cache, a crash mid write leaves the old file
+    std::filesystem::path tmpPath = _path;
+    tmpPath += ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << "Could not write pipeline cache " << tmpPath.string()
+                      << '\n';
+            return;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(data.data(), data.size());
+        file.close();
+        if (!file)
+        {
+            std::error_code ec;
+            std::filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmpPath, _path, ec);
+}
+
+void PipelineCache::destroy()
+{
+#ifndef NDEBUG
+    std::cout << std::format("Pipeline cache : {} hits, {} misses, {:.2f} ms "
+                             "creating pipelines\n",
+                             _stats.hits,
+                             _stats.misses,
+                             _stats.creationMs);
+#endif
+    vkDestroyPipelineCache(_device, _cache, nullptr);
+    _cache = VK_NULL_HANDLE;
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <mutex>
+#include <cstdint>
+#include <filesystem>
+#include <vulkan/vulkan.h>
+
+namespace baldwin
+{
+namespace vk
+{
+
+// On disk layout : [PipelineCacheFileHeader][driver cache blob]
+// The driver blob is only handed back to the driver that wrote it, so the
+// header records the GPU and driver it came from along with a hash of the
+// blob to catch truncated or corrupted files.
+constexpr uint32_t PipelineCacheMagic = 0x43504c42; // "BLPC"
+constexpr uint32_t PipelineCacheVersion = 1;
+
+struct PipelineCacheFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+struct PipelineCacheStats
+{
+    // Pipelines the driver found in the cache, as reported by the creation
+    // feedback. Drivers that do not report it count everything as a miss.
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    // Total time spent creating pipelines
+    double creationMs = 0.0;
+};
+
+// VkPipelineCache persisted between launches. Every pipeline of the device
+// is created against it, see VulkanDevice::createGraphicsPipeline.
+class PipelineCache
+{
+  public:
+    // An empty path keeps the cache in memory only. A missing, stale or
+    // corrupted file is not an error, the cache then starts empty.
+    void init(VkDevice device, VkPhysicalDevice gpu,
+              const std::filesystem::path& path);
+    // Writes the cache back if anything was added since it was loaded
+    void save();
+    void destroy();
+
+    VkPipelineCache handle() const { return _cache; }
+    PipelineCacheStats stats() const;
+    // Accounts for one pipeline created with creation feedback, pipelines
+    // may be built from several threads
+    void record(const VkPipelineCreationFeedback& feedback, double elapsedMs);
+
+  private:
+    VkDevice _device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties _properties{};
+    std::filesystem::path _path;
+    VkPipelineCache _cache = VK_NULL_HANDLE;
+    mutable std::mutex _statsMutex;
+    PipelineCacheStats _stats{};
+};
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,128 @@
+#include "vulkan_pipeline_registry.hpp"
+
+#include <cassert>
+
+#include "renderer/shaders.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+void PipelineRegistry::init(VulkanDevice& device, JobSystem& jobs)
+{
+    _device = &device;
+    _jobs = &jobs;
+}
+
+VkShaderModule PipelineRegistry::shader(const std::string& path)
+{
+    std::lock_guard lock(_mutex);
+    auto it = _shaders.find(path);
+    if (it != _shaders.end())
+        return it->second;
+
+    auto code = readShaderFile(path);
+    assert(!code.empty());
+    VkShaderModule module = _device->createShaderModule(code);
+    _shaders.emplace(path, module);
+    return module;
+}
+
+std::pair<PipelineHandle, bool> PipelineRegistry::findOrAdd(
+  uint64_t key, PipelineHandle fallback)
+{
+    auto [it, inserted] = _handles.try_emplace(
+      key, static_cast<PipelineHandle>(_entries.size()));
+    if (inserted)
+        _entries.emplace_back().fallback = fallback;
+    else
+        _deduplicated++;
+    return { it->second, inserted };
+}
+
+PipelineHandle PipelineRegistry::build(const GraphicsPipelineBuilder& builder)
+{
+    // Queued like any request, or requested earlier and maybe still building.
+    // Waiting runs our own job first, so a fresh build stays on this thread.
+    PipelineHandle handle = request(builder, InvalidPipeline);
+    JobCounter* pending;
+    {
+        std::lock_guard lock(_mutex);
+        pending = _entries[handle].pending.get();
+    }
+    _jobs->wait(*pending);
+    return handle;
+}
+
+PipelineHandle PipelineRegistry::request(
+  const GraphicsPipelineBuilder& builder, PipelineHandle fallback)
+{
+    uint64_t key = builder.hash();
+    std::lock_guard lock(_mutex);
+    auto [handle, added] = findOrAdd(key, fallback);
+    if (!added)
+        return handle;
+
+    // Queued under the lock, so a concurrent build() of the same pipeline
+    // never waits on the counter before it counts the job. The job only
+    // takes the lock once it runs, run() never calls it.
+    _jobs->run(
+      [this, builder, handle]()
+      {
+          VkPipeline pipeline = builder.build(*_device);
+          std::lock_guard lock(_mutex);
+          _entries[handle].pipeline = pipeline;
+      },
+      _entries[handle].pending.get());
+    return handle;
+}
+
+bool PipelineRegistry::ready(PipelineHandle handle) const
+{
+    std::lock_guard lock(_mutex);
+    return _entries[handle].pipeline != VK_NULL_HANDLE;
+}
+
+VkPipeline PipelineRegistry::get(PipelineHandle handle) const
+{
+    std::lock_guard lock(_mutex);
+    while (handle != InvalidPipeline)
+    {
+        const Entry& entry = _entries[handle];
+        if (entry.pipeline != VK_NULL_HANDLE)
+            return entry.pipeline;
+        handle = entry.fallback;
+    }
+    return VK_NULL_HANDLE;
+}
+
+size_t PipelineRegistry::pipelineCount() const
+{
+    std::lock_guard lock(_mutex);
+    return _entries.size();
+}
+
+uint32_t PipelineRegistry::deduplicated() const
+{
+    std::lock_guard lock(_mutex);
+    return _deduplicated;
+}
+
+void PipelineRegistry::destroy()
+{
+    // Nothing adds entries anymore, no need to hold the lock
+    for (Entry& entry : _entries)
+        _jobs->wait(*entry.pending);
+
+    for (Entry& entry : _entries)
+        vkDestroyPipeline(_device->handle(), entry.pipeline, nullptr);
+    for (auto& [path, module] : _shaders)
+        _device->destroyShaderModule(module);
+    _entries.clear();
+    _handles.clear();
+    _shaders.clear();
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <unordered_map>
+#include <vulkan/vulkan.h>
+
+#include "vulkan_device.hpp"
+#include "vulkan_pipelines.hpp"
+#include "utils/job_system.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+using PipelineHandle = uint32_t;
+constexpr PipelineHandle InvalidPipeline = UINT32_MAX;
+
+// Owns every graphics pipeline, keyed by the hash of the builder state so
+// identical requests share one pipeline. Missing pipelines are compiled on
+// the job system, until then get() hands out the fallback of the request so
+// a new material never stalls a frame.
+class PipelineRegistry
+{
+  public:
+    void init(VulkanDevice& device, JobSystem& jobs);
+    // Waits for the builds in flight
+    void destroy();
+
+    // Loaded once and kept until destroy, so builders sharing a shader file
+    // share the module and hash the same
+    VkShaderModule shader(const std::string& path);
+
+    // Returns once the pipeline is built, for the ones used as fallbacks
+    PipelineHandle build(const GraphicsPipelineBuilder& builder);
+    // Returns right away, the pipeline is built in the background
+    PipelineHandle request(const GraphicsPipelineBuilder& builder,
+                           PipelineHandle fallback);
+
+    bool ready(PipelineHandle handle) const;
+    // The pipeline, or the one of its fallback chain while it builds
+    VkPipeline get(PipelineHandle handle) const;
+
+    size_t pipelineCount() const;
+    // Requests answered with an existing pipeline
+    uint32_t deduplicated() const;
+
+  private:
+    struct Entry
+    {
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        PipelineHandle fallback = InvalidPipeline;
+        // Held by the build job, so waiting on one pipeline does not wait
+        // on every other build in flight
+        std::unique_ptr<JobCounter> pending = std::make_unique<JobCounter>();
+    };
+
+    // Returns the entry of the key and whether it was just added, called
+    // with the mutex held
+    std::pair<PipelineHandle, bool> findOrAdd(uint64_t key,
+                                              PipelineHandle fallback);
+
+    VulkanDevice* _device = nullptr;
+    JobSystem* _jobs = nullptr;
+
+    // Builds finish on any thread, everything below is behind the mutex
+    mutable std::mutex _mutex;
+    std::vector<Entry> _entries;
+    std::unordered_map<uint64_t, PipelineHandle> _handles;
+    std::unordered_map<std::string, VkShaderModule> _shaders;
+    uint32_t _deduplicated = 0;
+};
+
+} // namespace vk
+} // namespace baldwin
@@ -2,6 +2,7 @@
 
 #include <stdexcept>
 #include "vulkan_infos.hpp"
+#include "utils/hash.hpp"
 
 namespace baldwin
 {
@@ -149,7 +150,7 @@ void GraphicsPipelineBuilder::enableDepthTest(bool depthWriteEnable,
     _depthStencil.maxDepthBounds = 1.0f;
 }
 
-VkPipeline GraphicsPipelineBuilder::build(const VkDevice& device)
+VkPipeline GraphicsPipelineBuilder::build(VulkanDevice& device) const
 {
     // We use dynamic viewprt state so only counts are required
     VkPipelineViewportStateCreateInfo viewportInfo = {
@@ -173,9 +174,14 @@ VkPipeline GraphicsPipelineBuilder::build(const VkDevice& device)
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO
     };
 
+    // Builders get copied around, point at our own format
+    VkPipelineRenderingCreateInfo renderInfo = _renderInfo;
+    if (renderInfo.colorAttachmentCount > 0)
+        renderInfo.pColorAttachmentFormats = &_colorAttachmentformat;
+
     VkGraphicsPipelineCreateInfo pipelineInfo = {
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .pNext = &_renderInfo,
+        .pNext = &renderInfo,
         .stageCount = static_cast<uint32_t>(_shaderStages.size()),
         .pStages = _shaderStages.data(),
         .pVertexInputState = &_vertexInputInfo,
@@ -198,14 +204,42 @@ VkPipeline GraphicsPipelineBuilder::build(const VkDevice& device)
     };
     pipelineInfo.pDynamicState = &dynamicInfo;
 
-    VkPipeline newPipeline = VK_NULL_HANDLE;
-    if (vkCreateGraphicsPipelines(
-          device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &newPipeline) !=
-        VK_SUCCESS)
+    return device.createGraphicsPipeline(pipelineInfo);
+}
+
+uint64_t GraphicsPipelineBuilder::hash() const
+{
+    // Field by field, the create infos hold padding and pointers
+    uint64_t h = FNV1aSeed;
+    auto add = [&h](const auto& value)
+    {
+        h = fnv1a(&value, sizeof(value), h);
+    };
+
+    for (const VkPipelineShaderStageCreateInfo& stage : _shaderStages)
     {
-        throw(std::runtime_error("Failed to create graphics pipeline"));
+        add(stage.stage);
+        add(stage.module);
     }
-    return newPipeline;
+    add(_inputAssembly.topology);
+    add(_inputAssembly.primitiveRestartEnable);
+    add(_rasterizer.polygonMode);
+    add(_rasterizer.cullMode);
+    add(_rasterizer.frontFace);
+    add(_rasterizer.lineWidth);
+    add(_colorBlendAttachment);
+    add(_multisampling.rasterizationSamples);
+    add(_multisampling.sampleShadingEnable);
+    add(_multisampling.alphaToCoverageEnable);
+    add(_depthStencil.depthTestEnable);
+    add(_depthStencil.depthWriteEnable);
+    add(_depthStencil.depthCompareOp);
+    add(_renderInfo.colorAttachmentCount);
+    if (_renderInfo.colorAttachmentCount > 0)
+        add(_colorAttachmentformat);
+    add(_renderInfo.depthAttachmentFormat);
+    add(_pipelineLayout);
+    return h;
 }
 } // namespace vk
 } // namespace baldwin
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <vector>
+#include <cstdint>
 #include <vulkan/vulkan.h>
 
+#include "vulkan_device.hpp"
+
 namespace baldwin
 {
 namespace vk
@@ -24,7 +27,10 @@ class GraphicsPipelineBuilder
     void setDepthFormat(VkFormat format);
     void disableDepthTest();
     void enableDepthTest(bool depthWriteEnable, VkCompareOp op);
-    VkPipeline build(const VkDevice& device);
+    VkPipeline build(VulkanDevice& device) const;
+    // Identifies the pipeline build() would create, shaders included. Shader
+    // modules are hashed by handle, so equal keys need shared modules.
+    uint64_t hash() const;
 
     VkPipelineLayout _pipelineLayout;
 
@@ -36,7 +42,7 @@ class GraphicsPipelineBuilder
     VkPipelineMultisampleStateCreateInfo _multisampling;
     VkPipelineDepthStencilStateCreateInfo _depthStencil;
     VkPipelineRenderingCreateInfo _renderInfo;
-    VkFormat _colorAttachmentformat;
+    VkFormat _colorAttachmentformat = VK_FORMAT_UNDEFINED;
 };
 
 } // namespace vk
@@ -0,0 +1,213 @@
+#include "vulkan_profiler.hpp"
+
+#include <iostream>
+
+#include "vulkan_utils.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+namespace
+{
+
+// Results come back in bit order, matching GpuPipelineStatistics
+constexpr VkQueryPipelineStatisticFlags StatisticFlags =
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+constexpr uint32_t StatisticCount = 6;
+
+} // namespace
+
+void GpuProfiler::init(VulkanDevice& device, uint32_t frameCount)
+{
+    _device = &device;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(device.physicalDevice(), &properties);
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(
+      device.physicalDevice(), &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+      device.physicalDevice(), &familyCount, families.data());
+
+    // Zones do nothing on queues without timestamps
+    if (families[device.queueFamilies().graphics].timestampValidBits > 0)
+        _timestampPeriod = properties.limits.timestampPeriod;
+    _track = Profiler::instance().addTrack("GPU");
+
+    _frames.resize(frameCount);
+    for (FrameQueries& queries : _frames)
+    {
+        VkQueryPoolCreateInfo timestampInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = MaxZones * 2,
+        };
+        VK_CHECK(vkCreateQueryPool(device.handle(),
+                                   &timestampInfo,
+                                   nullptr,
+                                   &queries.timestamps),
+                 "Could not create timestamp query pool");
+
+        if (!device.hasPipelineStatistics())
+            continue;
+        VkQueryPoolCreateInfo statisticsInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = 1,
+            .pipelineStatistics = StatisticFlags,
+        };
+        VK_CHECK(vkCreateQueryPool(device.handle(),
+                                   &statisticsInfo,
+                                   nullptr,
+                                   &queries.statistics),
+                 "Could not create pipeline statistics query pool");
+    }
+    _results.resize(MaxZones * 2);
+
+#ifndef NDEBUG
+    std::cout << "GPU profiler : " << _timestampPeriod << " ns per tick"
+              << (device.hasPipelineStatistics() ? ", with statistics\n"
+                                                 : "\n");
+#endif
+}
+
+void GpuProfiler::readBack(FrameQueries& queries)
+{
+    uint32_t zoneCount = static_cast<uint32_t>(queries.zoneNames.size());
+    if (zoneCount > 0 && _timestampPeriod > 0.0)
+    {
+        VkResult result = vkGetQueryPoolResults(_device->handle(),
+                                                queries.timestamps,
+                                                0,
+                                                zoneCount * 2,
+                                                zoneCount * 2 *
+                                                  sizeof(uint64_t),
+                                                _results.data(),
+                                                sizeof(uint64_t),
+                                                VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+        {
+            uint64_t origin = _results[0];
+            for (uint32_t zone = 0; zone < zoneCount; zone++)
+            {
+                auto toNs = [&](uint64_t ticks)
+                {
+                    return queries.recordStartNs +
+                           static_cast<int64_t>((ticks - origin) *
+                                                _timestampPeriod);
+                };
+                Profiler::instance().record(_track,
+                                            queries.zoneNames[zone],
+                                            toNs(_results[zone * 2]),
+                                            toNs(_results[zone * 2 + 1]));
+            }
+        }
+    }
+
+    if (queries.statisticsWritten)
+    {
+        uint64_t values[StatisticCount];
+        VkResult result = vkGetQueryPoolResults(_device->handle(),
+                                                queries.statistics,
+                                                0,
+                                                1,
+                                                sizeof(values),
+                                                values,
+                                                sizeof(values),
+                                                VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+            _statistics = {
+                .inputVertices = values[0],
+                .inputPrimitives = values[1],
+                .vertexInvocations = values[2],
+                .clippingPrimitives = values[3],
+                .fragmentInvocations = values[4],
+                .computeInvocations = values[5],
+            };
+    }
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer cmd, uint32_t frame)
+{
+    FrameQueries& queries = _frames[frame];
+    readBack(queries);
+
+    vkCmdResetQueryPool(cmd, queries.timestamps, 0, MaxZones * 2);
+    if (queries.statistics != VK_NULL_HANDLE)
+        vkCmdResetQueryPool(cmd, queries.statistics, 0, 1);
+    queries.zoneNames.clear();
+    queries.statisticsWritten = false;
+    queries.recordStartNs = Profiler::now();
+    _current = &queries;
+}
+
+uint32_t GpuProfiler::beginZone(VkCommandBuffer cmd, const char* name)
+{
+    if (!_current || _timestampPeriod == 0.0 ||
+        _current->zoneNames.size() == MaxZones)
+        return UINT32_MAX;
+
+    uint32_t zone = static_cast<uint32_t>(_current->zoneNames.size());
+    _current->zoneNames.push_back(name);
+    vkCmdWriteTimestamp2(cmd,
+                         VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                         _current->timestamps,
+                         zone * 2);
+    return zone;
+}
+
+void GpuProfiler::endZone(VkCommandBuffer cmd, uint32_t zone)
+{
+    if (zone == UINT32_MAX)
+        return;
+    vkCmdWriteTimestamp2(cmd,
+                         VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                         _current->timestamps,
+                         zone * 2 + 1);
+}
+
+void GpuProfiler::beginStatistics(VkCommandBuffer cmd)
+{
+    if (!_current || _current->statistics == VK_NULL_HANDLE)
+        return;
+    vkCmdBeginQuery(cmd, _current->statistics, 0, 0);
+    _current->statisticsWritten = true;
+    _current->statisticsActive = true;
+}
+
+void GpuProfiler::endStatistics(VkCommandBuffer cmd)
+{
+    if (!_current || !_current->statisticsActive)
+        return;
+    vkCmdEndQuery(cmd, _current->statistics, 0);
+    _current->statisticsActive = false;
+}
+
+VkQueryPipelineStatisticFlags GpuProfiler::activeStatistics() const
+{
+    if (!_current || !_current->statisticsActive)
+        return 0;
+    return StatisticFlags;
+}
+
+void GpuProfiler::destroy()
+{
+    for (FrameQueries& queries : _frames)
+    {
+        vkDestroyQueryPool(_device->handle(), queries.timestamps, nullptr);
+        vkDestroyQueryPool(_device->handle(), queries.statistics, nullptr);
+    }
+    _frames.clear();
+    _current = nullptr;
+}
+
+} // namespace vk
+} // namespace baldwin
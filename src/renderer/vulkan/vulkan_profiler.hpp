@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+#include "vulkan_device.hpp"
+#include "utils/profiler.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+// Pipeline statistics of the culling and main passes, zero when the device
+// lacks them
+struct GpuPipelineStatistics
+{
+    uint64_t inputVertices = 0;
+    uint64_t inputPrimitives = 0;
+    uint64_t vertexInvocations = 0;
+    uint64_t clippingPrimitives = 0;
+    uint64_t fragmentInvocations = 0;
+    uint64_t computeInvocations = 0;
+};
+
+// Timestamp queries around the passes of a frame, one query pool per frame
+// in flight. Results are read back once the fence of the frame signaled, the
+// next time it is recorded, and handed to the Profiler on a GPU track.
+// GPU zones are placed in traces relative to the start of the recording of
+// their frame, durations are exact but the queue latency is not shown.
+class GpuProfiler
+{
+  public:
+    void init(VulkanDevice& device, uint32_t frameCount);
+    void destroy();
+
+    // Right after the fence of the frame, before any zone
+    void beginFrame(VkCommandBuffer cmd, uint32_t frame);
+
+    uint32_t beginZone(VkCommandBuffer cmd, const char* name);
+    void endZone(VkCommandBuffer cmd, uint32_t zone);
+    // Once per frame, begun and ended outside render passes
+    void beginStatistics(VkCommandBuffer cmd);
+    void endStatistics(VkCommandBuffer cmd);
+    // Secondary command buffers executed while the statistics query is
+    // active must inherit these
+    VkQueryPipelineStatisticFlags activeStatistics() const;
+
+    // Of the last frame read back
+    const GpuPipelineStatistics& statistics() const { return _statistics; }
+
+  private:
+    static constexpr uint32_t MaxZones = 64;
+
+    struct FrameQueries
+    {
+        VkQueryPool timestamps = VK_NULL_HANDLE;
+        VkQueryPool statistics = VK_NULL_HANDLE;
+        std::vector<const char*> zoneNames;
+        int64_t recordStartNs = 0;
+        bool statisticsWritten = false;
+        bool statisticsActive = false;
+    };
+
+    void readBack(FrameQueries& queries);
+
+    VulkanDevice* _device = nullptr;
+    std::vector<FrameQueries> _frames;
+    FrameQueries* _current = nullptr;
+    double _timestampPeriod = 0.0; // nanoseconds per tick
+    uint32_t _track = 0;
+    GpuPipelineStatistics _statistics{};
+    std::vector<uint64_t> _results; // reused by readBack
+};
+
+// Times the enclosing scope on the GPU
+class GpuProfileScope
+{
+  public:
+    GpuProfileScope(GpuProfiler& profiler, VkCommandBuffer cmd,
+                    const char* name)
+        : _profiler(profiler), _cmd(cmd), _zone(profiler.beginZone(cmd, name))
+    {
+    }
+    ~GpuProfileScope() { _profiler.endZone(_cmd, _zone); }
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+  private:
+    GpuProfiler& _profiler;
+    VkCommandBuffer _cmd;
+    uint32_t _zone;
+};
+
+} // namespace vk
+} // namespace baldwin
+
+#ifdef BALDWIN_PROFILING
+#define BALDWIN_GPU_ZONE(profiler, cmd, name)                                  \
+    ::baldwin::vk::GpuProfileScope BALDWIN_CONCAT(gpuZone, __LINE__)(          \
+      profiler, cmd, name)
+#else
+#define BALDWIN_GPU_ZONE(profiler, cmd, name)
+#endif
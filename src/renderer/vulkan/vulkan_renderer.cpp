@@ -7,8 +7,11 @@
 #include "vulkan_renderer.hpp"
 
 #include <iostream>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <cassert>
+#include <numeric>
 #include <stdexcept>
 #include <vulkan/vulkan_core.h>
 #include <glm/gtx/transform.hpp>
@@ -18,8 +21,11 @@
 #include "vulkan_infos.hpp"
 #include "vulkan_pipelines.hpp"
 #include "vulkan_descriptors.hpp"
+#include "renderer/lod.hpp"
+#include "renderer/culling.hpp"
 #include "renderer/shaders.hpp"
 #include "renderer/render_types.hpp"
+#include "renderer/vertex_compression.hpp"
 
 namespace baldwin
 {
@@ -27,19 +33,27 @@ namespace vk
 {
 
 VulkanRenderer::VulkanRenderer(GLFWwindow* window, int width, int height,
-                               bool tripleBuffering)
-  : _device{ window }
+                               JobSystem& jobs,
+                               const RendererSettings& settings)
+  : _settings(settings)
+  , _device{ window, settings.pipelineCachePath }
   , _swapchain(_device, width, height)
+  , _jobs(jobs)
 {
-    if (tripleBuffering)
+    if (_settings.tripleBuffering)
         _frameOverlap = 3;
 
     initCommands();
+    initUploads();
     initSync();
+    initDrawBuffers();
     initRenderTargets();
     initDefaultData();
     initSceneDescriptors();
+    initBindless();
     initDiffusePipeline();
+    initCulling();
+    initProfiling();
 }
 
 void VulkanRenderer::initCommands()
@@ -70,6 +84,35 @@ void VulkanRenderer::initCommands()
                    _device.handle(), &bufferInfo, &frame.mainCommandBuffer),
                  "Could not allocate frame main command buffer");
 
+        // Parallel recording, a pool per thread since pools are not thread
+        // safe. They are reset as a whole every time the frame comes back.
+        VkCommandPoolCreateInfo recordPoolInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = _device.queueFamilies().graphics
+        };
+        for (unsigned int t = 0; t < _jobs.threadCount(); t++)
+        {
+            VkCommandPool pool;
+            VK_CHECK(vkCreateCommandPool(
+                       _device.handle(), &recordPoolInfo, nullptr, &pool),
+                     "Could not create recording command pool");
+
+            VkCommandBufferAllocateInfo secondaryInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = pool,
+                .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                .commandBufferCount = 1,
+            };
+            VkCommandBuffer secondary;
+            VK_CHECK(vkAllocateCommandBuffers(
+                       _device.handle(), &secondaryInfo, &secondary),
+                     "Could not allocate secondary command buffer");
+
+            frame.recordPools.push_back(pool);
+            frame.secondaryCommandBuffers.push_back(secondary);
+        }
+
         _frames.push_back(frame);
         _frames[i].deletionQueue.pushFunction(
           [&, i]()
@@ -80,8 +123,29 @@ void VulkanRenderer::initCommands()
                                    &_frames[i].mainCommandBuffer);
               vkDestroyCommandPool(
                 _device.handle(), _frames[i].commandPool, nullptr);
+              // Destroying a pool frees its command buffers
+              for (VkCommandPool pool : _frames[i].recordPools)
+                  vkDestroyCommandPool(_device.handle(), pool, nullptr);
           });
     }
+    _sliceDrawCalls.resize(_jobs.threadCount());
+}
+
+void VulkanRenderer::initUploads()
+{
+    constexpr size_t UploadRingSize = 64 * 1024 * 1024;
+    _uploader.init(_device, UploadRingSize);
+    _geometryPool.init(_device,
+                       _settings.hostVisibleGeometry
+                         ? MemoryPlacement::Upload
+                         : MemoryPlacement::GpuOnly);
+
+    _deletionQueue.pushFunction(
+      [&]()
+      {
+          _uploader.destroy();
+          _geometryPool.destroy();
+      });
 }
 
 void VulkanRenderer::initSync()
@@ -125,10 +189,46 @@ void VulkanRenderer::initSync()
     }
 }
 
+void VulkanRenderer::initDrawBuffers()
+{
+    // Per draw buffers are created on first use and grown with the scene
+    for (int i = 0; i < _frameOverlap; i++)
+    {
+        _frames[i].cullData = _device.createBuffer(
+          sizeof(CullData),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+          MemoryPlacement::DeviceUpload);
+        _frames[i].cullStats = _device.createBuffer(
+          sizeof(CullStats),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+          MemoryPlacement::Readback);
+        *static_cast<CullStats*>(
+          _frames[i].cullStats.allocationInfo.pMappedData) = {};
+
+        _frames[i].deletionQueue.pushFunction(
+          [&, i]()
+          {
+              _device.destroyBuffer(_frames[i].drawCommands);
+              _device.destroyBuffer(_frames[i].drawData);
+              _device.destroyBuffer(_frames[i].drawCounts);
+              _device.destroyBuffer(_frames[i].instances);
+              _device.destroyBuffer(_frames[i].cullObjects);
+              _device.destroyBuffer(_frames[i].cullData);
+              _device.destroyBuffer(_frames[i].cullStats);
+              _device.destroyBuffer(_frames[i].clusterObjects);
+              _device.destroyBuffer(_frames[i].clusterTasks);
+              _device.destroyBuffer(_frames[i].meshlets);
+          });
+    }
+}
+
 void VulkanRenderer::initRenderTargets()
 {
     assert(_device.handle() != VK_NULL_HANDLE);
-    assert(_swapchain.handle() != VK_NULL_HANDLE);
+    assert(_device.headless() || _swapchain.handle() != VK_NULL_HANDLE);
 
     VkExtent3D size = { 1600, 900, 1 };
     VkImageUsageFlags colorUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
@@ -138,7 +238,9 @@ void VulkanRenderer::initRenderTargets()
     _drawImage = _device.createImage(
       size, VK_FORMAT_R16G16B16A16_SFLOAT, colorUsage, false);
 
-    VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    // Sampled to build the depth pyramid of the occlusion culling
+    VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                                   VK_IMAGE_USAGE_SAMPLED_BIT;
     _depthImage = _device.createImage(
       size, VK_FORMAT_D32_SFLOAT, depthUsage, false);
 
@@ -152,45 +254,35 @@ void VulkanRenderer::initRenderTargets()
 
 void VulkanRenderer::initDefaultData()
 {
-    // Scene uniform buffer
+    // Scene uniforms and other per frame data
     assert(_device.handle() != VK_NULL_HANDLE);
-    _sceneUniformBuffer = _device.createBuffer(
-      sizeof(SceneData),
-      VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-      VMA_MEMORY_USAGE_CPU_TO_GPU);
+    _frameAllocator.init(
+      _device, _frameOverlap, _settings.frameAllocatorSize);
 
     _deletionQueue.pushFunction(
       [&]()
       {
-          _device.destroyBuffer(_sceneUniformBuffer);
+          _frameAllocator.destroy();
       });
 }
 
 void VulkanRenderer::initSceneDescriptors()
 {
     DescriptorLayoutBuilder layoutBuilder;
-    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
-
-    VkDescriptorBindingFlags
-      bindingFlag = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
-    VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo = {
-        .sType =
-          VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
-        .bindingCount = 1,
-        .pBindingFlags = &bindingFlag
-    };
+    // Dynamic, each frame points it at its own SceneData when binding
+    layoutBuilder.addBinding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1);
     _sceneLayout = layoutBuilder.build(
       _device.handle(),
-      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
-      &bindingFlagsInfo,
-      VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
     std::vector<DescriptorManager::PoolSizeRatio> ratios = {
-        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 }
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 }
     };
     _descriptorManager.init(_device.handle(), 10, ratios);
-    _sceneSet = _descriptorManager.allocate(
+    _sceneSet.set = _descriptorManager.allocate(
       _device.handle(), _sceneLayout, nullptr);
+    _sceneWriter.reserve(0, 1);
+    updateSceneDescriptors();
 
     _deletionQueue.pushFunction(
       [&]()
@@ -200,6 +292,53 @@ void VulkanRenderer::initSceneDescriptors()
       });
 }
 
+// Called every frame, the set is only written when the buffer behind it
+// changed. Frames only change the dynamic offset.
+void VulkanRenderer::updateSceneDescriptors()
+{
+    _sceneWriter.clear();
+    _sceneWriter.writeBuffer(0,
+                             _frameAllocator.buffer().handle,
+                             sizeof(SceneData),
+                             0,
+                             VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+    _sceneWriter.updateSet(_device.handle(), _sceneSet);
+}
+
+void VulkanRenderer::initBindless()
+{
+    _bindless.init(_device);
+
+    // Default samplers, at the indices shaders/bindless.glsl expects
+    VkSamplerCreateInfo samplerInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .magFilter = VK_FILTER_LINEAR,
+        .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        .maxLod = VK_LOD_CLAMP_NONE,
+    };
+    VK_CHECK(vkCreateSampler(
+               _device.handle(), &samplerInfo, nullptr, &_linearSampler),
+             "Could not create linear sampler");
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    VK_CHECK(vkCreateSampler(
+               _device.handle(), &samplerInfo, nullptr, &_nearestSampler),
+             "Could not create nearest sampler");
+    _bindless.addSampler(_linearSampler);
+    _bindless.addSampler(_nearestSampler);
+    _bindless.flush();
+
+    _deletionQueue.pushFunction(
+      [&]()
+      {
+          vkDestroySampler(_device.handle(), _nearestSampler, nullptr);
+          vkDestroySampler(_device.handle(), _linearSampler, nullptr);
+          _bindless.destroy();
+      });
+}
+
 void VulkanRenderer::initDiffusePipeline()
 {
     assert(_device.handle() != VK_NULL_HANDLE);
@@ -210,10 +349,11 @@ void VulkanRenderer::initDiffusePipeline()
                                   .offset = 0,
                                   .size = sizeof(RasterizePushConstants) };
 
+    VkDescriptorSetLayout setLayouts[] = { _sceneLayout, _bindless.layout() };
     VkPipelineLayoutCreateInfo diffuseLayout = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = 1,
-        .pSetLayouts = &_sceneLayout,
+        .setLayoutCount = 2,
+        .pSetLayouts = setLayouts,
         .pushConstantRangeCount = 1,
         .pPushConstantRanges = &range
     };
@@ -222,19 +362,12 @@ void VulkanRenderer::initDiffusePipeline()
         _device.handle(), &diffuseLayout, nullptr, &_diffusePipelineLayout),
       "Could not create diffuse pipeline layout");
 
-    // Modules
-    auto vertCode = readShaderFile("shaders/diffuse.vert.spv");
-    assert(!vertCode.empty());
-    VkShaderModule vertModule = _device.createShaderModule(vertCode);
-
-    auto fragCode = readShaderFile("shaders/diffuse.frag.spv");
-    assert(!fragCode.empty());
-    VkShaderModule fragModule = _device.createShaderModule(fragCode);
+    _pipelines.init(_device, _jobs);
 
-    // Pipeline
     GraphicsPipelineBuilder builder = {};
     builder._pipelineLayout = _diffusePipelineLayout;
-    builder.setShaders(vertModule, fragModule);
+    builder.setShaders(_pipelines.shader("shaders/diffuse.vert.spv"),
+                       _pipelines.shader("shaders/diffuse.frag.spv"));
     builder.setInputTopology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
     builder.setPolygonMode(VK_POLYGON_MODE_FILL);
     builder.setCullMode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
@@ -243,17 +376,77 @@ void VulkanRenderer::initDiffusePipeline()
     builder.setColorAttachment(_drawImage.format);
     builder.setDepthFormat(_depthImage.format);
     builder.enableDepthTest(true, VK_COMPARE_OP_LESS_OR_EQUAL);
-    _diffusePipeline = builder.build(_device.handle());
+    _diffusePipeline = _pipelines.build(builder);
 
-    _device.destroyShaderModule(fragModule);
-    _device.destroyShaderModule(vertModule);
+    // Same state, per draw data comes from a buffer indexed with gl_DrawID.
+    // Its shaders differ so it cannot stand in for the direct pipeline,
+    // frames draw directly until it is ready instead.
+    builder.setShaders(_pipelines.shader("shaders/diffuse_indirect.vert.spv"),
+                       _pipelines.shader("shaders/diffuse.frag.spv"));
+    _diffuseIndirectPipeline = _pipelines.request(builder, InvalidPipeline);
 
     _deletionQueue.pushFunction(
       [&]()
       {
+          _pipelines.destroy();
           vkDestroyPipelineLayout(
             _device.handle(), _diffusePipelineLayout, nullptr);
-          vkDestroyPipeline(_device.handle(), _diffusePipeline, nullptr);
+      });
+}
+
+void VulkanRenderer::initCulling()
+{
+    assert(_device.handle() != VK_NULL_HANDLE);
+
+    _depthPyramid.init(_device, _depthImage);
+
+    // Both culling pipelines share the layout
+    VkPushConstantRange range = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+        .offset = 0,
+        .size = std::max(sizeof(CullPushConstants),
+                         sizeof(ClusterCullPushConstants)),
+    };
+    VkDescriptorSetLayout pyramidLayout = _depthPyramid.readLayout();
+    VkPipelineLayoutCreateInfo cullLayout = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 1,
+        .pSetLayouts = &pyramidLayout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &range
+    };
+    VK_CHECK(vkCreatePipelineLayout(
+               _device.handle(), &cullLayout, nullptr, &_cullPipelineLayout),
+             "Could not create cull pipeline layout");
+
+    auto cullCode = readShaderFile("shaders/cull.comp.spv");
+    assert(!cullCode.empty());
+    VkShaderModule cullModule = _device.createShaderModule(cullCode);
+    VkComputePipelineCreateInfo pipelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = getPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT,
+                                                  cullModule),
+        .layout = _cullPipelineLayout,
+    };
+    _cullPipeline = _device.createComputePipeline(pipelineInfo);
+    _device.destroyShaderModule(cullModule);
+
+    auto clusterCode = readShaderFile("shaders/cluster_cull.comp.spv");
+    assert(!clusterCode.empty());
+    VkShaderModule clusterModule = _device.createShaderModule(clusterCode);
+    pipelineInfo.stage = getPipelineShaderStageCreateInfo(
+      VK_SHADER_STAGE_COMPUTE_BIT, clusterModule);
+    _clusterCullPipeline = _device.createComputePipeline(pipelineInfo);
+    _device.destroyShaderModule(clusterModule);
+
+    _deletionQueue.pushFunction(
+      [&]()
+      {
+          vkDestroyPipeline(_device.handle(), _cullPipeline, nullptr);
+          vkDestroyPipeline(_device.handle(), _clusterCullPipeline, nullptr);
+          vkDestroyPipelineLayout(
+            _device.handle(), _cullPipelineLayout, nullptr);
+          _depthPyramid.destroy();
       });
 }
 
@@ -262,67 +455,132 @@ void VulkanRenderer::resizeSwapchain(int width, int height)
     _swapchain.reconstruct(width, height);
 }
 
-void VulkanRenderer::uploadMesh(const std::shared_ptr<Mesh> mesh)
+MeshHandle VulkanRenderer::uploadMesh(const Mesh& mesh)
+{
+    return uploadGeometry(mesh.uuid,
+                          mesh.vertices,
+                          mesh.indices,
+                          mesh.vertexFormat,
+                          mesh.lods,
+                          mesh.meshlets);
+}
+
+MeshHandle VulkanRenderer::uploadMeshData(const std::string& uuid,
+                                          std::span<const Vertex> vertices,
+                                          std::span<const uint32_t> indices,
+                                          VertexFormat format)
+{
+    return uploadGeometry(uuid, vertices, indices, format, {}, {});
+}
+
+MeshHandle VulkanRenderer::uploadGeometry(const std::string& uuid,
+                                          std::span<const Vertex> vertices,
+                                          std::span<const uint32_t> indices,
+                                          VertexFormat format,
+                                          std::span<const MeshLod> lods,
+                                          std::span<const Meshlet> meshlets)
 {
-    if (!_meshBuffersMap.contains(mesh->uuid))
+    if (vertices.empty() || indices.empty())
+        return InvalidMeshHandle;
+    auto [it, inserted] = _meshHandles.try_emplace(
+      uuid, static_cast<MeshHandle>(_gpuMeshes.size()));
+    if (!inserted)
+        return it->second;
+    MeshHandle handle = it->second;
+
+    GpuMesh mesh{};
+    mesh.decode.format = static_cast<uint32_t>(format);
+    const void* vertexData = vertices.data();
+    if (format == VertexFormat::Compact)
     {
-        size_t vertexSize = mesh->vertices.size() * sizeof(Vertex);
-        size_t indexSize = mesh->indices.size() * sizeof(uint32_t);
+        PositionQuantization quantization = compressVertices(
+          vertices, _compactVertices);
+        mesh.decode.positionOffset = quantization.offset;
+        mesh.decode.positionScale = quantization.scale;
+        vertexData = _compactVertices.data();
+    }
 
-        // Temporary buffer
-        Buffer staging = _device.createBuffer(vertexSize + indexSize,
-                                              VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                              VMA_MEMORY_USAGE_CPU_ONLY);
-        void* data = staging.allocation->GetMappedData();
+    // The pool counts in Vertex sized slots, smaller formats share them
+    constexpr size_t SlotSize = sizeof(Vertex);
+    size_t vertexBytes = vertices.size() * vertexSize(format);
+    uint32_t verticesPerSlot = static_cast<uint32_t>(SlotSize /
+                                                     vertexSize(format));
+    static_assert(sizeof(Vertex) % sizeof(CompactVertex) == 0);
+
+    mesh.range = _geometryPool.allocate(
+      static_cast<uint32_t>((vertexBytes + SlotSize - 1) / SlotSize),
+      static_cast<uint32_t>(indices.size()));
+    mesh.vertexOffset = mesh.range.vertexOffset *
+                        static_cast<int32_t>(verticesPerSlot);
+    const GeometryBlock& block = _geometryPool.block(mesh.range.block);
+
+    // Data is copied into the staging ring right away, the GPU copies are
+    // batched and submitted with the next frame
+    _uploader.enqueue(block.vertexBuffer.handle,
+                      mesh.range.vertexOffset * SlotSize,
+                      vertexData,
+                      vertexBytes);
+    uint64_t uploadValue = _uploader.enqueue(
+      block.indexBuffer.handle,
+      mesh.range.firstIndex * sizeof(uint32_t),
+      indices.data(),
+      indices.size() * sizeof(uint32_t));
+
+    // Meshlet ranges move with the mesh into its pool block
+    mesh.firstMeshlet = static_cast<uint32_t>(_gpuMeshlets.size());
+    mesh.meshletCount = static_cast<uint32_t>(meshlets.size());
+    for (const Meshlet& meshlet : meshlets)
+    {
+        _gpuMeshlets.push_back(
+          { .boundingSphere = glm::vec4(meshlet.center, meshlet.radius),
+            .cone = glm::vec4(meshlet.coneAxis, meshlet.coneCutoff),
+            .firstIndex = mesh.range.firstIndex + meshlet.firstIndex,
+            .indexCount = meshlet.triangleCount * 3 });
+    }
+    if (!meshlets.empty())
+        _meshletVersion++;
+
+    // Draws read the levels from here instead of the Mesh
+    mesh.firstLod = static_cast<uint32_t>(_meshLods.size());
+    mesh.lodCount = static_cast<uint32_t>(lods.size());
+    _meshLods.insert(_meshLods.end(), lods.begin(), lods.end());
+
+    _gpuMeshes.push_back(mesh);
+    _meshResident.push_back(false);
+    _pendingMeshes.push_back({ .mesh = handle, .uploadValue = uploadValue });
+    return handle;
+}
 
-        // Copy date on the cpu staging buffer
-        memcpy((char*)data, mesh->vertices.data(), vertexSize);
-        memcpy((char*)data + vertexSize, mesh->indices.data(), indexSize);
+void VulkanRenderer::initProfiling()
+{
+#ifdef BALDWIN_PROFILING
+    _gpuProfiler.init(_device, _frameOverlap);
+    _deletionQueue.pushFunction([&]() { _gpuProfiler.destroy(); });
+#endif
+}
 
-        MeshBuffers buffers;
-        buffers.vertexBuffer = _device.createBuffer(
-          vertexSize,
-          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
-            VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-          VMA_MEMORY_USAGE_CPU_ONLY);
-        buffers.indexBuffer = _device.createBuffer(
-          indexSize,
-          VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-          VMA_MEMORY_USAGE_CPU_ONLY);
-
-        VkBufferDeviceAddressInfo deviceAdressInfo = {
-            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-            .buffer = buffers.vertexBuffer.handle
-        };
-        buffers.vertexBufferAddress = vkGetBufferDeviceAddress(
-          _device.handle(), &deviceAdressInfo);
+void VulkanRenderer::collectUploads()
+{
+    BALDWIN_PROFILE_ZONE("Collect uploads");
+    _uploader.submit();
+    _uploadedValue = _uploader.completedValue();
+
+    // Meshes whose upload retired become drawable
+    std::erase_if(_pendingMeshes,
+                  [&](PendingMesh& pending)
+                  {
+                      if (pending.uploadValue > _uploadedValue)
+                          return false;
+                      _meshResident[pending.mesh] = true;
+                      return true;
+                  });
+}
 
-        _device.immediateSubmit(
-          [&](VkCommandBuffer cmd)
-          {
-              VkBufferCopy vertexCopy = {
-                  .srcOffset = 0,
-                  .dstOffset = 0,
-                  .size = vertexSize,
-              };
-              vkCmdCopyBuffer(cmd,
-                              staging.handle,
-                              buffers.vertexBuffer.handle,
-                              1,
-                              &vertexCopy);
-
-              VkBufferCopy indexCopy = {
-                  .srcOffset = vertexSize,
-                  .dstOffset = 0,
-                  .size = indexSize,
-              };
-              vkCmdCopyBuffer(
-                cmd, staging.handle, buffers.indexBuffer.handle, 1, &indexCopy);
-          });
-        _device.destroyBuffer(staging);
-        _meshBuffersMap[mesh->uuid] = buffers;
-    }
+void VulkanRenderer::waitForUploads()
+{
+    _uploader.submit();
+    _uploader.wait(_uploader.submittedValue());
+    collectUploads();
 }
 
 void VulkanRenderer::updateSceneBuffer(const VkCommandBuffer& cmd)
@@ -343,22 +601,267 @@ void VulkanRenderer::updateSceneBuffer(const VkCommandBuffer& cmd)
     dummySceneData.sunlightDirection = glm::vec4(0.5, 1.0, 0.2, 0.0);
     dummySceneData.sunlightColor = glm::vec4(1.0, 1.0, 0.9, 1.0);
 
-    SceneData* bufferSceneData = static_cast<SceneData*>(
-      _sceneUniformBuffer.allocation->GetMappedData());
-    *bufferSceneData = dummySceneData;
+    // Frames in flight keep reading their own copy
+    FrameAllocation sceneAllocation = _frameAllocator.push(dummySceneData);
+    _sceneOffset = static_cast<uint32_t>(sceneAllocation.offset);
+    _sceneData = dummySceneData;
+    updateSceneDescriptors();
 
-    DescriptorWriter writer{};
-    writer.writeBuffer(0,
-                       _sceneUniformBuffer.handle,
-                       _sceneUniformBuffer.allocationInfo.size,
-                       0,
-                       VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    writer.updateSet(_device.handle(), _sceneSet);
+    // Slots added since the last frame, usually none
+    _bindless.flush();
+}
+
+void VulkanRenderer::cullScene(const RenderScene& scene)
+{
+    BALDWIN_PROFILE_ZONE("CPU culling");
+    // Multiple of SceneBoundsWidth, smaller scenes are culled in one go
+    constexpr size_t CullChunkSize = 16384;
+
+    const SceneBounds& bounds = scene.bounds;
+    if (!_settings.cpuCulling)
+    {
+        _visibleInstances.resize(scene.instanceCount());
+        std::iota(_visibleInstances.begin(), _visibleInstances.end(), 0);
+        // The culling paths drop hidden instances through their bounds
+        if (scene.hiddenCount() > 0)
+        {
+            std::erase_if(_visibleInstances,
+                          [&](uint32_t instance)
+                          {
+                              return scene.instanceFlags[instance] &
+                                     InstanceHidden;
+                          });
+        }
+    }
+    else if (bounds.size() <= CullChunkSize)
+    {
+        cullSpheres(extractFrustum(_sceneData.viewproj),
+                    bounds,
+                    _visibleInstances);
+    }
+    else
+    {
+        // Every chunk writes its survivors at its own offset, they are then
+        // packed together
+        Frustum frustum = extractFrustum(_sceneData.viewproj);
+        size_t chunkCount = (bounds.size() + CullChunkSize - 1) /
+                            CullChunkSize;
+        _visibleInstances.resize(bounds.paddedSize());
+        _chunkVisibleCounts.resize(chunkCount);
+        _jobs.parallelFor(
+          chunkCount,
+          [&](size_t chunk)
+          {
+              size_t first = chunk * CullChunkSize;
+              _chunkVisibleCounts[chunk] = cullSphereRange(
+                frustum,
+                bounds,
+                first,
+                std::min(CullChunkSize, bounds.size() - first),
+                _visibleInstances.data() + first);
+          });
+
+        size_t visibleCount = 0;
+        for (size_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            size_t offset = chunk * CullChunkSize;
+            auto first = _visibleInstances.begin() + offset;
+            if (visibleCount != offset)
+            {
+                std::copy(first,
+                          first + _chunkVisibleCounts[chunk],
+                          _visibleInstances.begin() + visibleCount);
+            }
+            visibleCount += _chunkVisibleCounts[chunk];
+        }
+        _visibleInstances.resize(visibleCount);
+    }
+    _stats.cpuCulled = static_cast<uint32_t>(scene.instanceCount() -
+                                             _visibleInstances.size());
+}
+
+void VulkanRenderer::buildDrawList(const RenderScene& scene)
+{
+    BALDWIN_PROFILE_ZONE("Build draw list");
+    DrawList& list = _drawList;
+    size_t blockCount = _geometryPool.blockCount();
+    list.draws.clear();
+    list.unsortedDraws.clear();
+    size_t meshCount = scene.meshHandles.size();
+    list.meshFirstLod.resize(meshCount + 1);
+    list.meshFirstLod[0] = 0;
+    for (uint32_t mesh = 0; mesh < meshCount; mesh++)
+    {
+        MeshHandle handle = scene.meshHandles[mesh];
+        uint32_t levels = handle != InvalidMeshHandle
+                            ? _gpuMeshes[handle].lodCount
+                            : 0;
+        list.meshFirstLod[mesh + 1] = list.meshFirstLod[mesh] +
+                                      std::max(levels, 1u);
+    }
+    list.lodInstanceCount.assign(list.meshFirstLod.back(), 0);
+    list.lodDraw.resize(list.meshFirstLod.back());
+    list.visibleLods.resize(_visibleInstances.size());
+    list.blockFirstDraw.assign(blockCount, 0);
+    list.blockDrawCount.assign(blockCount, 0);
+    list.instanceCount = 0;
+
+    // Clusters are culled by the same pass as the instances
+    bool clusters = _indirectDraw && _settings.gpuCulling &&
+                    _settings.clusterCulling;
+    list.meshClustered.resize(meshCount);
+    for (uint32_t mesh = 0; mesh < meshCount; mesh++)
+    {
+        MeshHandle handle = scene.meshHandles[mesh];
+        list.meshClustered[mesh] = clusters &&
+                                   handle != InvalidMeshHandle &&
+                                   _gpuMeshes[handle].meshletCount > 0;
+    }
+    list.meshClusterInstances.assign(meshCount, 0);
+    list.clusterInstances.clear();
+    list.blockClusterFirstDraw.assign(blockCount, 0);
+    list.blockClusterDrawCount.assign(blockCount, 0);
+    list.clusterTaskCount = 0;
+
+    // Every visible instance picks a level from the size of its error on
+    // screen, instances of meshes without LODs skip the math
+    LodProjection projection = makeLodProjection(
+      _sceneData, static_cast<float>(_drawExtent.height));
+    const SceneBounds& bounds = scene.bounds;
+    for (size_t i = 0; i < _visibleInstances.size(); i++)
+    {
+        uint32_t instance = _visibleInstances[i];
+        uint32_t mesh = scene.instanceMeshes[instance];
+        uint32_t lod = list.meshFirstLod[mesh];
+        if (list.meshFirstLod[mesh + 1] - lod > 1 &&
+            _settings.lodErrorPixels > 0.0f)
+        {
+            const GpuMesh& gpuMesh = _gpuMeshes[scene.meshHandles[mesh]];
+            float radius = bounds.radius[instance];
+            float meshRadius = scene.meshBounds[mesh].radius;
+            float scale = meshRadius > 0.0f ? radius / meshRadius : 1.0f;
+            lod += selectLod({ _meshLods.data() + gpuMesh.firstLod,
+                               gpuMesh.lodCount },
+                             projection,
+                             glm::vec3(bounds.centerX[instance],
+                                       bounds.centerY[instance],
+                                       bounds.centerZ[instance]),
+                             radius,
+                             scale,
+                             _settings.lodErrorPixels);
+        }
+        if (lod == list.meshFirstLod[mesh] && list.meshClustered[mesh])
+        {
+            list.visibleLods[i] = ClusterLod;
+            list.clusterInstances.push_back(instance);
+            list.meshClusterInstances[mesh]++;
+            continue;
+        }
+        list.visibleLods[i] = lod;
+        list.lodInstanceCount[lod]++;
+    }
+
+    // One draw per level with at least one visible instance. Residency is
+    // only looked up once per mesh, not per instance.
+    for (uint32_t mesh = 0; mesh < meshCount; mesh++)
+    {
+        uint32_t firstLod = list.meshFirstLod[mesh];
+        uint32_t endLod = list.meshFirstLod[mesh + 1];
+        uint32_t instanceCount = list.meshClusterInstances[mesh];
+        for (uint32_t lod = firstLod; lod < endLod; lod++)
+            instanceCount += list.lodInstanceCount[lod];
+        if (instanceCount == 0)
+            continue;
+
+        MeshHandle handle = scene.meshHandles[mesh];
+        if (handle == InvalidMeshHandle || !_meshResident[handle])
+        {
+            // Still uploading, its instances are skipped
+            std::fill(list.lodInstanceCount.begin() + firstLod,
+                      list.lodInstanceCount.begin() + endLod,
+                      0);
+            continue;
+        }
+
+        const GpuMesh& gpuMesh = _gpuMeshes[handle];
+        std::span<const MeshLod> lods(_meshLods.data() + gpuMesh.firstLod,
+                                      gpuMesh.lodCount);
+        if (uint32_t clustered = list.meshClusterInstances[mesh])
+        {
+            // Every meshlet may survive, the triangles counted are the upper
+            // bound
+            uint32_t tasks = gpuMesh.meshletCount * clustered;
+            list.blockClusterDrawCount[gpuMesh.range.block] += tasks;
+            list.clusterTaskCount += tasks;
+            uint32_t indexCount = lods.empty() ? gpuMesh.range.indexCount
+                                               : lods[0].indexCount;
+            _stats.triangles += uint64_t(indexCount / 3) * clustered;
+        }
+        for (uint32_t lod = firstLod; lod < endLod; lod++)
+        {
+            if (list.lodInstanceCount[lod] == 0)
+                continue;
+            DrawItem item = { .lod = lod,
+                              .gpuMesh = gpuMesh,
+                              .firstIndex = gpuMesh.range.firstIndex,
+                              .indexCount = gpuMesh.range.indexCount,
+                              .instanceCount = list.lodInstanceCount[lod] };
+            if (!lods.empty())
+            {
+                item.firstIndex += lods[lod - firstLod].firstIndex;
+                item.indexCount = lods[lod - firstLod].indexCount;
+            }
+            list.unsortedDraws.push_back(item);
+            list.blockDrawCount[gpuMesh.range.block]++;
+            _stats.triangles += uint64_t(item.indexCount / 3) *
+                                item.instanceCount;
+        }
+    }
+
+    // Group the draws per pool block, since each block needs its own index
+    // buffer binding
+    uint32_t firstDraw = 0;
+    for (size_t b = 0; b < blockCount; b++)
+    {
+        list.blockFirstDraw[b] = firstDraw;
+        firstDraw += list.blockDrawCount[b];
+    }
+    // Cluster draws follow the regular ones, grouped the same way
+    uint32_t drawCount = static_cast<uint32_t>(list.unsortedDraws.size());
+    uint32_t firstClusterDraw = drawCount;
+    for (size_t b = 0; b < blockCount; b++)
+    {
+        list.blockClusterFirstDraw[b] = firstClusterDraw;
+        firstClusterDraw += list.blockClusterDrawCount[b];
+    }
+    list.draws.resize(drawCount);
+    list.cursor = list.blockFirstDraw;
+    for (const DrawItem& item : list.unsortedDraws)
+    {
+        uint32_t slot = list.cursor[item.gpuMesh.range.block]++;
+        list.draws[slot] = item;
+        list.lodDraw[item.lod] = slot;
+    }
+
+    // Instances of a draw are contiguous in the instance buffer
+    for (DrawItem& item : list.draws)
+    {
+        item.firstInstance = list.instanceCount;
+        list.instanceCount += item.instanceCount;
+    }
 }
 
 void VulkanRenderer::drawObjects(
-  const VkCommandBuffer& cmd, const std::vector<std::shared_ptr<Mesh>>& scene)
+  const VkCommandBuffer& cmd, FrameData& frame,
+  const RenderScene& scene)
 {
+    BALDWIN_PROFILE_ZONE("Record draws");
+
+    // Indirect draws are a handful of calls, only direct draws are worth
+    // spreading across threads
+    bool parallel = !_indirectDraw &&
+                    _drawList.draws.size() > _settings.parallelRecordThreshold;
+
     // Begin a render pass connected to our draw image
     VkRenderingAttachmentInfo colorAttachment = getAttachmentInfo(
       _drawImage.view, nullptr, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
@@ -367,17 +870,46 @@ void VulkanRenderer::drawObjects(
 
     VkRenderingInfo renderInfo = getRenderingInfo(
       _drawExtent, &colorAttachment, &depthAttachment);
+    if (parallel)
+        renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+#ifdef BALDWIN_PROFILING
+    // No query may be active around secondary command buffers without
+    // inheritedQueries, the statistics of this frame stop short
+    if (parallel && !_device.hasInheritedQueries())
+        _gpuProfiler.endStatistics(cmd);
+#endif
     vkCmdBeginRendering(cmd, &renderInfo);
 
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, _diffusePipeline);
+    if (parallel)
+    {
+        recordParallelDraws(cmd, frame);
+    }
+    else
+    {
+        setDrawState(cmd);
+        if (_indirectDraw)
+            recordIndirectDraws(cmd, frame);
+        else
+            _stats.drawCalls += recordDirectDraws(
+              cmd, frame, 0, _drawList.draws.size());
+    }
+
+    vkCmdEndRendering(cmd);
+    _stats.objects = _drawList.instanceCount +
+                     static_cast<uint32_t>(_drawList.clusterInstances.size());
+}
+
+void VulkanRenderer::setDrawState(const VkCommandBuffer& cmd)
+{
+    VkDescriptorSet sets[] = { _sceneSet.set, _bindless.set() };
     vkCmdBindDescriptorSets(cmd,
                             VK_PIPELINE_BIND_POINT_GRAPHICS,
                             _diffusePipelineLayout,
                             0,
+                            2,
+                            sets,
                             1,
-                            &_sceneSet,
-                            0,
-                            nullptr);
+                            &_sceneOffset);
 
     // Dynamic viewport and scissor
     // The vp defines the transformation from the image to the framebuffer
@@ -395,17 +927,105 @@ void VulkanRenderer::drawObjects(
 
     VkRect2D scissor = { .offset = { 0, 0 }, .extent = _drawExtent };
     vkCmdSetScissor(cmd, 0, 1, &scissor);
+}
+
+void VulkanRenderer::recordParallelDraws(const VkCommandBuffer& cmd,
+                                         FrameData& frame)
+{
+    // One contiguous slice of the draw list per thread, each recorded into a
+    // secondary command buffer allocated from the pool of its slice
+    size_t drawCount = _drawList.draws.size();
+    size_t maxSlices = frame.recordPools.size();
+    if (_settings.recordThreads != 0)
+        maxSlices = std::min<size_t>(maxSlices, _settings.recordThreads);
+    size_t sliceSize = (drawCount + maxSlices - 1) / maxSlices;
+    size_t sliceCount = (drawCount + sliceSize - 1) / sliceSize;
+
+    VkFormat colorFormat = _drawImage.format;
+    VkCommandBufferInheritanceRenderingInfo renderingInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &colorFormat,
+        .depthAttachmentFormat = _depthImage.format,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+    };
+    VkCommandBufferInheritanceInfo inheritanceInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = &renderingInfo,
+        .pipelineStatistics = _gpuProfiler.activeStatistics(),
+    };
+    VkCommandBufferBeginInfo beginInfo = getCommandBufferBeginInfo(
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+        VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    _jobs.parallelFor(
+      sliceCount,
+      [&](size_t slice)
+      {
+          BALDWIN_PROFILE_ZONE("Record slice");
+          VkCommandBuffer secondary = frame.secondaryCommandBuffers[slice];
+          VK_CHECK(
+            vkResetCommandPool(_device.handle(), frame.recordPools[slice], 0),
+            "Could not reset recording command pool");
+          VK_CHECK(vkBeginCommandBuffer(secondary, &beginInfo),
+                   "Could not begin secondary command buffer");
+
+          // Secondary command buffers inherit no state
+          setDrawState(secondary);
+          size_t firstDraw = slice * sliceSize;
+          _sliceDrawCalls[slice] = recordDirectDraws(
+            secondary,
+            frame,
+            firstDraw,
+            std::min(sliceSize, drawCount - firstDraw));
+
+          VK_CHECK(vkEndCommandBuffer(secondary),
+                   "Could not end secondary command buffer");
+      });
+
+    vkCmdExecuteCommands(cmd,
+                         static_cast<uint32_t>(sliceCount),
+                         frame.secondaryCommandBuffers.data());
+
+    for (size_t slice = 0; slice < sliceCount; slice++)
+        _stats.drawCalls += _sliceDrawCalls[slice];
+    _stats.secondaryCommandBuffers = static_cast<uint32_t>(sliceCount);
+}
 
-    for (auto& mesh : scene)
+uint32_t VulkanRenderer::recordDirectDraws(const VkCommandBuffer& cmd,
+                                           FrameData& frame, size_t firstDraw,
+                                           size_t drawCount)
+{
+    // The instance buffer only exists once something was drawn
+    if (drawCount == 0)
+        return 0;
+
+    vkCmdBindPipeline(cmd,
+                      VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      _pipelines.get(_diffusePipeline));
+    VkDeviceAddress instancesAddress = _device.getBufferAddress(
+      frame.instances);
+
+    // Draws are sorted per block, which share their index buffer
+    uint32_t boundBlock = UINT32_MAX;
+    for (size_t d = firstDraw; d < firstDraw + drawCount; d++)
     {
-        if (!_meshBuffersMap.contains(mesh->uuid))
-            continue;
+        const DrawItem& item = _drawList.draws[d];
+        const GeometryRange& range = item.gpuMesh.range;
+        const GeometryBlock& block = _geometryPool.block(range.block);
+        if (range.block != boundBlock)
+        {
+            vkCmdBindIndexBuffer(
+              cmd, block.indexBuffer.handle, 0, VK_INDEX_TYPE_UINT32);
+            boundBlock = range.block;
+        }
 
-        auto meshBuffers = _meshBuffersMap[mesh->uuid];
         RasterizePushConstants pc = {
-            .vertexBufferAddress = meshBuffers.vertexBufferAddress
+            .vertexBufferAddress = block.vertexBufferAddress,
+            .instancesAddress = instancesAddress,
+            .decode = item.gpuMesh.decode,
         };
-        pc.worldMatrix = glm::identity<glm::mat4>();
         vkCmdPushConstants(cmd,
                            _diffusePipelineLayout,
                            VK_SHADER_STAGE_VERTEX_BIT,
@@ -413,39 +1033,487 @@ void VulkanRenderer::drawObjects(
                            sizeof(RasterizePushConstants),
                            &pc);
 
-        vkCmdBindIndexBuffer(
-          cmd, meshBuffers.indexBuffer.handle, 0, VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(cmd, mesh->indices.size(), 1, 0, 0, 0);
+        vkCmdDrawIndexed(cmd,
+                         item.indexCount,
+                         item.instanceCount,
+                         item.firstIndex,
+                         item.gpuMesh.vertexOffset,
+                         item.firstInstance);
+    }
+    return static_cast<uint32_t>(drawCount);
+}
+
+void VulkanRenderer::reserveDrawBuffers(FrameData& frame, uint32_t drawCount,
+                                        uint32_t instanceCount,
+                                        uint32_t blockCount)
+{
+    // The frame fence was waited on, so nothing reads these buffers anymore
+    if (drawCount > frame.drawCapacity)
+    {
+        uint32_t capacity = std::max(drawCount, frame.drawCapacity * 2);
+        _device.destroyBuffer(frame.drawCommands);
+        _device.destroyBuffer(frame.drawData);
+        frame.drawCommands = _device.createBuffer(
+          capacity * sizeof(VkDrawIndexedIndirectCommand),
+          VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+          MemoryPlacement::DeviceUpload);
+        frame.drawData = _device.createBuffer(
+          capacity * sizeof(DrawData),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+          MemoryPlacement::DeviceUpload);
+        frame.drawCapacity = capacity;
+    }
+    if (instanceCount > frame.instanceCapacity)
+    {
+        uint32_t capacity = std::max(instanceCount,
+                                     frame.instanceCapacity * 2);
+        _device.destroyBuffer(frame.instances);
+        _device.destroyBuffer(frame.cullObjects);
+        frame.instances = _device.createBuffer(
+          capacity * sizeof(glm::mat4),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+          MemoryPlacement::DeviceUpload);
+        frame.cullObjects = _device.createBuffer(
+          capacity * sizeof(CullObject),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+          MemoryPlacement::DeviceUpload);
+        frame.instanceCapacity = capacity;
+    }
+    if (blockCount > frame.drawCountCapacity)
+    {
+        _device.destroyBuffer(frame.drawCounts);
+        frame.drawCounts = _device.createBuffer(
+          blockCount * sizeof(uint32_t),
+          VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+          MemoryPlacement::DeviceUpload);
+        frame.drawCountCapacity = blockCount;
+    }
+}
+
+void VulkanRenderer::prepareDraws(const VkCommandBuffer& cmd,
+                                  FrameData& frame, const RenderScene& scene)
+{
+    buildDrawList(scene);
+    const DrawList& list = _drawList;
+    if (list.draws.empty() && list.clusterTaskCount == 0)
+        return;
+
+    // Cluster draws and their instances go after the regular ones, with a
+    // second count per block
+    size_t blockCount = list.blockDrawCount.size();
+    reserveDrawBuffers(
+      frame,
+      static_cast<uint32_t>(list.draws.size()) + list.clusterTaskCount,
+      list.instanceCount +
+        static_cast<uint32_t>(list.clusterInstances.size()),
+      static_cast<uint32_t>(blockCount * 2));
+
+    bool gpuCulling = _indirectDraw && _settings.gpuCulling;
+    if (_indirectDraw)
+    {
+        auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(
+          frame.drawCommands.allocationInfo.pMappedData);
+        auto* drawData = static_cast<DrawData*>(
+          frame.drawData.allocationInfo.pMappedData);
+        auto* counts = static_cast<uint32_t*>(
+          frame.drawCounts.allocationInfo.pMappedData);
+
+        for (size_t d = 0; d < list.draws.size(); d++)
+        {
+            const DrawItem& item = list.draws[d];
+            const GeometryRange& range = item.gpuMesh.range;
+            // The culling pass adds the instances that survive
+            commands[d] = {
+                .indexCount = item.indexCount,
+                .instanceCount = gpuCulling ? 0 : item.instanceCount,
+                .firstIndex = item.firstIndex,
+                .vertexOffset = item.gpuMesh.vertexOffset,
+                .firstInstance = item.firstInstance,
+            };
+            drawData[d] = {
+                .vertexBufferAddress =
+                  _geometryPool.block(range.block).vertexBufferAddress,
+                .decode = item.gpuMesh.decode,
+            };
+        }
+        for (size_t b = 0; b < blockCount; b++)
+        {
+            counts[b] = list.blockDrawCount[b];
+            counts[blockCount + b] = 0;
+        }
+    }
+
+    if (gpuCulling)
+    {
+        cullInstances(cmd, frame, scene);
+        if (list.clusterTaskCount > 0)
+            cullClusters(cmd, frame, scene);
+        // The stats are read on the host once the frame fence signals
+        createMemoryBarrier(cmd,
+                            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                            VK_PIPELINE_STAGE_2_HOST_BIT,
+                            VK_ACCESS_2_HOST_READ_BIT);
+        return;
+    }
+
+    auto* instances = static_cast<glm::mat4*>(
+      frame.instances.allocationInfo.pMappedData);
+    _drawList.cursor.assign(list.draws.size(), 0);
+    for (size_t i = 0; i < _visibleInstances.size(); i++)
+    {
+        uint32_t lod = list.visibleLods[i];
+        if (list.lodInstanceCount[lod] == 0)
+            continue;
+
+        uint32_t draw = list.lodDraw[lod];
+        uint32_t slot = list.draws[draw].firstInstance +
+                        _drawList.cursor[draw]++;
+        instances[slot] = scene.instanceTransforms[_visibleInstances[i]];
+    }
+}
+
+void VulkanRenderer::cullInstances(const VkCommandBuffer& cmd,
+                                   FrameData& frame, const RenderScene& scene)
+{
+    // Every instance becomes a cull object, the compute pass copies the
+    // world matrix of the visible ones into the instance range of their draw
+    const DrawList& list = _drawList;
+    auto* objects = static_cast<CullObject*>(
+      frame.cullObjects.allocationInfo.pMappedData);
+    uint32_t objectCount = 0;
+    for (size_t i = 0; i < _visibleInstances.size(); i++)
+    {
+        uint32_t instance = _visibleInstances[i];
+        uint32_t lod = list.visibleLods[i];
+        if (lod == ClusterLod || list.lodInstanceCount[lod] == 0)
+            continue;
+
+        objects[objectCount++] = {
+            .worldMatrix = scene.instanceTransforms[instance],
+            .boundingSphere = glm::vec4(scene.bounds.centerX[instance],
+                                        scene.bounds.centerY[instance],
+                                        scene.bounds.centerZ[instance],
+                                        scene.bounds.radius[instance]),
+            .drawIndex = list.lodDraw[lod],
+        };
+    }
+
+    CullData* cullData = static_cast<CullData*>(
+      frame.cullData.allocationInfo.pMappedData);
+    Frustum frustum = extractFrustum(_sceneData.viewproj);
+    for (int i = 0; i < 6; i++)
+        cullData->frustumPlanes[i] = frustum.planes[i];
+    LodProjection projection = makeLodProjection(
+      _sceneData, static_cast<float>(_drawExtent.height));
+    cullData->cameraPosition = glm::vec4(projection.cameraPosition, 1.0f);
+    VkExtent2D pyramidExtent = _depthPyramid.extent();
+    cullData->pyramidView = _pyramidView;
+    cullData->pyramidProj = glm::vec4(_pyramidProj[0][0],
+                                      _pyramidProj[1][1],
+                                      _pyramidProj[2][2],
+                                      _pyramidProj[3][2]);
+    cullData->pyramidSize = glm::vec2(
+      static_cast<float>(pyramidExtent.width),
+      static_cast<float>(pyramidExtent.height));
+    cullData->znear = _pyramidProj[3][2] / _pyramidProj[2][2];
+    cullData->objectCount = objectCount;
+    cullData->occlusionEnabled = _settings.occlusionCulling &&
+                                 _depthPyramidValid;
+    cullData->clusterTaskCount = list.clusterTaskCount;
+    cullData->coneCullingEnabled = _settings.coneCulling;
+
+    vkCmdFillBuffer(cmd, frame.cullStats.handle, 0, sizeof(CullStats), 0);
+    createMemoryBarrier(cmd,
+                        VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                        VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                          VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _cullPipeline);
+    VkDescriptorSet pyramidSet = _depthPyramid.readSet();
+    vkCmdBindDescriptorSets(cmd,
+                            VK_PIPELINE_BIND_POINT_COMPUTE,
+                            _cullPipelineLayout,
+                            0,
+                            1,
+                            &pyramidSet,
+                            0,
+                            nullptr);
+
+    CullPushConstants pc = {
+        .objectsAddress = _device.getBufferAddress(frame.cullObjects),
+        .drawCommandsAddress = _device.getBufferAddress(frame.drawCommands),
+        .instancesAddress = _device.getBufferAddress(frame.instances),
+        .statsAddress = _device.getBufferAddress(frame.cullStats),
+        .cullDataAddress = _device.getBufferAddress(frame.cullData),
+    };
+    vkCmdPushConstants(cmd,
+                       _cullPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT,
+                       0,
+                       sizeof(CullPushConstants),
+                       &pc);
+    vkCmdDispatch(cmd, (objectCount + 63) / 64, 1, 1);
+
+    createMemoryBarrier(cmd,
+                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                          VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+                        VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+                          VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+}
+
+void VulkanRenderer::cullClusters(const VkCommandBuffer& cmd,
+                                  FrameData& frame, const RenderScene& scene)
+{
+    // Runs after cullInstances, which filled the cull data and cleared the
+    // stats. The frame fence was waited on, so the buffers can be replaced.
+    const DrawList& list = _drawList;
+    uint32_t objectCount = static_cast<uint32_t>(
+      list.clusterInstances.size());
+    if (objectCount > frame.clusterObjectCapacity)
+    {
+        uint32_t capacity = std::max(objectCount,
+                                     frame.clusterObjectCapacity * 2);
+        _device.destroyBuffer(frame.clusterObjects);
+        frame.clusterObjects = _device.createBuffer(
+          capacity * sizeof(ClusterObject),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+          MemoryPlacement::DeviceUpload);
+        frame.clusterObjectCapacity = capacity;
+    }
+    if (list.clusterTaskCount > frame.clusterTaskCapacity)
+    {
+        uint32_t capacity = std::max(list.clusterTaskCount,
+                                     frame.clusterTaskCapacity * 2);
+        _device.destroyBuffer(frame.clusterTasks);
+        frame.clusterTasks = _device.createBuffer(
+          capacity * sizeof(ClusterTask),
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+            VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+          MemoryPlacement::DeviceUpload);
+        frame.clusterTaskCapacity = capacity;
+    }
+
+    // Meshlets only change on uploads, every frame keeps its own copy
+    if (frame.meshletVersion != _meshletVersion)
+    {
+        uint32_t meshletCount = static_cast<uint32_t>(_gpuMeshlets.size());
+        if (meshletCount > frame.meshletCapacity)
+        {
+            uint32_t capacity = std::max(meshletCount,
+                                         frame.meshletCapacity * 2);
+            _device.destroyBuffer(frame.meshlets);
+            frame.meshlets = _device.createBuffer(
+              capacity * sizeof(GpuMeshlet),
+              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+              MemoryPlacement::DeviceUpload);
+            frame.meshletCapacity = capacity;
+        }
+        std::memcpy(frame.meshlets.allocationInfo.pMappedData,
+                    _gpuMeshlets.data(),
+                    meshletCount * sizeof(GpuMeshlet));
+        frame.meshletVersion = _meshletVersion;
+    }
+
+    // Every clustered instance gets an instance slot after the regular
+    // ones, and a task per meshlet
+    auto* instances = static_cast<glm::mat4*>(
+      frame.instances.allocationInfo.pMappedData);
+    auto* objects = static_cast<ClusterObject*>(
+      frame.clusterObjects.allocationInfo.pMappedData);
+    auto* tasks = static_cast<ClusterTask*>(
+      frame.clusterTasks.allocationInfo.pMappedData);
+    uint32_t taskCount = 0;
+    for (uint32_t k = 0; k < objectCount; k++)
+    {
+        uint32_t instance = list.clusterInstances[k];
+        MeshHandle handle = scene.meshHandles[scene.instanceMeshes[instance]];
+        if (!_meshResident[handle])
+            continue;
+        const GpuMesh* gpuMesh = &_gpuMeshes[handle];
+
+        uint32_t slot = list.instanceCount + k;
+        uint32_t block = gpuMesh->range.block;
+        instances[slot] = scene.instanceTransforms[instance];
+        objects[k] = {
+            .draw = { .vertexBufferAddress =
+                        _geometryPool.block(block).vertexBufferAddress,
+                      .decode = gpuMesh->decode },
+            .instance = slot,
+            .vertexOffset = gpuMesh->vertexOffset,
+            .firstDraw = list.blockClusterFirstDraw[block],
+            .block = block,
+        };
+        for (uint32_t m = 0; m < gpuMesh->meshletCount; m++)
+            tasks[taskCount++] = { k, gpuMesh->firstMeshlet + m };
+    }
+    assert(taskCount == list.clusterTaskCount);
+
+    vkCmdBindPipeline(
+      cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _clusterCullPipeline);
+    VkDescriptorSet pyramidSet = _depthPyramid.readSet();
+    vkCmdBindDescriptorSets(cmd,
+                            VK_PIPELINE_BIND_POINT_COMPUTE,
+                            _cullPipelineLayout,
+                            0,
+                            1,
+                            &pyramidSet,
+                            0,
+                            nullptr);
+
+    size_t blockCount = list.blockDrawCount.size();
+    ClusterCullPushConstants pc = {
+        .tasksAddress = _device.getBufferAddress(frame.clusterTasks),
+        .objectsAddress = _device.getBufferAddress(frame.clusterObjects),
+        .meshletsAddress = _device.getBufferAddress(frame.meshlets),
+        .drawCommandsAddress = _device.getBufferAddress(frame.drawCommands),
+        .drawDataAddress = _device.getBufferAddress(frame.drawData),
+        .drawCountsAddress = _device.getBufferAddress(frame.drawCounts) +
+                             blockCount * sizeof(uint32_t),
+        .instancesAddress = _device.getBufferAddress(frame.instances),
+        .statsAddress = _device.getBufferAddress(frame.cullStats),
+        .cullDataAddress = _device.getBufferAddress(frame.cullData),
+    };
+    vkCmdPushConstants(cmd,
+                       _cullPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT,
+                       0,
+                       sizeof(ClusterCullPushConstants),
+                       &pc);
+    vkCmdDispatch(cmd, (taskCount + 63) / 64, 1, 1);
+
+    createMemoryBarrier(cmd,
+                        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                        VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                          VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+                        VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+                          VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+}
+
+void VulkanRenderer::recordIndirectDraws(const VkCommandBuffer& cmd,
+                                         FrameData& frame)
+{
+    const DrawList& list = _drawList;
+    if (list.draws.empty() && list.clusterTaskCount == 0)
+        return;
+
+    vkCmdBindPipeline(
+      cmd,
+      VK_PIPELINE_BIND_POINT_GRAPHICS,
+      _pipelines.get(_diffuseIndirectPipeline));
+    VkDeviceAddress drawDataAddress = _device.getBufferAddress(
+      frame.drawData);
+    VkDeviceAddress instancesAddress = _device.getBufferAddress(
+      frame.instances);
+
+    // Regular draws then cluster draws, each range with its own count
+    size_t blockCount = list.blockDrawCount.size();
+    for (uint32_t b = 0; b < blockCount; b++)
+    {
+        const std::pair<uint32_t, uint32_t> ranges[] = {
+            { list.blockFirstDraw[b], list.blockDrawCount[b] },
+            { list.blockClusterFirstDraw[b], list.blockClusterDrawCount[b] },
+        };
+        if (ranges[0].second == 0 && ranges[1].second == 0)
+            continue;
+
+        vkCmdBindIndexBuffer(cmd,
+                             _geometryPool.block(b).indexBuffer.handle,
+                             0,
+                             VK_INDEX_TYPE_UINT32);
+        for (uint32_t r = 0; r < 2; r++)
+        {
+            auto [firstDraw, maxDraws] = ranges[r];
+            if (maxDraws == 0)
+                continue;
+
+            // gl_DrawID restarts at 0 for every call, offset the draw data
+            IndirectPushConstants pc = {
+                .drawDataAddress = drawDataAddress +
+                                   firstDraw * sizeof(DrawData),
+                .instancesAddress = instancesAddress,
+            };
+            vkCmdPushConstants(cmd,
+                               _diffusePipelineLayout,
+                               VK_SHADER_STAGE_VERTEX_BIT,
+                               0,
+                               sizeof(IndirectPushConstants),
+                               &pc);
+            vkCmdDrawIndexedIndirectCount(
+              cmd,
+              frame.drawCommands.handle,
+              firstDraw * sizeof(VkDrawIndexedIndirectCommand),
+              frame.drawCounts.handle,
+              (r * blockCount + b) * sizeof(uint32_t),
+              maxDraws,
+              sizeof(VkDrawIndexedIndirectCommand));
+
+            _stats.drawCalls++;
+        }
     }
-    vkCmdEndRendering(cmd);
 }
 
 void VulkanRenderer::draw(int frameNum,
-                          const std::vector<std::shared_ptr<Mesh>>& scene)
+                          const RenderScene& scene)
 {
+    BALDWIN_PROFILE_ZONE("Draw");
+
     // Wait for GPU to finish rendering
-    vkWaitForFences(_device.handle(),
-                    1,
-                    &getCurrentFrame(frameNum).renderFence,
-                    VK_TRUE,
-                    1000000000);
-
-    // Request swapchain image index that we can blit on
-    uint32_t swapchainImgIndex;
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point waitStart = Clock::now();
+    {
+        BALDWIN_PROFILE_ZONE("Wait for frame fence");
+        vkWaitForFences(_device.handle(),
+                        1,
+                        &getCurrentFrame(frameNum).renderFence,
+                        VK_TRUE,
+                        1000000000);
+    }
+
+    // Request swapchain image index that we can blit on. Headless frames
+    // stay in the draw image.
+    bool present = !_device.headless();
+    uint32_t swapchainImgIndex = 0;
     if (!_swapchain.sane)
+    {
+        _stats.waitMs = std::chrono::duration<double, std::milli>(
+                          Clock::now() - waitStart)
+                          .count();
         return;
+    }
 
-    VkResult r = vkAcquireNextImageKHR(_device.handle(),
-                                       _swapchain.handle(),
-                                       1000000,
-                                       getCurrentFrame(frameNum).swapSemaphore,
-                                       nullptr,
-                                       &swapchainImgIndex);
-
-    if (r == VK_ERROR_OUT_OF_DATE_KHR)
-        _swapchain.sane = false;
-    else if (r != VK_SUCCESS && r != VK_SUBOPTIMAL_KHR)
-        throw(std::runtime_error("Could not acquire swapchain image"));
+    if (present)
+    {
+        VkResult r = vkAcquireNextImageKHR(
+          _device.handle(),
+          _swapchain.handle(),
+          1000000,
+          getCurrentFrame(frameNum).swapSemaphore,
+          nullptr,
+          &swapchainImgIndex);
+
+        if (r == VK_ERROR_OUT_OF_DATE_KHR)
+            _swapchain.sane = false;
+        else if (r != VK_SUCCESS && r != VK_SUBOPTIMAL_KHR)
+            throw(std::runtime_error("Could not acquire swapchain image"));
+    }
+    double waitMs = std::chrono::duration<double, std::milli>(Clock::now() -
+                                                              waitStart)
+                      .count();
 
     _drawExtent.height = std::min(_swapchain.extent().height,
                                   _drawImage.extent.height);
@@ -453,6 +1521,22 @@ void VulkanRenderer::draw(int frameNum,
                                  _drawImage.extent.width);
 
     vkResetFences(_device.handle(), 1, &getCurrentFrame(frameNum).renderFence);
+    _frameAllocator.beginFrame(frameNum % _frameOverlap);
+
+    collectUploads();
+
+    // The culling counters of the last use of this frame are complete now
+    const CullStats& cullStats = *static_cast<CullStats*>(
+      getCurrentFrame(frameNum).cullStats.allocationInfo.pMappedData);
+    _stats = {};
+    _stats.waitMs = waitMs;
+    _stats.visible = cullStats.visible;
+    _stats.frustumCulled = cullStats.frustumCulled;
+    _stats.occlusionCulled = cullStats.occlusionCulled;
+    _stats.clustersVisible = cullStats.clustersVisible;
+    _stats.clustersFrustumCulled = cullStats.clustersFrustumCulled;
+    _stats.clustersBackfaceCulled = cullStats.clustersBackfaceCulled;
+    _stats.clustersOcclusionCulled = cullStats.clustersOcclusionCulled;
 
     // Usual command workflow is : 1. wait / 2. reset / 3. begin / 4. record
     // / 5. submit to queue
@@ -463,20 +1547,32 @@ void VulkanRenderer::draw(int frameNum,
     VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo),
              "Could not begin command recording");
 
-    createImageBarrierWithTransition(cmd,
-                                     _drawImage.handle,
-                                     VK_IMAGE_LAYOUT_UNDEFINED,
-                                     VK_IMAGE_LAYOUT_GENERAL);
+#ifdef BALDWIN_PROFILING
+    // Queries of the last use of this frame are complete as well
+    _gpuProfiler.beginFrame(cmd, frameNum % _frameOverlap);
+    const GpuPipelineStatistics& gpuStatistics = _gpuProfiler.statistics();
+    _stats.vertexInvocations = gpuStatistics.vertexInvocations;
+    _stats.clippingPrimitives = gpuStatistics.clippingPrimitives;
+    _stats.fragmentInvocations = gpuStatistics.fragmentInvocations;
+#endif
 
-    VkClearColorValue clearValue = { 0.1, 0.1, 0.1, 1.0 };
-    VkImageSubresourceRange srcRange = getImageSubresourceRange(
-      VK_IMAGE_ASPECT_COLOR_BIT);
-    vkCmdClearColorImage(cmd,
-                         _drawImage.handle,
-                         VK_IMAGE_LAYOUT_GENERAL,
-                         &clearValue,
-                         1,
-                         &srcRange);
+    {
+        BALDWIN_GPU_ZONE(_gpuProfiler, cmd, "Clear");
+        createImageBarrierWithTransition(cmd,
+                                         _drawImage.handle,
+                                         VK_IMAGE_LAYOUT_UNDEFINED,
+                                         VK_IMAGE_LAYOUT_GENERAL);
+
+        VkClearColorValue clearValue = { 0.1, 0.1, 0.1, 1.0 };
+        VkImageSubresourceRange srcRange = getImageSubresourceRange(
+          VK_IMAGE_ASPECT_COLOR_BIT);
+        vkCmdClearColorImage(cmd,
+                             _drawImage.handle,
+                             VK_IMAGE_LAYOUT_GENERAL,
+                             &clearValue,
+                             1,
+                             &srcRange);
+    }
 
     createImageBarrierWithTransition(cmd,
                                      _drawImage.handle,
@@ -487,47 +1583,107 @@ void VulkanRenderer::draw(int frameNum,
                                      VK_IMAGE_LAYOUT_UNDEFINED,
                                      VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
 
+    // The indirect pipeline may still be compiling on the first frames
+    _indirectDraw = _settings.indirectDraw &&
+                    _pipelines.ready(_diffuseIndirectPipeline);
+
     updateSceneBuffer(cmd);
-    drawObjects(cmd, scene);
+    cullScene(scene);
+#ifdef BALDWIN_PROFILING
+    _gpuProfiler.beginStatistics(cmd);
+#endif
+    {
+        BALDWIN_GPU_ZONE(_gpuProfiler, cmd, "Prepare draws");
+        prepareDraws(cmd, getCurrentFrame(frameNum), scene);
+    }
+    {
+        BALDWIN_GPU_ZONE(_gpuProfiler, cmd, "Main pass");
+        drawObjects(cmd, getCurrentFrame(frameNum), scene);
+    }
+#ifdef BALDWIN_PROFILING
+    _gpuProfiler.endStatistics(cmd);
+#endif
+
+    // Next frame culls against this depth
+    bool buildPyramid = _indirectDraw && _settings.gpuCulling &&
+                        _settings.occlusionCulling;
+    if (buildPyramid)
+    {
+        BALDWIN_GPU_ZONE(_gpuProfiler, cmd, "Depth pyramid");
+        createImageBarrierWithTransition(
+          cmd,
+          _depthImage.handle,
+          VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+          VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+        _depthPyramid.build(cmd, _drawExtent);
+        _pyramidView = _sceneData.view;
+        _pyramidProj = _sceneData.proj;
+        _depthPyramidValid = true;
+    }
 
+    // Left as a transfer source for readFrame when headless
     createImageBarrierWithTransition(cmd,
                                      _drawImage.handle,
                                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
-    createImageBarrierWithTransition(cmd,
-                                     _swapchain.image(swapchainImgIndex),
-                                     VK_IMAGE_LAYOUT_UNDEFINED,
-                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-    copyImageToImage(cmd,
-                     _drawImage.handle,
-                     _swapchain.image(swapchainImgIndex),
-                     _drawExtent,
-                     _swapchain.extent());
+    if (present)
+    {
+        BALDWIN_GPU_ZONE(_gpuProfiler, cmd, "Blit to swapchain");
+        createImageBarrierWithTransition(cmd,
+                                         _swapchain.image(swapchainImgIndex),
+                                         VK_IMAGE_LAYOUT_UNDEFINED,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
 
-    createImageBarrierWithTransition(cmd,
-                                     _swapchain.image(swapchainImgIndex),
-                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                     VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+        copyImageToImage(cmd,
+                         _drawImage.handle,
+                         _swapchain.image(swapchainImgIndex),
+                         _drawExtent,
+                         _swapchain.extent());
+
+        createImageBarrierWithTransition(cmd,
+                                         _swapchain.image(swapchainImgIndex),
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                         VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+    }
 
     VK_CHECK(vkEndCommandBuffer(cmd), "Could not end command recording");
 
     // We finished drawing, time to submit
+    BALDWIN_PROFILE_ZONE("Submit and present");
     VkCommandBufferSubmitInfo cmdSubmitInfo = getCommandBufferSubmitInfo(cmd);
-    VkSemaphoreSubmitInfo waitInfo = getSemaphoreSubmitInfo(
-      VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
-      getCurrentFrame(frameNum).swapSemaphore);
+    VkSemaphoreSubmitInfo waitInfos[] = {
+        getSemaphoreSubmitInfo(
+          VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+          getCurrentFrame(frameNum).swapSemaphore),
+        // Already signaled by the time we get here, this only makes the
+        // retired uploads visible to the graphics queue
+        getSemaphoreSubmitInfo(VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT |
+                                 VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+                               _uploader.timeline()),
+    };
+    waitInfos[1].value = _uploadedValue;
     VkSemaphoreSubmitInfo signalInfo = getSemaphoreSubmitInfo(
       VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR,
       getCurrentFrame(frameNum).renderSemaphore);
     VkSubmitInfo2 submitInfo = getSubmitInfo(
-      &cmdSubmitInfo, &signalInfo, &waitInfo);
+      &cmdSubmitInfo, &signalInfo, waitInfos);
+    submitInfo.waitSemaphoreInfoCount = _uploadedValue > 0 ? 2 : 1;
+    if (!present)
+    {
+        // No swapchain image to wait for, no present to signal
+        submitInfo.pWaitSemaphoreInfos = waitInfos + 1;
+        submitInfo.waitSemaphoreInfoCount--;
+        submitInfo.signalSemaphoreInfoCount = 0;
+    }
 
     VK_CHECK(vkQueueSubmit2(_device.graphicsQueue(),
                             1,
                             &submitInfo,
                             getCurrentFrame(frameNum).renderFence),
              "Could not submit graphics commands to queue");
+    _frameDrawn = true;
+    if (!present)
+        return;
 
     // We wait for rendering operations to finish and we
     // present
@@ -542,7 +1698,7 @@ void VulkanRenderer::draw(int frameNum,
         .pImageIndices = &swapchainImgIndex
     };
 
-    r = vkQueuePresentKHR(_device.presentQueue(), &presentInfo);
+    VkResult r = vkQueuePresentKHR(_device.presentQueue(), &presentInfo);
     if (r == VK_ERROR_OUT_OF_DATE_KHR)
         _swapchain.sane = false;
     else if (r != VK_SUCCESS && r != VK_SUBOPTIMAL_KHR)
@@ -550,11 +1706,77 @@ void VulkanRenderer::draw(int frameNum,
 }
 
 void VulkanRenderer::render(int frameNum,
-                            const std::vector<std::shared_ptr<Mesh>>& scene)
+                            const RenderScene& scene)
 {
     draw(frameNum, scene);
 }
 
+FrameCapture VulkanRenderer::readFrame()
+{
+    FrameCapture capture{};
+    if (!_frameDrawn)
+        return capture;
+
+    // The last submitted frame left the draw image as a transfer source
+    vkDeviceWaitIdle(_device.handle());
+    VkExtent2D extent = _drawExtent;
+    capture.width = extent.width;
+    capture.height = extent.height;
+
+    // Blitting converts the HDR draw image to 8 bit on the GPU
+    Image target = _device.createImage(
+      { extent.width, extent.height, 1 },
+      VK_FORMAT_R8G8B8A8_UNORM,
+      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    Buffer readback = _device.createBuffer(
+      static_cast<size_t>(extent.width) * extent.height * 4,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      MemoryPlacement::Readback);
+
+    _device.immediateSubmit(
+      [&](VkCommandBuffer cmd)
+      {
+          createImageBarrierWithTransition(
+            cmd,
+            target.handle,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+          copyImageToImage(cmd, _drawImage.handle, target.handle, extent,
+                           extent);
+          createImageBarrierWithTransition(
+            cmd,
+            target.handle,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+          VkBufferImageCopy region = {
+              .imageSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                    .layerCount = 1 },
+              .imageExtent = { extent.width, extent.height, 1 },
+          };
+          vkCmdCopyImageToBuffer(cmd,
+                                 target.handle,
+                                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                 readback.handle,
+                                 1,
+                                 &region);
+          createMemoryBarrier(cmd,
+                              VK_PIPELINE_STAGE_2_TRANSFER_BIT,
+                              VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_2_HOST_BIT,
+                              VK_ACCESS_2_HOST_READ_BIT);
+      });
+
+    const uint8_t* pixels = static_cast<const uint8_t*>(
+      readback.allocationInfo.pMappedData);
+    capture.pixels.assign(
+      pixels, pixels + static_cast<size_t>(extent.width) * extent.height * 4);
+
+    _device.destroyBuffer(readback);
+    _device.destroyImage(target);
+    return capture;
+}
+
 VulkanRenderer::~VulkanRenderer()
 {
 #ifndef NDEBUG
@@ -565,14 +1787,6 @@ VulkanRenderer::~VulkanRenderer()
     {
         frame.deletionQueue.flush();
     }
-    while (!_meshBuffersMap.empty())
-    {
-        auto it = _meshBuffersMap
-                    .begin(); // Always pick the first available element
-        _device.destroyBuffer(it->second.vertexBuffer);
-        _device.destroyBuffer(it->second.indexBuffer);
-        _meshBuffersMap.erase(it);
-    }
     _deletionQueue.flush();
 }
 
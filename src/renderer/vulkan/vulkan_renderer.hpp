@@ -15,7 +15,15 @@
 #include "vulkan_swapchain.hpp"
 #include "vulkan_device.hpp"
 #include "vulkan_types.hpp"
+#include "vulkan_upload.hpp"
+#include "vulkan_geometry_pool.hpp"
+#include "vulkan_bindless.hpp"
+#include "vulkan_frame_allocator.hpp"
+#include "vulkan_depth_pyramid.hpp"
+#include "vulkan_pipeline_registry.hpp"
+#include "vulkan_profiler.hpp"
 #include "renderer/render_types.hpp"
+#include "utils/job_system.hpp"
 
 namespace baldwin
 {
@@ -30,36 +38,145 @@ struct FrameData
     VkSemaphore swapSemaphore = VK_NULL_HANDLE;
     VkSemaphore renderSemaphore = VK_NULL_HANDLE;
     DeletionQueue deletionQueue = {};
+
+    // Parallel recording, one pool and secondary buffer per job thread
+    std::vector<VkCommandPool> recordPools;
+    std::vector<VkCommandBuffer> secondaryCommandBuffers;
+
+    // Draw inputs, written by the CPU or by the culling pass
+    Buffer drawCommands{};
+    Buffer drawData{};
+    Buffer drawCounts{};
+    Buffer instances{}; // world matrices in draw order
+    uint32_t drawCapacity = 0;
+    uint32_t drawCountCapacity = 0;
+    uint32_t instanceCapacity = 0;
+
+    // Culling pass inputs and counters
+    Buffer cullObjects{};
+    Buffer cullData{};
+    Buffer cullStats{};
+
+    // Cluster culling inputs. The meshlets are a copy of _gpuMeshlets,
+    // refreshed when meshletVersion falls behind.
+    Buffer clusterObjects{};
+    Buffer clusterTasks{};
+    Buffer meshlets{};
+    uint32_t clusterObjectCapacity = 0;
+    uint32_t clusterTaskCapacity = 0;
+    uint32_t meshletCapacity = 0;
+    uint64_t meshletVersion = 0;
+};
+
+// One draw per visible mesh covering all its visible instances
+struct DrawItem
+{
+    uint32_t lod; // meshFirstLod[mesh] + level in DrawList
+    GpuMesh gpuMesh;
+    // Indices of the level in its pool block
+    uint32_t firstIndex = 0;
+    uint32_t indexCount = 0;
+    uint32_t instanceCount = 0;
+    uint32_t firstInstance = 0;
+};
+
+// The draws of a frame, sorted per geometry pool block. Vectors are kept
+// between frames to avoid reallocating them.
+struct DrawList
+{
+    std::vector<DrawItem> draws;
+    std::vector<DrawItem> unsortedDraws;
+    // Every level of every mesh has a slot, meshes without LODs have one
+    std::vector<uint32_t> meshFirstLod;
+    std::vector<uint32_t> lodInstanceCount; // 0 when the level is not drawn
+    std::vector<uint32_t> lodDraw;
+    // Slot picked by each of the visible instances
+    std::vector<uint32_t> visibleLods;
+    std::vector<uint32_t> blockFirstDraw;
+    std::vector<uint32_t> blockDrawCount;
+    std::vector<uint32_t> cursor;
+    uint32_t instanceCount = 0;
+
+    // Full detail instances of meshes with meshlets are culled and drawn
+    // cluster by cluster when meshClustered, their visibleLods is ClusterLod
+    std::vector<uint8_t> meshClustered;
+    std::vector<uint32_t> meshClusterInstances;
+    std::vector<uint32_t> clusterInstances;
+    // Room for a draw per meshlet of those, after the regular draws
+    std::vector<uint32_t> blockClusterFirstDraw;
+    std::vector<uint32_t> blockClusterDrawCount;
+    uint32_t clusterTaskCount = 0;
 };
 
+constexpr uint32_t ClusterLod = UINT32_MAX;
+
 class VulkanRenderer : public Renderer
 {
   public:
     VulkanRenderer(GLFWwindow* window, int width, int height,
-                   bool tripleBuffering = false);
+                   JobSystem& jobs, const RendererSettings& settings = {});
     ~VulkanRenderer() override;
     VulkanRenderer(const VulkanRenderer&) = delete;
     VulkanRenderer& operator=(const VulkanRenderer&) = delete;
 
     void resizeSwapchain(int width, int height) override;
-    void uploadMesh(const std::shared_ptr<Mesh> mesh) override;
-    void render(int frameNum,
-                const std::vector<std::shared_ptr<Mesh>>& scene) override;
+    const RenderStats& stats() const override { return _stats; }
+    MeshHandle uploadMesh(const Mesh& mesh) override;
+    MeshHandle uploadMeshData(const std::string& uuid,
+                              std::span<const Vertex> vertices,
+                              std::span<const uint32_t> indices,
+                              VertexFormat format) override;
+    void waitForUploads() override;
+    void render(int frameNum, const RenderScene& scene) override;
+    FrameCapture readFrame() override;
 
   private:
     void initCommands();
+    void initUploads();
     void initSync();
+    void initDrawBuffers();
     void initRenderTargets();
     void initDefaultData();
     void initSceneDescriptors();
+    void initBindless();
     void initDiffusePipeline();
+    void initCulling();
+    void initProfiling();
+    MeshHandle uploadGeometry(const std::string& uuid,
+                              std::span<const Vertex> vertices,
+                              std::span<const uint32_t> indices,
+                              VertexFormat format,
+                              std::span<const MeshLod> lods,
+                              std::span<const Meshlet> meshlets);
+    void collectUploads();
     void updateSceneBuffer(const VkCommandBuffer& cmd);
-    void drawObjects(const VkCommandBuffer& cmd,
-                     const std::vector<std::shared_ptr<Mesh>>& scene);
-    void draw(int frameNum, const std::vector<std::shared_ptr<Mesh>>& scene);
+    void updateSceneDescriptors();
+    void cullScene(const RenderScene& scene);
+    void buildDrawList(const RenderScene& scene);
+    void reserveDrawBuffers(FrameData& frame, uint32_t drawCount,
+                            uint32_t instanceCount, uint32_t blockCount);
+    void prepareDraws(const VkCommandBuffer& cmd, FrameData& frame,
+                      const RenderScene& scene);
+    void cullInstances(const VkCommandBuffer& cmd, FrameData& frame,
+                       const RenderScene& scene);
+    void cullClusters(const VkCommandBuffer& cmd, FrameData& frame,
+                      const RenderScene& scene);
+    void drawObjects(const VkCommandBuffer& cmd, FrameData& frame,
+                     const RenderScene& scene);
+    void setDrawState(const VkCommandBuffer& cmd);
+    void recordParallelDraws(const VkCommandBuffer& cmd, FrameData& frame);
+    // Records draws [firstDraw, firstDraw + drawCount) of the draw list and
+    // returns the number of draw calls. Safe to call from several threads.
+    uint32_t recordDirectDraws(const VkCommandBuffer& cmd, FrameData& frame,
+                               size_t firstDraw, size_t drawCount);
+    void recordIndirectDraws(const VkCommandBuffer& cmd, FrameData& frame);
+    void draw(int frameNum, const RenderScene& scene);
 
+    RendererSettings _settings;
     VulkanDevice _device;
     VulkanSwapchain _swapchain;
+    JobSystem& _jobs;
+    std::vector<uint32_t> _sliceDrawCalls;
     DeletionQueue _deletionQueue{};
     Image _drawImage{};
     Image _depthImage{};
@@ -67,12 +184,58 @@ class VulkanRenderer : public Renderer
 
     DescriptorManager _descriptorManager{};
     VkDescriptorSetLayout _sceneLayout = VK_NULL_HANDLE;
-    VkDescriptorSet _sceneSet = VK_NULL_HANDLE;
-    VkPipeline _diffusePipeline = VK_NULL_HANDLE;
+    TrackedDescriptorSet _sceneSet{};
+    DescriptorWriter _sceneWriter{}; // reused, see updateSceneDescriptors
+    BindlessHeap _bindless{};
+    VkSampler _linearSampler = VK_NULL_HANDLE;
+    VkSampler _nearestSampler = VK_NULL_HANDLE;
+    PipelineRegistry _pipelines{};
+    PipelineHandle _diffusePipeline = InvalidPipeline;
+    PipelineHandle _diffuseIndirectPipeline = InvalidPipeline;
+    // Indirect drawing was requested and its pipeline is ready
+    bool _indirectDraw = false;
     VkPipelineLayout _diffusePipelineLayout = VK_NULL_HANDLE;
 
-    Buffer _sceneUniformBuffer{};
-    std::unordered_map<std::string, MeshBuffers> _meshBuffersMap;
+    FrameAllocator _frameAllocator{};
+    uint32_t _sceneOffset = 0; // dynamic offset of this frame's SceneData
+    SceneData _sceneData{};
+    GeometryPool _geometryPool{};
+    // Indexed by MeshHandle, the uuids are only looked up by uploads
+    std::unordered_map<std::string, MeshHandle> _meshHandles;
+    std::vector<GpuMesh> _gpuMeshes;
+    std::vector<uint8_t> _meshResident;
+    std::vector<MeshLod> _meshLods; // ranges of GpuMesh
+
+    // Meshes wait here until the upload batch holding their data retires
+    struct PendingMesh
+    {
+        MeshHandle mesh;
+        uint64_t uploadValue;
+    };
+    UploadManager _uploader{};
+    std::vector<PendingMesh> _pendingMeshes;
+    std::vector<CompactVertex> _compactVertices; // reused by uploadMeshData
+    // Meshlets of every uploaded mesh, copied to the frames when they change
+    std::vector<GpuMeshlet> _gpuMeshlets;
+    uint64_t _meshletVersion = 0;
+    uint64_t _uploadedValue = 0;
+
+    VkPipeline _cullPipeline = VK_NULL_HANDLE;
+    VkPipeline _clusterCullPipeline = VK_NULL_HANDLE;
+    VkPipelineLayout _cullPipelineLayout = VK_NULL_HANDLE; // both pipelines
+    DepthPyramid _depthPyramid{};
+    // Camera of the frame the pyramid was built from, invalid until then
+    bool _depthPyramidValid = false;
+    glm::mat4 _pyramidView{ 1.0f };
+    glm::mat4 _pyramidProj{ 1.0f };
+
+    GpuProfiler _gpuProfiler{};
+    bool _frameDrawn = false; // readFrame has something to copy
+    RenderStats _stats{};
+    // Indices of the scene instances that passed the CPU culling
+    std::vector<uint32_t> _visibleInstances;
+    std::vector<size_t> _chunkVisibleCounts;
+    DrawList _drawList;
 
     int _frameOverlap = 2;
     std::vector<FrameData> _frames{};
@@ -19,6 +19,15 @@ void VulkanSwapchain::createSwapchain(int width, int height)
 {
     _format = VK_FORMAT_B8G8R8A8_UNORM;
 
+    // Only the extent is kept, frames stay in the draw image
+    if (_device.headless())
+    {
+        _extent = { static_cast<uint32_t>(width),
+                    static_cast<uint32_t>(height) };
+        sane = true;
+        return;
+    }
+
     vkb::SwapchainBuilder swapchainBuilder{ _device.physicalDevice(),
                                             _device.handle(),
                                             _device.surface() };
@@ -49,13 +58,16 @@ void VulkanSwapchain::destroySwapchain()
     {
         vkDestroyImageView(_device.handle(), imgView, nullptr);
     }
+    _imageViews.clear();
+    _images.clear();
     vkDestroySwapchainKHR(_device.handle(), _swapchain, nullptr);
+    _swapchain = VK_NULL_HANDLE;
 }
 
 void VulkanSwapchain::reconstruct(int width, int height)
 {
     assert(_device.handle() != VK_NULL_HANDLE);
-    assert(_swapchain != VK_NULL_HANDLE &&
+    assert((_swapchain != VK_NULL_HANDLE || _device.headless()) &&
            "Resize swapchain called before creation");
 
     vkDeviceWaitIdle(_device.handle());
@@ -2,6 +2,9 @@
 
 #include <vulkan/vulkan.h>
 #include <vk_mem_alloc.h>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 
 namespace baldwin
@@ -9,11 +12,27 @@ namespace baldwin
 namespace vk
 {
 
+// Where a buffer lives and how the CPU reaches it
+enum class MemoryPlacement
+{
+    // Device local and never mapped, filled through the upload manager
+    GpuOnly,
+    // Host visible and mapped, written sequentially by the CPU
+    Upload,
+    // Host visible and mapped, cached for CPU reads
+    Readback,
+    // Mapped device local memory when the whole VRAM is host visible
+    // (ReBAR), host memory otherwise. Meant for small data the CPU rewrites
+    // every frame.
+    DeviceUpload,
+};
+
 struct Buffer
 {
     VkBuffer handle = VK_NULL_HANDLE;
     VmaAllocation allocation = VK_NULL_HANDLE;
     VmaAllocationInfo allocationInfo = {};
+    VkMemoryPropertyFlags memoryFlags = 0;
 };
 
 struct Image
@@ -25,17 +44,159 @@ struct Image
     VkFormat format = VK_FORMAT_UNDEFINED;
 };
 
-struct MeshBuffers
+// Where a mesh lives inside the geometry pool, indices are relative to the
+// first vertex of the mesh
+struct GeometryRange
 {
-    Buffer vertexBuffer;
-    Buffer indexBuffer;
-    VkDeviceAddress vertexBufferAddress;
+    uint32_t block;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    int32_t vertexOffset;
+    uint32_t vertexCount;
+};
+
+// How the vertex shaders read the vertices of a mesh. Matches VertexDecode
+// in vertex.glsl.
+struct alignas(16) VertexDecode
+{
+    glm::vec3 positionOffset{ 0.0f };
+    uint32_t format = 0; // VertexFormat
+    glm::vec3 positionScale{ 1.0f };
+    uint32_t pad = 0;
+};
+static_assert(sizeof(VertexDecode) == 32);
+
+// A mesh resident in the geometry pool
+struct GpuMesh
+{
+    GeometryRange range;
+    // First vertex in units of the vertex format of the mesh, what draws
+    // pass as their vertex offset. Compact vertices are packed several per
+    // pool slot.
+    int32_t vertexOffset = 0;
+    VertexDecode decode{};
+    // Range of VulkanRenderer::_gpuMeshlets, empty unless the mesh was
+    // split into meshlets at import
+    uint32_t firstMeshlet = 0;
+    uint32_t meshletCount = 0;
+    // Range of VulkanRenderer::_meshLods, empty without LODs
+    uint32_t firstLod = 0;
+    uint32_t lodCount = 0;
+};
+
+// A meshlet of a resident mesh. Matches Meshlet in cluster_cull.comp.glsl.
+struct alignas(16) GpuMeshlet
+{
+    glm::vec4 boundingSphere; // object space
+    glm::vec4 cone;           // axis and cutoff, see Meshlet
+    uint32_t firstIndex;      // in the index buffer of its pool block
+    uint32_t indexCount;
+    uint32_t pad[2];
 };
+static_assert(sizeof(GpuMeshlet) == 48);
 
+// The world matrix of every drawn instance sits in a per frame buffer,
+// read with gl_InstanceIndex
 struct RasterizePushConstants
 {
-    glm::mat4x4 worldMatrix;
     VkDeviceAddress vertexBufferAddress;
+    VkDeviceAddress instancesAddress;
+    VertexDecode decode;
+};
+
+// Per draw data of the indirect path, read with gl_DrawID. Matches the std430
+// layout of DrawData in diffuse_indirect.vert.glsl.
+struct DrawData
+{
+    VkDeviceAddress vertexBufferAddress;
+    VertexDecode decode;
+};
+static_assert(sizeof(DrawData) == 48);
+
+struct IndirectPushConstants
+{
+    VkDeviceAddress drawDataAddress;
+    VkDeviceAddress instancesAddress;
+};
+
+// GPU culling, these match the std430 structs of cull.comp.glsl.
+// One object per instance, visible ones bump the instance count of their
+// draw and copy their world matrix to the instance slot it gives them.
+struct alignas(16) CullObject
+{
+    glm::mat4x4 worldMatrix;
+    glm::vec4 boundingSphere; // world space
+    uint32_t drawIndex;
+    uint32_t pad[3];
+};
+static_assert(sizeof(CullObject) == 96);
+
+struct alignas(16) CullData
+{
+    glm::vec4 frustumPlanes[6];
+    glm::vec4 cameraPosition; // w unused
+    // Camera the depth pyramid was rendered with
+    glm::mat4x4 pyramidView;
+    glm::vec4 pyramidProj; // P00, P11, P22, P32
+    glm::vec2 pyramidSize;
+    float znear;
+    uint32_t objectCount;
+    uint32_t occlusionEnabled;
+    uint32_t clusterTaskCount;
+    uint32_t coneCullingEnabled;
+};
+
+struct CullStats
+{
+    uint32_t visible;
+    uint32_t frustumCulled;
+    uint32_t occlusionCulled;
+    uint32_t clustersVisible;
+    uint32_t clustersFrustumCulled;
+    uint32_t clustersBackfaceCulled;
+    uint32_t clustersOcclusionCulled;
+};
+
+struct CullPushConstants
+{
+    VkDeviceAddress objectsAddress;
+    VkDeviceAddress drawCommandsAddress;
+    VkDeviceAddress instancesAddress;
+    VkDeviceAddress statsAddress;
+    VkDeviceAddress cullDataAddress;
+};
+
+// Cluster culling, these match cluster_cull.comp.glsl. Instances drawn
+// cluster by cluster get one object, and one task per meshlet. Visible
+// meshlets append a draw of their own to the cluster draws of their block,
+// which read the world matrix the CPU wrote at the instance slot.
+struct alignas(16) ClusterObject
+{
+    DrawData draw;
+    uint32_t instance;
+    int32_t vertexOffset;
+    uint32_t firstDraw; // first cluster draw of its block
+    uint32_t block;
+};
+static_assert(sizeof(ClusterObject) == 64);
+
+struct ClusterTask
+{
+    uint32_t object;
+    uint32_t meshlet; // in the meshlet buffer
+};
+
+struct ClusterCullPushConstants
+{
+    VkDeviceAddress tasksAddress;
+    VkDeviceAddress objectsAddress;
+    VkDeviceAddress meshletsAddress;
+    VkDeviceAddress drawCommandsAddress;
+    VkDeviceAddress drawDataAddress;
+    VkDeviceAddress drawCountsAddress; // the cluster counts
+    VkDeviceAddress instancesAddress;
+    VkDeviceAddress statsAddress;
+    VkDeviceAddress cullDataAddress;
 };
 
 } // namespace vk
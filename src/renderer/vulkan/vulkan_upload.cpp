@@ -0,0 +1,237 @@
+#include "vulkan_upload.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "vulkan_infos.hpp"
+#include "vulkan_utils.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+constexpr size_t UploadAlignment = 16;
+
+void UploadManager::init(VulkanDevice& device, size_t ringSize)
+{
+    _device = &device;
+
+    VkCommandPoolCreateInfo poolInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        .queueFamilyIndex = device.queueFamilies().transfer
+    };
+    VK_CHECK(vkCreateCommandPool(
+               device.handle(), &poolInfo, nullptr, &_commandPool),
+             "Could not create upload command pool");
+
+    VkSemaphoreTypeCreateInfo timelineInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0,
+    };
+    VkSemaphoreCreateInfo semaphoreInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &timelineInfo,
+    };
+    VK_CHECK(
+      vkCreateSemaphore(device.handle(), &semaphoreInfo, nullptr, &_timeline),
+      "Could not create upload timeline semaphore");
+
+    _ringSize = ringSize;
+    _ring = device.createBuffer(
+      ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryPlacement::Upload);
+}
+
+void UploadManager::destroy()
+{
+    // Copies that never got submitted are dropped, their destinations are
+    // going away along with us
+    if (_pending.cmd != VK_NULL_HANDLE)
+    {
+        for (Buffer& staging : _pending.dedicatedStaging)
+            _device->destroyBuffer(staging);
+        _freeCommandBuffers.push_back(_pending.cmd);
+        _pending = {};
+    }
+
+    wait(_submittedValue);
+    retire(_submittedValue);
+
+    vkDestroySemaphore(_device->handle(), _timeline, nullptr);
+    if (!_freeCommandBuffers.empty())
+    {
+        vkFreeCommandBuffers(_device->handle(),
+                             _commandPool,
+                             static_cast<uint32_t>(_freeCommandBuffers.size()),
+                             _freeCommandBuffers.data());
+    }
+    vkDestroyCommandPool(_device->handle(), _commandPool, nullptr);
+    _device->destroyBuffer(_ring);
+}
+
+uint64_t UploadManager::enqueue(VkBuffer dst, VkDeviceSize dstOffset,
+                                const void* data, size_t size)
+{
+    if (_pending.cmd == VK_NULL_HANDLE)
+        beginBatch();
+
+    VkBufferCopy copy = { .dstOffset = dstOffset, .size = size };
+    if (size > _ringSize)
+    {
+        // Would never fit in the ring, give it its own staging buffer
+        Buffer staging = _device->createBuffer(
+          size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryPlacement::Upload);
+        memcpy(staging.allocation->GetMappedData(), data, size);
+        vkCmdCopyBuffer(_pending.cmd, staging.handle, dst, 1, &copy);
+        _pending.dedicatedStaging.push_back(staging);
+    }
+    else
+    {
+        copy.srcOffset = allocate(size);
+        memcpy(static_cast<char*>(_ring.allocation->GetMappedData()) +
+                 copy.srcOffset,
+               data,
+               size);
+        vkCmdCopyBuffer(_pending.cmd, _ring.handle, dst, 1, &copy);
+    }
+
+    return _submittedValue + 1;
+}
+
+size_t UploadManager::allocate(size_t size)
+{
+    size = (size + UploadAlignment - 1) / UploadAlignment * UploadAlignment;
+
+    while (true)
+    {
+        if (_ringUsed == 0)
+            _ringHead = 0;
+
+        // The ring is consumed and released in order, so the only free
+        // space is after the head, possibly wrapping around to the start
+        size_t wasted = _ringHead + size > _ringSize ? _ringSize - _ringHead
+                                                     : 0;
+        if (_ringUsed + wasted + size <= _ringSize)
+        {
+            if (wasted)
+                _ringHead = 0;
+            size_t offset = _ringHead;
+            _ringHead = (_ringHead + size) % _ringSize;
+            _ringUsed += wasted + size;
+            _pending.ringBytes += wasted + size;
+            return offset;
+        }
+
+        // Only the pending batch holds ring space, ship it to make room and
+        // carry on recording in a fresh batch
+        if (_inFlight.empty())
+        {
+            submit();
+            beginBatch();
+        }
+
+        // Block on the oldest batch, this only happens when uploads outpace
+        // the transfer queue by a full ring
+        wait(_inFlight.front().value);
+        retire(_inFlight.front().value);
+    }
+}
+
+void UploadManager::beginBatch()
+{
+    if (_freeCommandBuffers.empty())
+    {
+        VkCommandBufferAllocateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = _commandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1,
+        };
+        VkCommandBuffer cmd;
+        VK_CHECK(
+          vkAllocateCommandBuffers(_device->handle(), &bufferInfo, &cmd),
+          "Could not allocate upload command buffer");
+        _freeCommandBuffers.push_back(cmd);
+    }
+
+    _pending.cmd = _freeCommandBuffers.back();
+    _freeCommandBuffers.pop_back();
+
+    VK_CHECK(vkResetCommandBuffer(_pending.cmd, 0),
+             "Could not reset upload command buffer");
+    VkCommandBufferBeginInfo beginInfo = getCommandBufferBeginInfo(
+      VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK(vkBeginCommandBuffer(_pending.cmd, &beginInfo),
+             "Could not begin upload command buffer");
+}
+
+void UploadManager::submit()
+{
+    if (_pending.cmd == VK_NULL_HANDLE)
+        return;
+
+    VK_CHECK(vkEndCommandBuffer(_pending.cmd),
+             "Could not end upload command buffer");
+
+    _pending.value = ++_submittedValue;
+
+    VkCommandBufferSubmitInfo cmdInfo = getCommandBufferSubmitInfo(
+      _pending.cmd);
+    VkSemaphoreSubmitInfo signalInfo = getSemaphoreSubmitInfo(
+      VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, _timeline);
+    signalInfo.value = _pending.value;
+    VkSubmitInfo2 submitInfo = getSubmitInfo(&cmdInfo, &signalInfo, nullptr);
+
+    VK_CHECK(vkQueueSubmit2(
+               _device->transferQueue(), 1, &submitInfo, VK_NULL_HANDLE),
+             "Could not submit upload batch");
+
+    _inFlight.push_back(std::move(_pending));
+    _pending = {};
+}
+
+uint64_t UploadManager::completedValue()
+{
+    uint64_t value = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(_device->handle(), _timeline, &value),
+             "Could not read upload timeline semaphore");
+    retire(value);
+    return _completedValue;
+}
+
+void UploadManager::wait(uint64_t value)
+{
+    if (value <= _completedValue)
+        return;
+
+    VkSemaphoreWaitInfo waitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &_timeline,
+        .pValues = &value,
+    };
+    VK_CHECK(vkWaitSemaphores(_device->handle(), &waitInfo, UINT64_MAX),
+             "Could not wait for upload timeline semaphore");
+}
+
+void UploadManager::retire(uint64_t completed)
+{
+    assert(completed <= _submittedValue);
+
+    while (!_inFlight.empty() && _inFlight.front().value <= completed)
+    {
+        Batch& batch = _inFlight.front();
+        _ringUsed -= batch.ringBytes;
+        for (Buffer& staging : batch.dedicatedStaging)
+            _device->destroyBuffer(staging);
+        _freeCommandBuffers.push_back(batch.cmd);
+        _inFlight.pop_front();
+    }
+    _completedValue = std::max(_completedValue, completed);
+}
+
+} // namespace vk
+} // namespace baldwin
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+#include "vulkan_device.hpp"
+#include "vulkan_types.hpp"
+
+namespace baldwin
+{
+namespace vk
+{
+
+// Streams data to GPU buffers through a persistently mapped ring staging
+// buffer. Copies are recorded into batches that are submitted on the transfer
+// queue and retired through a timeline semaphore, so nothing ever blocks
+// unless the ring runs out of space.
+class UploadManager
+{
+  public:
+    void init(VulkanDevice& device, size_t ringSize);
+    void destroy();
+
+    // Copies size bytes of data into dst at dstOffset. The returned value is
+    // reached by the timeline semaphore once the copy is done.
+    uint64_t enqueue(VkBuffer dst, VkDeviceSize dstOffset, const void* data,
+                     size_t size);
+
+    // Submits every copy enqueued since the last submit
+    void submit();
+    // Value the last submitted batch signals
+    uint64_t submittedValue() const { return _submittedValue; }
+
+    // Polls the timeline semaphore and recycles retired batches
+    uint64_t completedValue();
+    void wait(uint64_t value);
+
+    VkSemaphore timeline() { return _timeline; }
+
+  private:
+    struct Batch
+    {
+        uint64_t value = 0;
+        VkCommandBuffer cmd = VK_NULL_HANDLE;
+        size_t ringBytes = 0;
+        std::vector<Buffer> dedicatedStaging;
+    };
+
+    size_t allocate(size_t size);
+    void beginBatch();
+    void retire(uint64_t completed);
+
+    VulkanDevice* _device = nullptr;
+    VkCommandPool _commandPool = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> _freeCommandBuffers;
+    VkSemaphore _timeline = VK_NULL_HANDLE;
+    uint64_t _submittedValue = 0;
+    uint64_t _completedValue = 0;
+
+    Buffer _ring{};
+    size_t _ringSize = 0;
+    size_t _ringHead = 0;
+    size_t _ringUsed = 0;
+
+    Batch _pending{};
+    std::deque<Batch> _inFlight;
+};
+
+} // namespace vk
+} // namespace baldwin
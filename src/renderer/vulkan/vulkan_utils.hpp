@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdio>
 #include <stdexcept>
 #include <vulkan/vk_enum_string_helper.h>
 
@@ -9,7 +10,8 @@
         VkResult err = x;                                                      \
         if (err != VK_SUCCESS)                                                 \
         {                                                                      \
-            printf("Detected Vulkan error: %s | ", string_VkResult(err));      \
+            fprintf(                                                           \
+              stderr, "Detected Vulkan error: %s | ", string_VkResult(err));   \
             throw std::runtime_error(message);                                 \
         }                                                                      \
     } while (0)
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace baldwin
+{
+
+constexpr uint64_t FNV1aSeed = 0xcbf29ce484222325ull;
+
+// 64 bit FNV-1a, pass the previous result as seed to hash data in chunks
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t seed = FNV1aSeed)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+} // namespace baldwin
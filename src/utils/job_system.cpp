@@ -0,0 +1,245 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+#include "profiler.hpp"
+
+namespace baldwin
+{
+
+namespace
+{
+
+// Identifies the worker threads, any thread foreign to a system shares the
+// queue of thread 0
+thread_local const JobSystem* currentSystem = nullptr;
+thread_local unsigned int currentIndex = 0;
+
+} // namespace
+
+JobSystem::JobSystem(unsigned int threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < threadCount; i++)
+        _queues.push_back(std::make_unique<Queue>());
+    for (unsigned int i = 1; i < threadCount; i++)
+        _workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+unsigned int JobSystem::currentThread() const
+{
+    return currentSystem == this ? currentIndex : 0;
+}
+
+void JobSystem::push(Job job)
+{
+    // Counted first so the count never drops below the queued jobs
+    _queuedJobs.fetch_add(1, std::memory_order_release);
+    Queue& queue = *_queues[currentThread()];
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+
+    // Taking the lock orders us after a worker that just found nothing to
+    // do, so it is either awake or receives the notification
+    {
+        std::lock_guard lock(_sleepMutex);
+    }
+    _sleepCondition.notify_one();
+}
+
+bool JobSystem::pop(unsigned int thread, Job& job)
+{
+    // Newest local job first
+    {
+        Queue& queue = *_queues[thread];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            _queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Then the oldest job of another thread, which tends to be the biggest
+    // piece of work it has left
+    for (size_t i = 1; i < _queues.size(); i++)
+    {
+        Queue& queue = *_queues[(thread + i) % _queues.size()];
+        std::lock_guard lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            _queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::runOne(unsigned int thread)
+{
+    Job job;
+    if (!pop(thread, job))
+        return false;
+
+    job.function();
+    finish(job.counter);
+    return true;
+}
+
+void JobSystem::finish(JobCounter* counter)
+{
+    if (!counter)
+        return;
+
+    // Decrements that cannot be the last one skip the lock
+    uint32_t pending = counter->_pending.load(std::memory_order_relaxed);
+    while (pending > 1)
+    {
+        if (counter->_pending.compare_exchange_weak(
+              pending,
+              pending - 1,
+              std::memory_order_acq_rel,
+              std::memory_order_relaxed))
+        {
+            return;
+        }
+    }
+
+    // The last decrement and the continuations are taken under the lock,
+    // which wait() takes before returning, so the owner of the counter can
+    // not destroy it meanwhile
+    std::vector<Job> continuations;
+    {
+        std::lock_guard lock(counter->_mutex);
+        if (counter->_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            continuations.swap(counter->_continuations);
+    }
+    for (Job& job : continuations)
+        push(std::move(job));
+}
+
+void JobSystem::run(std::function<void()> function, JobCounter* counter)
+{
+    if (counter)
+        counter->_pending.fetch_add(1, std::memory_order_relaxed);
+    push({ .function = std::move(function), .counter = counter });
+}
+
+void JobSystem::then(JobCounter& dependency, std::function<void()> function,
+                     JobCounter* counter)
+{
+    if (counter)
+        counter->_pending.fetch_add(1, std::memory_order_relaxed);
+    Job job = { .function = std::move(function), .counter = counter };
+
+    // finish() drains the continuations under the same lock as the last
+    // decrement, so the job is either seen there or queued here
+    {
+        std::lock_guard lock(dependency._mutex);
+        if (!dependency.done())
+        {
+            dependency._continuations.push_back(std::move(job));
+            return;
+        }
+    }
+    push(std::move(job));
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    unsigned int thread = currentThread();
+    while (!counter.done())
+    {
+        // The jobs left may be running elsewhere, nothing to help with
+        if (!runOne(thread))
+            std::this_thread::yield();
+    }
+    // finish() may still hold the lock after the last decrement
+    std::lock_guard lock(counter._mutex);
+}
+
+void JobSystem::parallelFor(
+  size_t count, size_t grain,
+  const std::function<void(size_t, size_t)>& function)
+{
+    if (count == 0)
+        return;
+
+    grain = std::max<size_t>(grain, 1);
+    // Not worth queuing anything
+    if (_workers.empty() || count <= grain)
+    {
+        function(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for (size_t begin = 0; begin < count; begin += grain)
+    {
+        size_t end = std::min(begin + grain, count);
+        run(
+          [&function, begin, end]()
+          {
+              function(begin, end);
+          },
+          &counter);
+    }
+    wait(counter);
+}
+
+void JobSystem::parallelFor(size_t count,
+                            const std::function<void(size_t)>& function)
+{
+    parallelFor(count,
+                1,
+                [&function](size_t begin, size_t end)
+                {
+                    for (size_t i = begin; i < end; i++)
+                        function(i);
+                });
+}
+
+void JobSystem::workerLoop(unsigned int thread)
+{
+    currentSystem = this;
+    currentIndex = thread;
+    BALDWIN_PROFILE_THREAD("Job worker");
+
+    while (true)
+    {
+        if (runOne(thread))
+            continue;
+
+        std::unique_lock lock(_sleepMutex);
+        _sleepCondition.wait(lock,
+                             [this]()
+                             {
+                                 return _stop || _queuedJobs.load() > 0;
+                             });
+        // Jobs queued before the destructor still run
+        if (_stop && _queuedJobs.load() == 0)
+            return;
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard lock(_sleepMutex);
+        _stop = true;
+    }
+    _sleepCondition.notify_all();
+
+    for (auto& worker : _workers)
+        worker.join();
+}
+
+} // namespace baldwin
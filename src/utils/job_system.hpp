@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace baldwin
+{
+
+class JobCounter;
+
+struct Job
+{
+    std::function<void()> function;
+    // Decremented once function returned
+    JobCounter* counter = nullptr;
+};
+
+// Counts the unfinished jobs of a group. Jobs chained with JobSystem::then
+// are queued as soon as it drops to zero, so a counter doubles as the
+// dependency between two stages.
+class JobCounter
+{
+  public:
+    JobCounter() = default;
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    bool done() const { return _pending.load(std::memory_order_acquire) == 0; }
+
+  private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> _pending = 0;
+    std::mutex _mutex;
+    std::vector<Job> _continuations;
+};
+
+// Work-stealing job scheduler. Every thread owns a deque, it pushes and pops
+// its own jobs at the back while idle threads steal from the front of the
+// others, so freshly spawned work stays hot in the cache of its spawner.
+// Waiting on a counter runs queued jobs instead of blocking, which lets jobs
+// spawn and wait on other jobs without deadlocking. The thread that creates
+// the system takes part as thread 0, so a system of N threads spawns N - 1
+// workers and a system of 1 thread runs everything inside wait().
+class JobSystem
+{
+  public:
+    // threadCount == 0 uses every hardware thread
+    explicit JobSystem(unsigned int threadCount = 0);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    unsigned int threadCount() const { return _queues.size(); }
+
+    // Queues function, counter is incremented right away and decremented
+    // once the job is done
+    void run(std::function<void()> function, JobCounter* counter = nullptr);
+    // Queues function once dependency reaches zero, it counts against
+    // counter from now on
+    void then(JobCounter& dependency, std::function<void()> function,
+              JobCounter* counter = nullptr);
+    // Runs jobs on the calling thread until counter reaches zero. Only then
+    // may the counter be destroyed, done() alone does not guarantee the
+    // last job let go of it.
+    void wait(JobCounter& counter);
+
+    // Calls function(begin, end) over [0, count) in ranges of at most grain
+    // items and returns once they are all done
+    void parallelFor(size_t count, size_t grain,
+                     const std::function<void(size_t, size_t)>& function);
+    // Calls function(i) for every i in [0, count), one job per index
+    void parallelFor(size_t count, const std::function<void(size_t)>& function);
+
+  private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void push(Job job);
+    bool pop(unsigned int thread, Job& job);
+    bool runOne(unsigned int thread);
+    void finish(JobCounter* counter);
+    unsigned int currentThread() const;
+    void workerLoop(unsigned int thread);
+
+    std::vector<std::unique_ptr<Queue>> _queues;
+    std::vector<std::thread> _workers;
+
+    // Idle workers sleep until something gets queued
+    std::atomic<size_t> _queuedJobs = 0;
+    std::mutex _sleepMutex;
+    std::condition_variable _sleepCondition;
+    bool _stop = false;
+};
+
+} // namespace baldwin
@@ -0,0 +1,103 @@
+#include "offset_allocator.hpp"
+
+#include <cassert>
+#include <iterator>
+
+namespace baldwin
+{
+
+void OffsetAllocator::reset(uint64_t size)
+{
+    _size = size;
+    _freeSpace = 0;
+    _freeByOffset.clear();
+    _freeBySize.clear();
+    if (size > 0)
+        insertFreeRange(0, size);
+}
+
+uint64_t OffsetAllocator::allocate(uint64_t size, uint64_t alignment)
+{
+    assert(size > 0 && alignment > 0);
+
+    // Smallest free range that still fits once aligned
+    for (auto it = _freeBySize.lower_bound(size); it != _freeBySize.end();
+         it++)
+    {
+        uint64_t rangeOffset = it->second;
+        uint64_t rangeSize = it->first;
+        uint64_t offset = (rangeOffset + alignment - 1) / alignment *
+                          alignment;
+        uint64_t padding = offset - rangeOffset;
+        if (padding + size > rangeSize)
+            continue;
+
+        eraseFreeRange(_freeByOffset.find(rangeOffset));
+
+        // Give back what is left on both sides of the allocation
+        if (padding > 0)
+            insertFreeRange(rangeOffset, padding);
+        if (padding + size < rangeSize)
+            insertFreeRange(offset + size, rangeSize - padding - size);
+
+        return offset;
+    }
+
+    return InvalidOffset;
+}
+
+void OffsetAllocator::free(uint64_t offset, uint64_t size)
+{
+    assert(offset + size <= _size);
+
+    // Coalesce with the free ranges right before and right after
+    auto next = _freeByOffset.lower_bound(offset);
+    if (next != _freeByOffset.begin())
+    {
+        auto previous = std::prev(next);
+        assert(previous->first + previous->second <= offset &&
+               "Double free in OffsetAllocator");
+        if (previous->first + previous->second == offset)
+        {
+            offset = previous->first;
+            size += previous->second;
+            eraseFreeRange(previous);
+        }
+    }
+    if (next != _freeByOffset.end() && offset + size == next->first)
+    {
+        size += next->second;
+        eraseFreeRange(next);
+    }
+
+    insertFreeRange(offset, size);
+}
+
+uint64_t OffsetAllocator::largestFreeRange() const
+{
+    return _freeBySize.empty() ? 0 : _freeBySize.rbegin()->first;
+}
+
+void OffsetAllocator::insertFreeRange(uint64_t offset, uint64_t size)
+{
+    _freeByOffset.emplace(offset, size);
+    _freeBySize.emplace(size, offset);
+    _freeSpace += size;
+}
+
+void OffsetAllocator::eraseFreeRange(std::map<uint64_t, uint64_t>::iterator it)
+{
+    auto [first, last] = _freeBySize.equal_range(it->second);
+    for (auto sizeIt = first; sizeIt != last; sizeIt++)
+    {
+        if (sizeIt->second == it->first)
+        {
+            _freeBySize.erase(sizeIt);
+            break;
+        }
+    }
+    _freeSpace -= it->second;
+    _freeByOffset.erase(it);
+}
+
+} // namespace baldwin
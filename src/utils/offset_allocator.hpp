@@ -0,0 +1,43 @@
+#pragma once
+
+#include <map>
+#include <cstddef>
+#include <cstdint>
+
+namespace baldwin
+{
+
+// Hands out ranges of a linear address space, typically to sub-allocate a
+// large GPU buffer. Allocation is best fit, and freed ranges are merged back
+// with their free neighbours so the space does not fragment over time.
+class OffsetAllocator
+{
+  public:
+    static constexpr uint64_t InvalidOffset = UINT64_MAX;
+
+    explicit OffsetAllocator(uint64_t size = 0) { reset(size); }
+
+    // Drops every allocation and makes the whole [0, size) range free
+    void reset(uint64_t size);
+
+    // Returns InvalidOffset when no free range is large enough
+    uint64_t allocate(uint64_t size, uint64_t alignment = 1);
+    // offset and size must match a previous allocation
+    void free(uint64_t offset, uint64_t size);
+
+    uint64_t size() const { return _size; }
+    uint64_t freeSpace() const { return _freeSpace; }
+    uint64_t largestFreeRange() const;
+    size_t freeRangeCount() const { return _freeByOffset.size(); }
+
+  private:
+    void insertFreeRange(uint64_t offset, uint64_t size);
+    void eraseFreeRange(std::map<uint64_t, uint64_t>::iterator it);
+
+    uint64_t _size = 0;
+    uint64_t _freeSpace = 0;
+    std::map<uint64_t, uint64_t> _freeByOffset;     // offset -> size
+    std::multimap<uint64_t, uint64_t> _freeBySize; // size -> offset
+};
+
+} // namespace baldwin
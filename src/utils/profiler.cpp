@@ -0,0 +1,219 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <iostream>
+
+namespace baldwin
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const Clock::time_point epoch = Clock::now();
+
+} // namespace
+
+thread_local Profiler::Track* Profiler::_threadTrack = nullptr;
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+int64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                                epoch)
+      .count();
+}
+
+Profiler::Track& Profiler::threadTrack()
+{
+    if (_threadTrack)
+        return *_threadTrack;
+
+    std::lock_guard lock(_tracksMutex);
+    _threadTrack = &_tracks.emplace_back();
+    return *_threadTrack;
+}
+
+void Profiler::setThreadName(const char* name) { threadTrack().name = name; }
+
+uint32_t Profiler::addTrack(const char* name)
+{
+    std::lock_guard lock(_tracksMutex);
+    _tracks.emplace_back().name = name;
+    return static_cast<uint32_t>(_tracks.size() - 1);
+}
+
+void Profiler::record(const char* name, int64_t startNs, int64_t endNs)
+{
+    Track& track = threadTrack();
+    std::lock_guard lock(track.mutex);
+    track.events.push_back({ name, startNs, endNs });
+}
+
+void Profiler::record(uint32_t trackIndex, const char* name, int64_t startNs,
+                      int64_t endNs)
+{
+    Track* track;
+    {
+        std::lock_guard lock(_tracksMutex);
+        track = &_tracks[trackIndex];
+    }
+    std::lock_guard lock(track->mutex);
+    track->events.push_back({ name, startNs, endNs });
+}
+
+void Profiler::endFrame()
+{
+    std::lock_guard statsLock(_statsMutex);
+    std::lock_guard tracksLock(_tracksMutex);
+    for (uint32_t trackIndex = 0; trackIndex < _tracks.size(); trackIndex++)
+    {
+        // Swapped so both vectors keep their capacity across frames
+        Track& track = _tracks[trackIndex];
+        {
+            std::lock_guard lock(track.mutex);
+            track.events.swap(_drained);
+        }
+
+        for (const ProfileEvent& event : _drained)
+        {
+            ZoneHistory& zone = _zones[event.name];
+            zone.name = event.name;
+            zone.samplesMs[zone.next] = static_cast<float>(
+              (event.endNs - event.startNs) / 1e6);
+            zone.next = (zone.next + 1) % HistorySize;
+            zone.count = std::min(zone.count + 1, HistorySize);
+
+            if (!_capturing)
+                continue;
+            if (_capture.size() < MaxCaptureEvents)
+                _capture.push_back({ event, trackIndex });
+            else
+                _droppedEvents++;
+        }
+        _drained.clear();
+    }
+}
+
+void Profiler::beginCapture()
+{
+    std::lock_guard lock(_statsMutex);
+    _capture.clear();
+    _droppedEvents = 0;
+    _capturing = true;
+}
+
+bool Profiler::endCapture(const std::filesystem::path& path)
+{
+    std::lock_guard statsLock(_statsMutex);
+    _capturing = false;
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not write trace " << path.string() << '\n';
+        return false;
+    }
+
+    // Names are literals from our own code, nothing to escape
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    {
+        std::lock_guard tracksLock(_tracksMutex);
+        for (size_t i = 0; i < _tracks.size(); i++)
+        {
+            std::string name = _tracks[i].name ? _tracks[i].name
+                                               : std::format("Thread {}", i);
+            file << std::format("{{\"ph\":\"M\",\"name\":\"thread_name\","
+                                "\"pid\":0,\"tid\":{},"
+                                "\"args\":{{\"name\":\"{}\"}}}},\n",
+                                i,
+                                name);
+        }
+    }
+    for (size_t i = 0; i < _capture.size(); i++)
+    {
+        const CapturedEvent& captured = _capture[i];
+        file << std::format("{{\"ph\":\"X\",\"name\":\"{}\",\"pid\":0,"
+                            "\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}{}\n",
+                            captured.event.name,
+                            captured.track,
+                            captured.event.startNs / 1e3,
+                            (captured.event.endNs - captured.event.startNs) /
+                              1e3,
+                            i + 1 < _capture.size() ? "," : "");
+    }
+    file << "]}\n";
+
+    if (_droppedEvents > 0)
+        std::cout << std::format("Trace {} is missing {} events\n",
+                                 path.string(),
+                                 _droppedEvents);
+    _capture.clear();
+    _capture.shrink_to_fit();
+    return static_cast<bool>(file);
+}
+
+std::vector<ProfileZoneSummary> Profiler::summary() const
+{
+    std::vector<ProfileZoneSummary> zones;
+    std::vector<float> sorted;
+    std::lock_guard lock(_statsMutex);
+    for (const auto& [key, zone] : _zones)
+    {
+        if (zone.count == 0)
+            continue;
+        sorted.assign(zone.samplesMs.begin(),
+                      zone.samplesMs.begin() + zone.count);
+        std::sort(sorted.begin(), sorted.end());
+
+        double sum = 0.0;
+        for (float sample : sorted)
+            sum += sample;
+        size_t p99 = static_cast<size_t>(std::ceil(sorted.size() * 0.99)) - 1;
+        zones.push_back({ .name = zone.name,
+                          .minMs = sorted.front(),
+                          .avgMs = sum / sorted.size(),
+                          .p99Ms = sorted[p99],
+                          .samples = zone.count });
+    }
+    std::sort(zones.begin(),
+              zones.end(),
+              [](const ProfileZoneSummary& a, const ProfileZoneSummary& b)
+              {
+                  return a.avgMs > b.avgMs;
+              });
+    return zones;
+}
+
+void Profiler::printSummary() const
+{
+    std::cout << std::format("{:<28} {:>9} {:>9} {:>9}\n",
+                             "Zone",
+                             "min ms",
+                             "avg ms",
+                             "p99 ms");
+    for (const ProfileZoneSummary& zone : summary())
+        std::cout << std::format("{:<28} {:>9.3f} {:>9.3f} {:>9.3f}\n",
+                                 zone.name,
+                                 zone.minMs,
+                                 zone.avgMs,
+                                 zone.p99Ms);
+}
+
+void Profiler::clearStatistics()
+{
+    std::lock_guard lock(_statsMutex);
+    _zones.clear();
+}
+
+} // namespace baldwin
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+#include <unordered_map>
+
+namespace baldwin
+{
+
+// Zone and track names are kept as pointers, they must be string literals
+struct ProfileEvent
+{
+    const char* name;
+    int64_t startNs;
+    int64_t endNs;
+};
+
+struct ProfileZoneSummary
+{
+    const char* name;
+    double minMs;
+    double avgMs;
+    double p99Ms;
+    uint32_t samples;
+};
+
+// Collects timed zones from every thread. Each thread appends to its own
+// track under a lock nobody else takes outside endFrame, which drains every
+// track into rolling per zone statistics and, while capturing, into a trace
+// for chrome://tracing or Perfetto. Zones are a couple of clock reads, cheap
+// enough to leave on, and the macros below compile to nothing without
+// BALDWIN_PROFILING.
+class Profiler
+{
+  public:
+    static Profiler& instance();
+
+    // Nanoseconds on the clock of every event
+    static int64_t now();
+
+    // Names the track of the calling thread in traces
+    void setThreadName(const char* name);
+    // Tracks not tied to a thread, the GPU queue for instance
+    uint32_t addTrack(const char* name);
+
+    // Into the track of the calling thread
+    void record(const char* name, int64_t startNs, int64_t endNs);
+    void record(uint32_t track, const char* name, int64_t startNs,
+                int64_t endNs);
+
+    // From a single thread, once per frame
+    void endFrame();
+
+    void beginCapture();
+    // Writes the events since beginCapture as Chrome trace JSON
+    bool endCapture(const std::filesystem::path& path);
+
+    // Over the last HistorySize samples of each zone, slowest first
+    std::vector<ProfileZoneSummary> summary() const;
+    void printSummary() const;
+    // Forgets the samples of every zone, events not drained yet are kept
+    void clearStatistics();
+
+  private:
+    static constexpr uint32_t HistorySize = 512;
+    static constexpr size_t MaxCaptureEvents = 1 << 20;
+
+    struct Track
+    {
+        const char* name = nullptr;
+        std::mutex mutex;
+        std::vector<ProfileEvent> events;
+    };
+
+    struct ZoneHistory
+    {
+        const char* name = nullptr;
+        std::array<float, HistorySize> samplesMs{};
+        uint32_t count = 0;
+        uint32_t next = 0;
+    };
+
+    struct CapturedEvent
+    {
+        ProfileEvent event;
+        uint32_t track;
+    };
+
+    Profiler() = default;
+    Track& threadTrack();
+
+    // One per thread that ever recorded, kept for the life of the program.
+    // Deque so tracks keep their address when others are added.
+    mutable std::mutex _tracksMutex;
+    std::deque<Track> _tracks;
+    static thread_local Track* _threadTrack;
+
+    // Only touched by endFrame, summary and the capture calls
+    mutable std::mutex _statsMutex;
+    std::vector<ProfileEvent> _drained;
+    std::unordered_map<std::string_view, ZoneHistory> _zones;
+    bool _capturing = false;
+    std::vector<CapturedEvent> _capture;
+    size_t _droppedEvents = 0;
+};
+
+// Records the enclosing scope
+class ProfileScope
+{
+  public:
+    explicit ProfileScope(const char* name)
+        : _name(name), _start(Profiler::now())
+    {
+    }
+    ~ProfileScope()
+    {
+        Profiler::instance().record(_name, _start, Profiler::now());
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+  private:
+    const char* _name;
+    int64_t _start;
+};
+
+} // namespace baldwin
+
+#define BALDWIN_CONCAT_INNER(a, b) a##b
+#define BALDWIN_CONCAT(a, b) BALDWIN_CONCAT_INNER(a, b)
+
+#ifdef BALDWIN_PROFILING
+#define BALDWIN_PROFILE_ZONE(name)                                             \
+    ::baldwin::ProfileScope BALDWIN_CONCAT(profileZone, __LINE__)(name)
+#define BALDWIN_PROFILE_THREAD(name)                                           \
+    ::baldwin::Profiler::instance().setThreadName(name)
+#define BALDWIN_PROFILE_FRAME() ::baldwin::Profiler::instance().endFrame()
+#else
+#define BALDWIN_PROFILE_ZONE(name)
+#define BALDWIN_PROFILE_THREAD(name)
+#define BALDWIN_PROFILE_FRAME()
+#endif